@@ -33,6 +33,15 @@
 
 #include "drm_crtc_internal.h"
 
+void __drm_crtc_commit_free(struct kref *kref)
+{
+	struct drm_crtc_commit *commit =
+		container_of(kref, struct drm_crtc_commit, ref);
+
+	kfree(commit);
+}
+EXPORT_SYMBOL(__drm_crtc_commit_free);
+
 /**
  * drm_atomic_state_default_release -
  * release memory initialized by drm_atomic_state_init
@@ -47,6 +56,7 @@ void drm_atomic_state_default_release(struct drm_atomic_state *state)
 	kfree(state->connector_states);
 	kfree(state->crtcs);
 	kfree(state->crtc_states);
+	kfree(state->crtc_commits);
 	kfree(state->planes);
 	kfree(state->plane_states);
 }
@@ -76,6 +86,10 @@ drm_atomic_state_init(struct drm_device *dev, struct drm_atomic_state *state)
 				     sizeof(*state->crtc_states), GFP_KERNEL);
 	if (!state->crtc_states)
 		goto fail;
+	state->crtc_commits = kcalloc(dev->mode_config.num_crtc,
+				      sizeof(*state->crtc_commits), GFP_KERNEL);
+	if (!state->crtc_commits)
+		goto fail;
 	state->planes = kcalloc(dev->mode_config.num_total_plane,
 				sizeof(*state->planes), GFP_KERNEL);
 	if (!state->planes)
@@ -159,8 +173,16 @@ void drm_atomic_state_default_clear(struct drm_atomic_state *state)
 
 		crtc->funcs->atomic_destroy_state(crtc,
 						  state->crtc_states[i]);
+
+		if (state->crtc_commits[i]) {
+			kfree(state->crtc_commits[i]->event);
+			state->crtc_commits[i]->event = NULL;
+			drm_crtc_commit_put(state->crtc_commits[i]);
+		}
+
 		state->crtcs[i] = NULL;
 		state->crtc_states[i] = NULL;
+		state->crtc_commits[i] = NULL;
 	}
 
 	for (i = 0; i < config->num_total_plane; i++) {
@@ -574,7 +574,6 @@ struct drm_device *drm_dev_alloc(struct drm_driver *driver,
 	INIT_LIST_HEAD(&dev->ctxlist);
 	INIT_LIST_HEAD(&dev->vmalist);
 	INIT_LIST_HEAD(&dev->maplist);
-	INIT_LIST_HEAD(&dev->vblank_event_list);
 
 	spin_lock_init(&dev->buf_lock);
 	spin_lock_init(&dev->event_lock);
@@ -935,6 +934,7 @@ module_exit(drm_core_exit);
 #include <linux/dmi.h>
 #include <drm/drmP.h>
 #include <drm/drm_core.h>
+#include <drm/drm_tracebuf.h>
 
 static int drm_load(struct drm_device *dev);
 drm_pci_id_list_t *drm_find_description(int vendor, int device,
@@ -1125,6 +1125,7 @@ static int drm_load(struct drm_device *dev)
 	INIT_LIST_HEAD(&dev->maplist);
 
 	drm_sysctl_init(dev);
+	drm_ioctl_stats_init(dev);
 	INIT_LIST_HEAD(&dev->filelist);
 
 	dev->counters  = 6;
@@ -1138,8 +1139,6 @@ static int drm_load(struct drm_device *dev)
 	for (i = 0; i < ARRAY_SIZE(dev->counts); i++)
 		atomic_set(&dev->counts[i], 0);
 
-	INIT_LIST_HEAD(&dev->vblank_event_list);
-
 	if (drm_core_check_feature(dev, DRIVER_USE_AGP)) {
 		if (drm_pci_device_is_agp(dev))
 			dev->agp = drm_agp_init(dev);
@@ -1177,6 +1176,7 @@ static int drm_load(struct drm_device *dev)
 
 error1:
 	drm_gem_destroy(dev);
+	drm_ioctl_stats_fini(dev);
 	drm_sysctl_cleanup(dev);
 	DRM_LOCK(dev);
 	drm_lastclose(dev);
@@ -1231,6 +1231,7 @@ void drm_cdevpriv_dtor(void *cd)
 	if (dev->driver->postclose != NULL)
 		dev->driver->postclose(dev, file_priv);
 	list_del(&file_priv->lhead);
+	lockuninit(&file_priv->event_read_lock);
 
 
 	/* ========================================================
@@ -1294,6 +1295,8 @@ drm_core_init(void *arg)
 {
 
 	drm_global_init();
+	drm_mm_core_init();
+	drm_trace_init();
 
 	DRM_INFO("Initialized %s %d.%d.%d %s\n",
 		 CORE_NAME, CORE_MAJOR, CORE_MINOR, CORE_PATCHLEVEL, CORE_DATE);
@@ -1304,6 +1307,8 @@ static void
 drm_core_exit(void *arg)
 {
 
+	drm_trace_fini();
+	drm_mm_core_exit();
 	drm_global_release();
 }
 
@@ -239,6 +239,7 @@ int drm_open_helper(struct cdev *kdev, int flags, int fmt, DRM_STRUCTPROC *p,
 	INIT_LIST_HEAD(&priv->event_list);
 	init_waitqueue_head(&priv->event_wait);
 	priv->event_space = 4096; /* set aside 4k for event buffer */
+	lockinit(&priv->event_read_lock, "dperl", 0, 0);
 
 	if (drm_core_check_feature(dev, DRIVER_GEM))
 		drm_gem_open(dev, priv);
@@ -247,6 +248,7 @@ int drm_open_helper(struct cdev *kdev, int flags, int fmt, DRM_STRUCTPROC *p,
 		/* shared code returns -errno */
 		retcode = -dev->driver->open(dev, priv);
 		if (retcode != 0) {
+			lockuninit(&priv->event_read_lock);
 			kfree(priv);
 			DRM_UNLOCK(dev);
 			return retcode;
@@ -354,7 +356,6 @@ int drm_release(device_t kdev)
 
 	DRM_DEBUG("\n");
 
-	drm_sysctl_cleanup(dev);
 	if (dev->devnode != NULL)
 		destroy_dev(dev->devnode);
 
@@ -391,6 +392,10 @@ int drm_release(device_t kdev)
 		DRM_UNLOCK(dev);
 	}
 
+	/* Only now that the driver's nodes below hw.dri.N are gone */
+	drm_ioctl_stats_fini(dev);
+	drm_sysctl_cleanup(dev);
+
 	if (pci_disable_busmaster(dev->dev->bsddev))
 		DRM_ERROR("Request to disable bus-master failed.\n");
 
@@ -418,33 +423,69 @@ int drm_release(device_t kdev)
 }
 EXPORT_SYMBOL(drm_release);
 
-static bool
-drm_dequeue_event(struct drm_device *dev, struct drm_file *file_priv,
-    struct uio *uio, struct drm_pending_event **out)
+/*
+ * Detach as many queued events as fit into @resid bytes onto @batch, in one
+ * hold of the event lock.  Returns the number of bytes detached.
+ */
+static size_t
+drm_dequeue_events(struct drm_device *dev, struct drm_file *file_priv,
+    size_t resid, struct list_head *batch)
 {
-	struct drm_pending_event *e;
-	bool ret = false;
+	struct drm_pending_event *e, *t;
+	size_t len = 0;
 
 	lockmgr(&dev->event_lock, LK_EXCLUSIVE);
+	list_for_each_entry_safe(e, t, &file_priv->event_list, link) {
+		if (len + e->event->length > resid)
+			break;
+		len += e->event->length;
+		list_move_tail(&e->link, batch);
+	}
+	file_priv->event_space += len;
+	file_priv->event_pending -= len;
+	lockmgr(&dev->event_lock, LK_RELEASE);
 
-	*out = NULL;
-	if (list_empty(&file_priv->event_list))
-		goto out;
-	e = list_first_entry(&file_priv->event_list,
-	    struct drm_pending_event, link);
-	if (e->event->length > uio->uio_resid)
-		goto out;
+	return len;
+}
+
+/*
+ * Put events which could not be copied out back at the head of the queue,
+ * in their original order.
+ */
+static void
+drm_requeue_events(struct drm_device *dev, struct drm_file *file_priv,
+    struct list_head *batch)
+{
+	struct drm_pending_event *e;
+	size_t len = 0;
 
-	file_priv->event_space += e->event->length;
-	list_del(&e->link);
-	*out = e;
-	ret = true;
+	list_for_each_entry(e, batch, link)
+		len += e->event->length;
 
-out:
+	lockmgr(&dev->event_lock, LK_EXCLUSIVE);
+	list_splice(batch, &file_priv->event_list);
+	file_priv->event_space -= len;
+	file_priv->event_pending += len;
 	lockmgr(&dev->event_lock, LK_RELEASE);
-	return ret;
 }
 
+static void
+drm_destroy_events(struct list_head *list)
+{
+	struct drm_pending_event *e, *t;
+
+	list_for_each_entry_safe(e, t, list, link) {
+		list_del(&e->link);
+		e->destroy(e);
+	}
+}
+
+/*
+ * Size of the on-stack buffer drm_read() gathers events in, so that a burst
+ * of small vblank and flip events goes out with a single uiomove().
+ */
+#define DRM_READ_GATHER	512
+
 /**
  * drm_read - read method for DRM file
  * @filp: file pointer
@@ -464,7 +505,8 @@ out:
  * This function will only ever read a full event. Therefore userspace must
  * supply a big enough buffer to fit any event to ensure forward progress. Since
  * the maximum event space is currently 4K it's recommended to just use that for
- * safety.
+ * safety. All events which fit into the buffer are dequeued at once, and the
+ * number of bytes pending is reported in the data field of EVFILT_READ knotes.
  *
  * RETURNS:
  *
@@ -478,6 +520,9 @@ int drm_read(struct dev_read_args *ap)
 	struct drm_file *file_priv;
 	struct drm_device *dev = drm_get_device_from_kdev(kdev);
 	struct drm_pending_event *e;
+	struct list_head batch, copied;
+	char buf[DRM_READ_GATHER];
+	size_t len;
 	int error;
 	int ret;
 
@@ -494,13 +539,56 @@ int drm_read(struct dev_read_args *ap)
 	if (ret < 0)
 		return -ret;
 
-	while (drm_dequeue_event(dev, file_priv, uio, &e)) {
-		error = uiomove((caddr_t)e->event, e->event->length, uio);
-		e->destroy(e);
-		if (error != 0)
-			return (error);
+	error = lockmgr(&file_priv->event_read_lock, LK_EXCLUSIVE | LK_PCATCH);
+	if (error != 0)
+		return (error);
+
+	INIT_LIST_HEAD(&batch);
+	INIT_LIST_HEAD(&copied);
+	if (drm_dequeue_events(dev, file_priv, uio->uio_resid, &batch) == 0)
+		goto out;
+
+	/*
+	 * Gather the batch into buf and copy it out in as few uiomove()
+	 * calls as possible.  Events are only destroyed once they have
+	 * reached userspace, so a failed copy can put them back.
+	 */
+	len = 0;
+	while (!list_empty(&batch)) {
+		e = list_first_entry(&batch, struct drm_pending_event, link);
+		if (len != 0 && len + e->event->length > sizeof(buf)) {
+			error = uiomove(buf, len, uio);
+			if (error != 0)
+				break;
+			len = 0;
+			drm_destroy_events(&copied);
+		}
+		if (e->event->length > sizeof(buf)) {
+			error = uiomove((caddr_t)e->event, e->event->length,
+			    uio);
+			if (error != 0)
+				break;
+			list_del(&e->link);
+			e->destroy(e);
+			continue;
+		}
+		memcpy(buf + len, e->event, e->event->length);
+		len += e->event->length;
+		list_move_tail(&e->link, &copied);
+	}
+	if (error == 0 && len != 0)
+		error = uiomove(buf, len, uio);
+
+	if (error != 0) {
+		list_splice_tail_init(&batch, &copied);
+		drm_requeue_events(dev, file_priv, &copied);
+	} else {
+		drm_destroy_events(&copied);
 	}
 
+out:
+	lockmgr(&file_priv->event_read_lock, LK_RELEASE);
+
 	return (error);
 }
 
@@ -533,6 +621,8 @@ drmfilt(struct knote *kn, long hint)
 	lockmgr(&dev->event_lock, LK_EXCLUSIVE);
 	if (!list_empty(&file_priv->event_list))
 		ready = 1;
+	/* Let clients size their reads */
+	kn->kn_data = file_priv->event_pending;
 	lockmgr(&dev->event_lock, LK_RELEASE);
 
 	return (ready);
@@ -723,8 +813,20 @@ void drm_send_event_locked(struct drm_device *dev, struct drm_pending_event *e)
 {
 	assert_spin_locked(&dev->event_lock);
 
+	if (e->completion) {
+		complete_all(e->completion);
+		e->completion = NULL;
+	}
+
+	/* Kernel-internal events only exist to signal their completion */
+	if (!e->file_priv) {
+		kfree(e);
+		return;
+	}
+
 	list_add_tail(&e->link,
 		      &e->file_priv->event_list);
+	e->file_priv->event_pending += e->event->length;
 	wake_up_interruptible(&e->file_priv->event_wait);
 #ifdef __DragonFly__
 	KNOTE(&e->file_priv->dkq.ki_note, 0);
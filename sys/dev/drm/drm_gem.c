@@ -580,6 +580,43 @@ drm_gem_object_lookup(struct drm_file *filp, u32 handle)
 }
 EXPORT_SYMBOL(drm_gem_object_lookup);
 
+/**
+ * drm_gem_objects_lookup - look up an array of GEM objects from their handles
+ * @filp: DRM file private date
+ * @handles: userspace handles
+ * @count: number of handles
+ * @objs: array receiving the objects
+ *
+ * Like drm_gem_object_lookup(), but takes the handle table lock only once for
+ * the whole array. Each entry of @objs which was found holds a reference the
+ * caller has to drop, entries for handles which do not exist are NULL.
+ *
+ * Returns:
+ *
+ * The number of handles which could not be looked up.
+ */
+int
+drm_gem_objects_lookup(struct drm_file *filp, const u32 *handles, int count,
+		       struct drm_gem_object **objs)
+{
+	int i, missing = 0;
+
+	lockmgr(&filp->table_lock, LK_EXCLUSIVE);
+
+	for (i = 0; i < count; i++) {
+		objs[i] = idr_find(&filp->object_idr, handles[i]);
+		if (objs[i] == NULL)
+			missing++;
+		else
+			drm_gem_object_reference(objs[i]);
+	}
+
+	lockmgr(&filp->table_lock, LK_RELEASE);
+
+	return missing;
+}
+EXPORT_SYMBOL(drm_gem_objects_lookup);
+
 /**
  * drm_gem_close_ioctl - implementation of the GEM_CLOSE ioctl
  * @dev: drm_device
@@ -38,16 +38,39 @@
 #include <linux/slab.h>
 #include <linux/export.h>
 
-int drm_ht_create(struct drm_open_hash *ht, unsigned int order)
+/*
+ * Tables start out at the order passed to drm_ht_create() and are resized
+ * by a factor of two whenever the average chain length leaves
+ * [1/DRM_HT_MIN_LOAD, DRM_HT_MAX_LOAD].  Resizing is incremental: the
+ * previous table is kept next to the new one and every insert or remove
+ * moves DRM_HT_MIGRATE_STEP of its buckets over, so no single operation
+ * pays for rehashing the whole table.  Lookups walk both tables.  As the
+ * previous table is freed once it has been drained, lookups must be
+ * serialized against modifications like everything else.  The new table
+ * is allocated without sleeping; if that fails the table simply stays at
+ * its current size for now.
+ */
+#define DRM_HT_MAX_LOAD		2
+#define DRM_HT_MIN_LOAD		8
+#define DRM_HT_MAX_ORDER	20
+#define DRM_HT_MIGRATE_STEP	4
+
+static struct hlist_head *drm_ht_alloc_table(unsigned int order, int flags)
 {
-	unsigned int size = 1 << order;
+	return kmalloc((1UL << order) * sizeof(struct hlist_head), M_DRM,
+		       flags | M_ZERO);
+}
 
+int drm_ht_create(struct drm_open_hash *ht, unsigned int order)
+{
 	ht->order = order;
-	ht->table = NULL;
-	if (size <= PAGE_SIZE / sizeof(*ht->table))
-		ht->table = kcalloc(size, sizeof(*ht->table), GFP_KERNEL);
-	else
-		ht->table = kcalloc(size, sizeof(*ht->table), GFP_KERNEL);
+	ht->min_order = order;
+	ht->old_table = NULL;
+	ht->old_order = 0;
+	ht->migrate = 0;
+	ht->count = 0;
+	ht->resizes = 0;
+	ht->table = drm_ht_alloc_table(order, M_WAITOK);
 	if (!ht->table) {
 		DRM_ERROR("Out of memory for hash table\n");
 		return -ENOMEM;
@@ -56,66 +79,30 @@ int drm_ht_create(struct drm_open_hash *ht, unsigned int order)
 }
 EXPORT_SYMBOL(drm_ht_create);
 
-void drm_ht_verbose_list(struct drm_open_hash *ht, unsigned long key)
-{
-	struct drm_hash_item *entry;
-	struct hlist_head *h_list;
-	unsigned int hashed_key;
-	int count = 0;
-
-	hashed_key = hash_long(key, ht->order);
-	DRM_DEBUG("Key is 0x%08lx, Hashed key is 0x%08x\n", key, hashed_key);
-	h_list = &ht->table[hashed_key];
-	hlist_for_each_entry(entry, h_list, head)
-		DRM_DEBUG("count %d, key: 0x%08lx\n", count++, entry->key);
-}
-
-static struct hlist_node *drm_ht_find_key(struct drm_open_hash *ht,
-					  unsigned long key)
+static struct drm_hash_item *drm_ht_chain_find(struct hlist_head *h_list,
+					       unsigned long key)
 {
 	struct drm_hash_item *entry;
-	struct hlist_head *h_list;
-	unsigned int hashed_key;
 
-	hashed_key = hash_long(key, ht->order);
-	h_list = &ht->table[hashed_key];
-	hlist_for_each_entry(entry, h_list, head) {
-		if (entry->key == key)
-			return &entry->head;
-		if (entry->key > key)
-			break;
-	}
-	return NULL;
-}
-
-static struct hlist_node *drm_ht_find_key_rcu(struct drm_open_hash *ht,
-					      unsigned long key)
-{
-	struct drm_hash_item *entry;
-	struct hlist_head *h_list;
-	unsigned int hashed_key;
-
-	hashed_key = hash_long(key, ht->order);
-	h_list = &ht->table[hashed_key];
 	hlist_for_each_entry_rcu(entry, h_list, head) {
 		if (entry->key == key)
-			return &entry->head;
+			return entry;
 		if (entry->key > key)
 			break;
 	}
 	return NULL;
 }
 
-int drm_ht_insert_item(struct drm_open_hash *ht, struct drm_hash_item *item)
+/* Insert @item into its sorted chain of @table */
+static int drm_ht_link(struct hlist_head *table, unsigned int order,
+		       struct drm_hash_item *item)
 {
 	struct drm_hash_item *entry;
 	struct hlist_head *h_list;
 	struct hlist_node *parent;
-	unsigned int hashed_key;
 	unsigned long key = item->key;
 
-	hashed_key = hash_long(key, ht->order);
-	h_list = &ht->table[hashed_key];
+	h_list = &table[hash_long(key, order)];
 	parent = NULL;
 	hlist_for_each_entry(entry, h_list, head) {
 		if (entry->key == key)
@@ -131,6 +118,111 @@ int drm_ht_insert_item(struct drm_open_hash *ht, struct drm_hash_item *item)
 	}
 	return 0;
 }
+
+static void drm_ht_migrate(struct drm_open_hash *ht, unsigned int nbuckets)
+{
+	struct drm_hash_item *entry, *last;
+	struct hlist_head *h_list;
+
+	while (ht->old_table != NULL && nbuckets-- > 0) {
+		h_list = &ht->old_table[ht->migrate];
+		while (!hlist_empty(h_list)) {
+			last = NULL;
+			hlist_for_each_entry(entry, h_list, head)
+				last = entry;
+			hlist_del_init_rcu(&last->head);
+			drm_ht_link(ht->table, ht->order, last);
+		}
+		if (++ht->migrate == 1U << ht->old_order) {
+			kfree(ht->old_table);
+			ht->old_table = NULL;
+		}
+	}
+}
+
+static void drm_ht_resize(struct drm_open_hash *ht)
+{
+	unsigned long size = 1UL << ht->order;
+	struct hlist_head *table;
+	unsigned int order;
+
+	if (ht->old_table != NULL)
+		return;
+
+	if (ht->count > size * DRM_HT_MAX_LOAD &&
+	    ht->order < DRM_HT_MAX_ORDER)
+		order = ht->order + 1;
+	else if (ht->count < size / DRM_HT_MIN_LOAD &&
+		 ht->order > ht->min_order)
+		order = ht->order - 1;
+	else
+		return;
+
+	table = drm_ht_alloc_table(order, M_NOWAIT);
+	if (table == NULL)
+		return;
+
+	ht->old_table = ht->table;
+	ht->old_order = ht->order;
+	ht->migrate = 0;
+	ht->table = table;
+	ht->order = order;
+	ht->resizes++;
+}
+
+void drm_ht_verbose_list(struct drm_open_hash *ht, unsigned long key)
+{
+	struct drm_hash_item *entry;
+	struct hlist_head *h_list;
+	unsigned int hashed_key;
+	int count = 0;
+
+	hashed_key = hash_long(key, ht->order);
+	DRM_DEBUG("Key is 0x%08lx, Hashed key is 0x%08x\n", key, hashed_key);
+	h_list = &ht->table[hashed_key];
+	hlist_for_each_entry(entry, h_list, head)
+		DRM_DEBUG("count %d, key: 0x%08lx\n", count++, entry->key);
+	if (ht->old_table != NULL) {
+		h_list = &ht->old_table[hash_long(key, ht->old_order)];
+		hlist_for_each_entry(entry, h_list, head)
+			DRM_DEBUG("count %d, key: 0x%08lx (migrating)\n",
+				  count++, entry->key);
+	}
+}
+
+static struct drm_hash_item *drm_ht_find_key(struct drm_open_hash *ht,
+					     unsigned long key)
+{
+	struct hlist_head *old_table = ht->old_table;
+	struct drm_hash_item *entry = NULL;
+
+	if (old_table != NULL)
+		entry = drm_ht_chain_find(&old_table[hash_long(key,
+		    ht->old_order)], key);
+	if (entry == NULL)
+		entry = drm_ht_chain_find(&ht->table[hash_long(key,
+		    ht->order)], key);
+	return entry;
+}
+
+int drm_ht_insert_item(struct drm_open_hash *ht, struct drm_hash_item *item)
+{
+	int ret;
+
+	if (ht->old_table != NULL &&
+	    drm_ht_chain_find(&ht->old_table[hash_long(item->key,
+	    ht->old_order)], item->key) != NULL)
+		return -EINVAL;
+
+	ret = drm_ht_link(ht->table, ht->order, item);
+	if (ret)
+		return ret;
+
+	ht->count++;
+	drm_ht_resize(ht);
+	drm_ht_migrate(ht, DRM_HT_MIGRATE_STEP);
+	return 0;
+}
 EXPORT_SYMBOL(drm_ht_insert_item);
 
 /*
@@ -165,44 +257,247 @@ EXPORT_SYMBOL(drm_ht_just_insert_please);
 int drm_ht_find_item(struct drm_open_hash *ht, unsigned long key,
 		     struct drm_hash_item **item)
 {
-	struct hlist_node *list;
+	struct drm_hash_item *entry;
 
-	list = drm_ht_find_key_rcu(ht, key);
-	if (!list)
+	entry = drm_ht_find_key(ht, key);
+	if (!entry)
 		return -EINVAL;
 
-	*item = hlist_entry(list, struct drm_hash_item, head);
+	*item = entry;
 	return 0;
 }
 EXPORT_SYMBOL(drm_ht_find_item);
 
 int drm_ht_remove_key(struct drm_open_hash *ht, unsigned long key)
 {
-	struct hlist_node *list;
+	struct drm_hash_item *entry;
 
-	list = drm_ht_find_key(ht, key);
-	if (list) {
-		hlist_del_init_rcu(list);
-		return 0;
-	}
+	entry = drm_ht_find_key(ht, key);
+	if (entry)
+		return drm_ht_remove_item(ht, entry);
 	return -EINVAL;
 }
 
 int drm_ht_remove_item(struct drm_open_hash *ht, struct drm_hash_item *item)
 {
 	hlist_del_init_rcu(&item->head);
+	ht->count--;
+	drm_ht_resize(ht);
+	drm_ht_migrate(ht, DRM_HT_MIGRATE_STEP);
 	return 0;
 }
 EXPORT_SYMBOL(drm_ht_remove_item);
 
+static void drm_ht_chain_stats(struct hlist_head *table, unsigned int order,
+			       struct drm_ht_stats *stats)
+{
+	struct drm_hash_item *entry;
+	unsigned long i, len;
+
+	for (i = 0; i < 1UL << order; i++) {
+		len = 0;
+		hlist_for_each_entry(entry, &table[i], head)
+			len++;
+		if (len == 0)
+			continue;
+		stats->used++;
+		if (len > stats->max_chain)
+			stats->max_chain = len;
+		stats->chains[min_t(unsigned long, len,
+				    DRM_HT_CHAIN_HIST) - 1]++;
+	}
+}
+
+/**
+ * drm_ht_stats - collect chain length statistics
+ * @ht: hash table
+ * @stats: filled in with the current state of @ht
+ *
+ * Walks every bucket, so callers must hold whatever lock serializes
+ * modifications of @ht.  While the table is being resized both the old
+ * and the new buckets are accounted.
+ */
+void drm_ht_stats(struct drm_open_hash *ht, struct drm_ht_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+	stats->items = ht->count;
+	stats->buckets = 1UL << ht->order;
+	stats->resizes = ht->resizes;
+	drm_ht_chain_stats(ht->table, ht->order, stats);
+	if (ht->old_table != NULL) {
+		stats->buckets += (1UL << ht->old_order) - ht->migrate;
+		drm_ht_chain_stats(ht->old_table, ht->old_order, stats);
+	}
+}
+EXPORT_SYMBOL(drm_ht_stats);
+
 void drm_ht_remove(struct drm_open_hash *ht)
 {
+	if (ht->old_table) {
+		kfree(ht->old_table);
+		ht->old_table = NULL;
+	}
 	if (ht->table) {
-		if ((PAGE_SIZE / sizeof(*ht->table)) >> ht->order)
-			kfree(ht->table);
-		else
-			kfree(ht->table);
+		kfree(ht->table);
 		ht->table = NULL;
 	}
 }
 EXPORT_SYMBOL(drm_ht_remove);
+
+/*
+ * Resize stress check, run by writing a non-zero value to
+ * hw.dri.hashtab_selftest.  A small table is grown to
+ * DRM_HT_TEST_ITEMS entries and drained again in a different order.
+ * Every key is looked up, and duplicate inserts are tried while tables are
+ * being migrated, so entries in both the old and the new buckets are
+ * covered.  The write fails if anything goes wrong, with details in the
+ * kernel log.
+ */
+#define DRM_HT_TEST_ITEMS	4096
+#define DRM_HT_TEST_ORDER	4
+
+static unsigned long drm_ht_test_key(int i)
+{
+	/* Distinct, and spread out of insertion order */
+	return (unsigned long)i * 2654435761UL + 1;
+}
+
+static int drm_ht_test_check(struct drm_open_hash *ht,
+			     struct drm_hash_item *items, const bool *present,
+			     const char *phase)
+{
+	struct drm_hash_item *item;
+	struct drm_ht_stats stats;
+	unsigned long count = 0;
+	int i, ret;
+
+	for (i = 0; i < DRM_HT_TEST_ITEMS; i++) {
+		ret = drm_ht_find_item(ht, items[i].key, &item);
+		if (present[i] && (ret != 0 || item != &items[i])) {
+			DRM_ERROR("hashtab selftest %s: key %lx lost\n",
+				  phase, items[i].key);
+			return -EINVAL;
+		}
+		if (!present[i] && ret == 0) {
+			DRM_ERROR("hashtab selftest %s: key %lx not removed\n",
+				  phase, items[i].key);
+			return -EINVAL;
+		}
+		if (present[i])
+			count++;
+	}
+
+	drm_ht_stats(ht, &stats);
+	if (stats.items != count) {
+		DRM_ERROR("hashtab selftest %s: %lu items, expected %lu\n",
+			  phase, stats.items, count);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int drm_ht_selftest(void)
+{
+	struct drm_open_hash ht;
+	struct drm_hash_item *items, dup;
+	unsigned long resizes;
+	bool *present;
+	int i, j, ret;
+
+	items = kcalloc(DRM_HT_TEST_ITEMS, sizeof(*items), GFP_KERNEL);
+	present = kcalloc(DRM_HT_TEST_ITEMS, sizeof(*present), GFP_KERNEL);
+	if (items == NULL || present == NULL) {
+		ret = -ENOMEM;
+		goto out_free;
+	}
+
+	ret = drm_ht_create(&ht, DRM_HT_TEST_ORDER);
+	if (ret)
+		goto out_free;
+
+	for (i = 0; i < DRM_HT_TEST_ITEMS; i++) {
+		items[i].key = drm_ht_test_key(i);
+		ret = drm_ht_insert_item(&ht, &items[i]);
+		if (ret) {
+			DRM_ERROR("hashtab selftest: insert %d failed\n", i);
+			goto out;
+		}
+		present[i] = true;
+
+		/* An earlier key, which may not have migrated yet */
+		dup.key = items[i / 2].key;
+		if (drm_ht_insert_item(&ht, &dup) != -EINVAL) {
+			DRM_ERROR("hashtab selftest: duplicate key %lx "
+				  "accepted\n", dup.key);
+			ret = -EINVAL;
+			goto out;
+		}
+
+		if ((i & 255) == 255 || ht.old_table != NULL) {
+			ret = drm_ht_test_check(&ht, items, present, "grow");
+			if (ret)
+				goto out;
+		}
+	}
+
+	if (ht.resizes == 0 || ht.order <= DRM_HT_TEST_ORDER) {
+		DRM_ERROR("hashtab selftest: table never grew\n");
+		ret = -EINVAL;
+		goto out;
+	}
+	resizes = ht.resizes;
+
+	/* Odd entries first, then even ones from the top */
+	for (j = 0; j < DRM_HT_TEST_ITEMS; j++) {
+		if (j < DRM_HT_TEST_ITEMS / 2)
+			i = 2 * j + 1;
+		else
+			i = DRM_HT_TEST_ITEMS - 2 * (j - DRM_HT_TEST_ITEMS / 2) - 2;
+
+		ret = drm_ht_remove_key(&ht, items[i].key);
+		if (ret) {
+			DRM_ERROR("hashtab selftest: remove of key %lx "
+				  "failed\n", items[i].key);
+			goto out;
+		}
+		present[i] = false;
+
+		if ((j & 255) == 255 || ht.old_table != NULL) {
+			ret = drm_ht_test_check(&ht, items, present, "shrink");
+			if (ret)
+				goto out;
+		}
+	}
+
+	if (ht.resizes == resizes) {
+		DRM_ERROR("hashtab selftest: table never shrank\n");
+		ret = -EINVAL;
+		goto out;
+	}
+
+	DRM_INFO("hashtab selftest passed, %lu resizes\n", ht.resizes);
+out:
+	drm_ht_remove(&ht);
+out_free:
+	kfree(present);
+	kfree(items);
+	return ret;
+}
+
+static int drm_ht_selftest_sysctl(SYSCTL_HANDLER_ARGS)
+{
+	int val = 0;
+	int error;
+
+	error = sysctl_handle_int(oidp, &val, 0, req);
+	if (error || req->newptr == NULL || val == 0)
+		return error;
+
+	return -drm_ht_selftest();
+}
+
+SYSCTL_DECL(_hw_dri);
+SYSCTL_PROC(_hw_dri, OID_AUTO, hashtab_selftest, CTLTYPE_INT | CTLFLAG_RW,
+    NULL, 0, drm_ht_selftest_sysctl, "I",
+    "Run the drm_open_hash resize stress check");
@@ -28,6 +28,14 @@ extern unsigned int drm_timestamp_monotonic;
 extern struct lock drm_global_mutex;
 void drm_lastclose(struct drm_device *dev);
 
+/* drm_ioctl.c */
+void drm_ioctl_stats_init(struct drm_device *dev);
+void drm_ioctl_stats_fini(struct drm_device *dev);
+
+/* drm_mm.c */
+void drm_mm_core_init(void);
+void drm_mm_core_exit(void);
+
 /* drm_pci.c */
 int drm_pci_set_unique(struct drm_device *dev,
 		       struct drm_master *master,
@@ -29,6 +29,8 @@
  */
 
 #include <sys/devfs.h>
+#include <sys/sysctl.h>
+#include <sys/thread2.h>
 
 #include <drm/drmP.h>
 #include <drm/drm_core.h>
@@ -218,7 +220,14 @@ static int drm_getstats(struct drm_device *dev, void *data,
 		if (dev->types[i] == _DRM_STAT_LOCK)
 			stats->data[i].value =
 			    (dev->lock.hw_lock ? dev->lock.hw_lock->lock : 0);
-		else 
+		else if (dev->types[i] == _DRM_STAT_IOCTLS) {
+			u_long calls = 0;
+			int cpu;
+
+			for (cpu = 0; cpu < ncpus; cpu++)
+				calls += dev->ioctl_pcpu[cpu].calls;
+			stats->data[i].value = calls;
+		} else
 			stats->data[i].value = atomic_read(&dev->counts[i]);
 		stats->data[i].type = dev->types[i];
 	}
@@ -633,6 +642,275 @@ static const struct drm_ioctl_desc drm_ioctls[] = {
 
 #define DRM_CORE_IOCTL_COUNT	ARRAY_SIZE( drm_ioctls )
 
+/*
+ * ioctl statistics.
+ *
+ * Every cpu counts the ioctls it dispatches in its own cache line instead
+ * of bouncing dev->counts[_DRM_STAT_IOCTLS] between all callers.  Setting
+ * hw.dri.N.ioctl.stats additionally records a latency histogram per ioctl
+ * number, and for driver ioctls which are not DRM_UNLOCKED how long they
+ * waited for and held drm_global_mutex.  The per-ioctl tables are only
+ * allocated once collection is first enabled.
+ */
+
+#define DRM_IOCTL_STAT_NR	256	/* DRM_IOCTL_NR() is 8 bits */
+#define DRM_IOCTL_LAT_BUCKETS	20	/* bucket n counts < 2^n us */
+
+struct drm_ioctl_stat {
+	u_long	calls;
+	u_long	locked;			/* calls under drm_global_mutex */
+	u_long	lock_wait_ns;
+	u_long	lock_hold_ns;
+	u_long	lat[DRM_IOCTL_LAT_BUCKETS];
+};
+
+struct drm_ioctl_pcpu {
+	u_long	calls;
+	struct drm_ioctl_stat *stats;	/* DRM_IOCTL_STAT_NR entries */
+} __cachealign;
+
+static __inline void
+drm_ioctl_count(struct drm_device *dev)
+{
+	crit_enter();
+	dev->ioctl_pcpu[mycpuid].calls++;
+	crit_exit();
+}
+
+static void
+drm_ioctl_account(struct drm_device *dev, unsigned int nr, u64 ns,
+		  bool locked, u64 wait_ns, u64 hold_ns)
+{
+	struct drm_ioctl_stat *st;
+	u64 us = ns / 1000;
+	int bucket;
+
+	bucket = us >= (1U << (DRM_IOCTL_LAT_BUCKETS - 1)) ?
+	    DRM_IOCTL_LAT_BUCKETS - 1 : fls(us);
+
+	crit_enter();
+	st = dev->ioctl_pcpu[mycpuid].stats;
+	if (st != NULL) {
+		st += nr;
+		st->calls++;
+		st->lat[bucket]++;
+		if (locked) {
+			st->locked++;
+			st->lock_wait_ns += wait_ns;
+			st->lock_hold_ns += hold_ns;
+		}
+	}
+	crit_exit();
+}
+
+static const struct drm_ioctl_desc *
+drm_ioctl_stat_desc(struct drm_device *dev, unsigned int nr)
+{
+	if (nr < DRM_CORE_IOCTL_COUNT && drm_ioctls[nr].func != NULL)
+		return &drm_ioctls[nr];
+	if (nr >= DRM_COMMAND_BASE && nr < DRM_COMMAND_END &&
+	    nr - DRM_COMMAND_BASE < dev->driver->num_ioctls)
+		return &dev->driver->ioctls[nr - DRM_COMMAND_BASE];
+	return NULL;
+}
+
+static void
+drm_ioctl_stat_sum(struct drm_device *dev, unsigned int nr,
+		   struct drm_ioctl_stat *sum)
+{
+	struct drm_ioctl_stat *st;
+	int i, b;
+
+	memset(sum, 0, sizeof(*sum));
+	for (i = 0; i < ncpus; i++) {
+		st = dev->ioctl_pcpu[i].stats;
+		if (st == NULL)
+			continue;
+		st += nr;
+		sum->calls += st->calls;
+		sum->locked += st->locked;
+		sum->lock_wait_ns += st->lock_wait_ns;
+		sum->lock_hold_ns += st->lock_hold_ns;
+		for (b = 0; b < DRM_IOCTL_LAT_BUCKETS; b++)
+			sum->lat[b] += st->lat[b];
+	}
+}
+
+/* Upper bound in us of the bucket holding the @pct percentile */
+static u_long
+drm_ioctl_stat_pct(struct drm_ioctl_stat *sum, int pct)
+{
+	u_long want, seen = 0;
+	int b;
+
+	want = (sum->calls * pct + 99) / 100;
+	for (b = 0; b < DRM_IOCTL_LAT_BUCKETS - 1; b++) {
+		seen += sum->lat[b];
+		if (seen >= want)
+			break;
+	}
+	return 1UL << b;
+}
+
+static int
+drm_ioctl_sysctl_calls(SYSCTL_HANDLER_ARGS)
+{
+	struct drm_device *dev = arg1;
+	u_long val = 0;
+	int i;
+
+	for (i = 0; i < ncpus; i++)
+		val += dev->ioctl_pcpu[i].calls;
+
+	return sysctl_handle_long(oidp, &val, 0, req);
+}
+
+/*
+ * Any write clears the collected statistics, a non-zero value (re)starts
+ * collection.
+ */
+static int
+drm_ioctl_sysctl_stats(SYSCTL_HANDLER_ARGS)
+{
+	struct drm_device *dev = arg1;
+	struct drm_ioctl_stat *st;
+	int val, error, i;
+
+	val = dev->ioctl_stats;
+	error = sysctl_handle_int(oidp, &val, 0, req);
+	if (error || req->newptr == NULL)
+		return error;
+
+	mutex_lock(&drm_global_mutex);
+	dev->ioctl_stats = 0;
+	for (i = 0; i < ncpus; i++) {
+		st = dev->ioctl_pcpu[i].stats;
+		if (st == NULL && val != 0) {
+			st = kmalloc(DRM_IOCTL_STAT_NR * sizeof(*st), M_DRM,
+			    M_WAITOK | M_ZERO);
+			cpu_sfence();
+			dev->ioctl_pcpu[i].stats = st;
+		} else if (st != NULL) {
+			/* Racy against ioctls still in flight, good enough */
+			memset(st, 0, DRM_IOCTL_STAT_NR * sizeof(*st));
+		}
+	}
+	dev->ioctl_stats = val != 0;
+	mutex_unlock(&drm_global_mutex);
+
+	return 0;
+}
+
+#define DRM_IOCTL_SYSCTL_PRINT(fmt, arg...)			\
+do {								\
+	ksnprintf(buf, sizeof(buf), fmt, ##arg);		\
+	error = SYSCTL_OUT(req, buf, strlen(buf));		\
+	if (error)						\
+		return error;					\
+} while (0)
+
+static int
+drm_ioctl_sysctl_latency(SYSCTL_HANDLER_ARGS)
+{
+	struct drm_device *dev = arg1;
+	const struct drm_ioctl_desc *desc;
+	struct drm_ioctl_stat sum;
+	char buf[128];
+	unsigned int nr;
+	int error;
+
+	DRM_IOCTL_SYSCTL_PRINT("\n%-32s %10s %8s %8s", "ioctl", "calls",
+	    "p50 us", "p99 us");
+	for (nr = 0; nr < DRM_IOCTL_STAT_NR; nr++) {
+		desc = drm_ioctl_stat_desc(dev, nr);
+		if (desc == NULL)
+			continue;
+		drm_ioctl_stat_sum(dev, nr, &sum);
+		if (sum.calls == 0)
+			continue;
+		DRM_IOCTL_SYSCTL_PRINT("\n%-32s %10lu %8lu %8lu", desc->name,
+		    sum.calls, drm_ioctl_stat_pct(&sum, 50),
+		    drm_ioctl_stat_pct(&sum, 99));
+	}
+
+	return SYSCTL_OUT(req, "", 1);
+}
+
+/*
+ * List the driver ioctls which still serialize on drm_global_mutex, with
+ * the time spent waiting for and holding it while stats were collected.
+ */
+static int
+drm_ioctl_sysctl_audit(SYSCTL_HANDLER_ARGS)
+{
+	struct drm_device *dev = arg1;
+	const struct drm_ioctl_desc *desc;
+	struct drm_ioctl_stat sum;
+	char buf[128];
+	unsigned int i;
+	int error;
+
+	DRM_IOCTL_SYSCTL_PRINT("\n%-32s %10s %12s %12s", "ioctl", "locked",
+	    "wait us", "hold us");
+	for (i = 0; i < dev->driver->num_ioctls; i++) {
+		desc = &dev->driver->ioctls[i];
+		if (desc->func == NULL || (desc->flags & DRM_UNLOCKED))
+			continue;
+		drm_ioctl_stat_sum(dev, DRM_COMMAND_BASE + i, &sum);
+		DRM_IOCTL_SYSCTL_PRINT("\n%-32s %10lu %12lu %12lu", desc->name,
+		    sum.locked, sum.lock_wait_ns / 1000,
+		    sum.lock_hold_ns / 1000);
+	}
+
+	return SYSCTL_OUT(req, "", 1);
+}
+
+void drm_ioctl_stats_init(struct drm_device *dev)
+{
+	struct sysctl_ctx_list *ctx = &dev->ioctl_sysctl_ctx;
+	struct sysctl_oid *top;
+
+	dev->ioctl_pcpu = kmalloc(ncpus * sizeof(*dev->ioctl_pcpu), M_DRM,
+	    M_WAITOK | M_ZERO);
+
+	sysctl_ctx_init(ctx);
+	if (dev->sysctl == NULL || dev->sysctl->top == NULL)
+		return;
+
+	top = SYSCTL_ADD_NODE(ctx, SYSCTL_CHILDREN(dev->sysctl->top),
+	    OID_AUTO, "ioctl", CTLFLAG_RD, NULL, "ioctl statistics");
+	if (top == NULL)
+		return;
+
+	SYSCTL_ADD_PROC(ctx, SYSCTL_CHILDREN(top), OID_AUTO, "calls",
+	    CTLTYPE_ULONG | CTLFLAG_RD, dev, 0, drm_ioctl_sysctl_calls, "LU",
+	    "ioctls dispatched");
+	SYSCTL_ADD_PROC(ctx, SYSCTL_CHILDREN(top), OID_AUTO, "stats",
+	    CTLTYPE_INT | CTLFLAG_RW, dev, 0, drm_ioctl_sysctl_stats, "I",
+	    "Collect per-ioctl statistics, writing resets them");
+	SYSCTL_ADD_PROC(ctx, SYSCTL_CHILDREN(top), OID_AUTO, "latency",
+	    CTLTYPE_STRING | CTLFLAG_RD, dev, 0, drm_ioctl_sysctl_latency, "A",
+	    "Per-ioctl call count and latency percentiles");
+	SYSCTL_ADD_PROC(ctx, SYSCTL_CHILDREN(top), OID_AUTO, "audit",
+	    CTLTYPE_STRING | CTLFLAG_RD, dev, 0, drm_ioctl_sysctl_audit, "A",
+	    "Driver ioctls serialized on drm_global_mutex");
+}
+
+void drm_ioctl_stats_fini(struct drm_device *dev)
+{
+	int i;
+
+	if (dev->ioctl_pcpu == NULL)
+		return;
+
+	sysctl_ctx_free(&dev->ioctl_sysctl_ctx);
+	dev->ioctl_stats = 0;
+	for (i = 0; i < ncpus; i++)
+		kfree(dev->ioctl_pcpu[i].stats);
+	kfree(dev->ioctl_pcpu);
+	dev->ioctl_pcpu = NULL;
+}
+
 /**
  * drm_ioctl - ioctl callback implementation for DRM drivers
  * @filp: file this ioctl is called on
@@ -657,6 +935,8 @@ int drm_ioctl(struct dev_ioctl_args *ap)
 	int (*func)(struct drm_device *dev, void *data, struct drm_file *file_priv);
 	struct drm_file *file_priv;
 	bool is_driver_ioctl;
+	bool locked = false;
+	u64 start = 0, t = 0, wait_ns = 0, hold_ns = 0;
 
 	dev = drm_get_device_from_kdev(kdev);
 
@@ -666,7 +946,9 @@ int drm_ioctl(struct dev_ioctl_args *ap)
 		return EINVAL;
 	}
 
-	atomic_inc(&dev->counts[_DRM_STAT_IOCTLS]);
+	drm_ioctl_count(dev);
+	if (__predict_false(dev->ioctl_stats))
+		start = ktime_get_raw_ns();
 
 	if (drm_device_is_unplugged(dev))
 		return ENODEV;
@@ -711,14 +993,23 @@ int drm_ioctl(struct dev_ioctl_args *ap)
 	/* Enforce sane locking for kms driver ioctls. Core ioctls are
 	 * too messy still. */
 	if (is_driver_ioctl) {
-		if ((ioctl->flags & DRM_UNLOCKED) == 0)
+		if ((ioctl->flags & DRM_UNLOCKED) == 0) {
 			mutex_lock(&drm_global_mutex);
+			locked = true;
+			if (start != 0) {
+				t = ktime_get_raw_ns();
+				wait_ns = t - start;
+			}
+		}
 		/* shared code returns -errno */
 		retcode = -func(dev, data, file_priv);
 		if (retcode == ERESTARTSYS)
 			retcode = EINTR;
-		if ((ioctl->flags & DRM_UNLOCKED) == 0)
+		if (locked) {
+			if (start != 0)
+				hold_ns = ktime_get_raw_ns() - t;
 			mutex_unlock(&drm_global_mutex);
+		}
 	} else {
 		retcode = -func(dev, data, file_priv);
 		if (retcode == ERESTARTSYS)
@@ -734,6 +1025,9 @@ int drm_ioctl(struct dev_ioctl_args *ap)
 
 	if (retcode)
 		DRM_DEBUG_FIOCTL("ret = %d\n", retcode);
+	if (start != 0)
+		drm_ioctl_account(dev, DRM_IOCTL_NR(cmd),
+		    ktime_get_raw_ns() - start, locked, wait_ns, hold_ns);
 	return retcode;
 }
 EXPORT_SYMBOL(drm_ioctl);
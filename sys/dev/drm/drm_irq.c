@@ -57,6 +57,7 @@
 static bool
 drm_get_last_vbltimestamp(struct drm_device *dev, unsigned int pipe,
 			  struct timeval *tvblank, unsigned flags);
+static void drm_vblank_sysctl_init(struct drm_device *dev);
 
 unsigned int drm_timestamp_precision = 20;  /* Default to 20 usecs. */
 
@@ -377,6 +378,7 @@ void drm_vblank_cleanup(struct drm_device *dev)
 		del_timer_sync(&vblank->disable_timer);
 	}
 
+	sysctl_ctx_free(&dev->vblank_sysctl_ctx);
 	kfree(dev->vblank);
 
 	dev->num_crtcs = 0;
@@ -415,8 +417,11 @@ int drm_vblank_init(struct drm_device *dev, unsigned int num_crtcs)
 		init_waitqueue_head(&vblank->queue);
 		setup_timer(&vblank->disable_timer, vblank_disable_fn,
 			    (unsigned long)vblank);
+		INIT_LIST_HEAD(&vblank->event_list);
 	}
 
+	drm_vblank_sysctl_init(dev);
+
 	DRM_INFO("Supports vblank timestamp caching Rev 2 (21.10.2013).\n");
 
 	/* Driver specific high-precision vblank timestamping supported? */
@@ -1027,10 +1032,136 @@ static void send_vblank_event(struct drm_device *dev,
 	e->event.tv_sec = now->tv_sec;
 	e->event.tv_usec = now->tv_usec;
 
-	drm_send_event_locked(dev, &e->base);
-
+	/* e may be freed by the send if nobody is reading it */
 	trace_drm_vblank_event_delivered(e->base.pid, e->pipe,
 					 e->event.sequence);
+
+	drm_send_event_locked(dev, &e->base);
+}
+
+/*
+ * Queue @e on the pending list of its pipe, keeping the list sorted by
+ * target sequence and FIFO among events for the same vblank.  Events
+ * normally either target the very next vblank or are queued in
+ * increasing order, so try the tail first and otherwise scan from the
+ * head.  Caller must hold dev->event_lock.
+ */
+static void drm_vblank_event_insert(struct drm_vblank_crtc *vblank,
+				    struct drm_pending_vblank_event *e)
+{
+	struct drm_pending_vblank_event *pos;
+	u32 seq = e->event.sequence;
+
+	assert_spin_locked(&vblank->dev->event_lock);
+
+	pos = list_last_entry(&vblank->event_list,
+			      struct drm_pending_vblank_event, base.link);
+	if (list_empty(&vblank->event_list) ||
+	    (s32)(seq - pos->event.sequence) >= 0) {
+		list_add_tail(&e->base.link, &vblank->event_list);
+	} else {
+		list_for_each_entry(pos, &vblank->event_list, base.link) {
+			if ((s32)(seq - pos->event.sequence) < 0)
+				break;
+		}
+		list_add_tail(&e->base.link, &pos->base.link);
+	}
+	vblank->event_count++;
+}
+
+static void drm_vblank_event_remove(struct drm_vblank_crtc *vblank,
+				    struct drm_pending_vblank_event *e)
+{
+	list_del(&e->base.link);
+	vblank->event_count--;
+}
+
+/* Account the time from the vblank at @vbltime to now */
+static void drm_vblank_event_latency(struct drm_vblank_crtc *vblank,
+				     struct timeval *vbltime)
+{
+	struct timeval now = get_drm_timestamp();
+	long us;
+	int bucket;
+
+	us = (now.tv_sec - vbltime->tv_sec) * 1000000 +
+	     (now.tv_usec - vbltime->tv_usec);
+	bucket = us > 0 ? fls(us) : 0;
+	if (bucket >= DRM_VBLANK_LATENCY_BUCKETS)
+		bucket = DRM_VBLANK_LATENCY_BUCKETS - 1;
+
+	vblank->event_dispatched++;
+	vblank->event_latency[bucket]++;
+}
+
+static int drm_vblank_sysctl_latency(SYSCTL_HANDLER_ARGS)
+{
+	struct drm_vblank_crtc *vblank = arg1;
+	struct drm_device *dev = vblank->dev;
+	u_long hist[DRM_VBLANK_LATENCY_BUCKETS];
+	char buf[64];
+	int error = 0;
+	int i;
+
+	spin_lock_irq(&dev->event_lock);
+	memcpy(hist, vblank->event_latency, sizeof(hist));
+	spin_unlock_irq(&dev->event_lock);
+
+	for (i = 0; i < DRM_VBLANK_LATENCY_BUCKETS && error == 0; i++) {
+		if (i < DRM_VBLANK_LATENCY_BUCKETS - 1)
+			ksnprintf(buf, sizeof(buf), "\n< %6luus %lu",
+				  1UL << i, hist[i]);
+		else
+			ksnprintf(buf, sizeof(buf), "\n>=%6luus %lu",
+				  1UL << (i - 1), hist[i]);
+		error = SYSCTL_OUT(req, buf, strlen(buf));
+	}
+	if (error == 0)
+		error = SYSCTL_OUT(req, "", 1);
+
+	return error;
+}
+
+/*
+ * hw.dri.N.vblank.<pipe>: pending event gauge and dispatch latency
+ * histogram of the per-pipe event queues.
+ */
+static void drm_vblank_sysctl_init(struct drm_device *dev)
+{
+	struct sysctl_ctx_list *ctx = &dev->vblank_sysctl_ctx;
+	struct sysctl_oid *top, *oid;
+	char name[8];
+	unsigned int pipe;
+
+	sysctl_ctx_init(ctx);
+	if (dev->sysctl == NULL || dev->sysctl->top == NULL)
+		return;
+
+	top = SYSCTL_ADD_NODE(ctx, SYSCTL_CHILDREN(dev->sysctl->top),
+	    OID_AUTO, "vblank", CTLFLAG_RD, NULL, "vblank event queues");
+	if (top == NULL)
+		return;
+
+	for (pipe = 0; pipe < dev->num_crtcs; pipe++) {
+		struct drm_vblank_crtc *vblank = &dev->vblank[pipe];
+
+		ksnprintf(name, sizeof(name), "%u", pipe);
+		oid = SYSCTL_ADD_NODE(ctx, SYSCTL_CHILDREN(top), OID_AUTO,
+		    name, CTLFLAG_RD, NULL, NULL);
+		if (oid == NULL)
+			return;
+
+		SYSCTL_ADD_UINT(ctx, SYSCTL_CHILDREN(oid), OID_AUTO,
+		    "queued", CTLFLAG_RD, &vblank->event_count, 0,
+		    "Pending vblank events");
+		SYSCTL_ADD_ULONG(ctx, SYSCTL_CHILDREN(oid), OID_AUTO,
+		    "dispatched", CTLFLAG_RD, &vblank->event_dispatched,
+		    "Events sent from the vblank interrupt");
+		SYSCTL_ADD_PROC(ctx, SYSCTL_CHILDREN(oid), OID_AUTO,
+		    "latency", CTLTYPE_STRING | CTLFLAG_RD, vblank, 0,
+		    drm_vblank_sysctl_latency, "A",
+		    "Vblank to event dispatch latency histogram");
+	}
 }
 
 /**
@@ -1057,7 +1188,7 @@ void drm_arm_vblank_event(struct drm_device *dev, unsigned int pipe,
 
 	e->pipe = pipe;
 	e->event.sequence = drm_vblank_count(dev, pipe);
-	list_add_tail(&e->base.link, &dev->vblank_event_list);
+	drm_vblank_event_insert(&dev->vblank[pipe], e);
 }
 EXPORT_SYMBOL(drm_arm_vblank_event);
 
@@ -1375,13 +1506,11 @@ void drm_vblank_off(struct drm_device *dev, unsigned int pipe)
 	/* Send any queued vblank events, lest the natives grow disquiet */
 	seq = drm_vblank_count_and_time(dev, pipe, &now);
 
-	list_for_each_entry_safe(e, t, &dev->vblank_event_list, base.link) {
-		if (e->pipe != pipe)
-			continue;
+	list_for_each_entry_safe(e, t, &vblank->event_list, base.link) {
 		DRM_DEBUG_VBLANK("Sending premature vblank event on disable: \
 			  wanted %d, current %d\n",
 			  e->event.sequence, seq);
-		list_del(&e->base.link);
+		drm_vblank_event_remove(vblank, e);
 		drm_vblank_put(dev, pipe);
 		send_vblank_event(dev, e, seq, &now);
 	}
@@ -1436,7 +1565,7 @@ void drm_crtc_vblank_reset(struct drm_crtc *crtc)
 	}
 	spin_unlock_irqrestore(&dev->vbl_lock, irqflags);
 
-	WARN_ON(!list_empty(&dev->vblank_event_list));
+	WARN_ON(!list_empty(&vblank->event_list));
 }
 EXPORT_SYMBOL(drm_crtc_vblank_reset);
 
@@ -1678,7 +1807,7 @@ static int drm_queue_vblank_event(struct drm_device *dev, unsigned int pipe,
 	DRM_DEBUG_VBLANK("event on vblank count %d, current %d, crtc %u\n",
 		  vblwait->request.sequence, seq, pipe);
 
-	trace_drm_vblank_event_queued(current->pid, pipe,
+	trace_drm_vblank_event_queued(curproc->p_pid, pipe,
 				      vblwait->request.sequence);
 
 	e->event.sequence = vblwait->request.sequence;
@@ -1688,7 +1817,7 @@ static int drm_queue_vblank_event(struct drm_device *dev, unsigned int pipe,
 		vblwait->reply.sequence = seq;
 	} else {
 		/* drm_handle_vblank_events will call drm_vblank_put */
-		list_add_tail(&e->base.link, &dev->vblank_event_list);
+		drm_vblank_event_insert(vblank, e);
 		vblwait->reply.sequence = vblwait->request.sequence;
 	}
 
@@ -1812,6 +1941,7 @@ done:
 
 static void drm_handle_vblank_events(struct drm_device *dev, unsigned int pipe)
 {
+	struct drm_vblank_crtc *vblank = &dev->vblank[pipe];
 	struct drm_pending_vblank_event *e, *t;
 	struct timeval now;
 	unsigned int seq;
@@ -1820,18 +1950,18 @@ static void drm_handle_vblank_events(struct drm_device *dev, unsigned int pipe)
 
 	seq = drm_vblank_count_and_time(dev, pipe, &now);
 
-	list_for_each_entry_safe(e, t, &dev->vblank_event_list, base.link) {
-		if (e->pipe != pipe)
-			continue;
+	/* The list is sorted, so stop at the first event still in the future */
+	list_for_each_entry_safe(e, t, &vblank->event_list, base.link) {
 		if ((seq - e->event.sequence) > (1<<23))
-			continue;
+			break;
 
 		DRM_DEBUG_VBLANK("vblank event on %d, current %d\n",
 			  e->event.sequence, seq);
 
-		list_del(&e->base.link);
+		drm_vblank_event_remove(vblank, e);
 		drm_vblank_put(dev, pipe);
 		send_vblank_event(dev, e, seq, &now);
+		drm_vblank_event_latency(vblank, &now);
 	}
 
 	trace_drm_vblank_event(pipe, seq);
@@ -30,12 +30,11 @@
  * Generic simple memory manager implementation. Intended to be used as a base
  * class implementation for more advanced memory managers.
  *
- * Note that the algorithm used is quite simple and there might be substantial
- * performance gains if a smarter free list is implemented. Currently it is just an
- * unordered stack of free regions. This could easily be improved if an RB-tree
- * is used instead. At least if we expect heavy fragmentation.
+ * Free regions are kept on a stack for iteration and indexed by two RB-trees,
+ * one sorted by hole size and one sorted by hole address, so that searches
+ * stay logarithmic even with heavy fragmentation.
  *
- * Aligned allocations can also see improvement.
+ * Aligned allocations can still see improvement.
  *
  * Authors:
  * Thomas Hellström <thomas-at-tungstengraphics-dot-com>
@@ -46,17 +45,31 @@
 #include <linux/slab.h>
 #include <linux/seq_file.h>
 #include <linux/export.h>
+#include "drm_internal.h"
 
 #define MM_UNUSED_TARGET 4
 
+static struct kmem_cache *drm_mm_node_cache;
+
+void drm_mm_core_init(void)
+{
+	drm_mm_node_cache = KMEM_CACHE(drm_mm_node, 0);
+}
+
+void drm_mm_core_exit(void)
+{
+	kmem_cache_destroy(drm_mm_node_cache);
+	drm_mm_node_cache = NULL;
+}
+
 static struct drm_mm_node *drm_mm_kmalloc(struct drm_mm *mm, int atomic)
 {
 	struct drm_mm_node *child;
 
 	if (atomic)
-		child = kzalloc(sizeof(*child), GFP_ATOMIC);
+		child = kmem_cache_zalloc(drm_mm_node_cache, GFP_ATOMIC);
 	else
-		child = kzalloc(sizeof(*child), GFP_KERNEL);
+		child = kmem_cache_zalloc(drm_mm_node_cache, GFP_KERNEL);
 
 	if (unlikely(child == NULL)) {
 		spin_lock(&mm->unused_lock);
@@ -81,7 +94,7 @@ int drm_mm_pre_get(struct drm_mm *mm)
 	spin_lock(&mm->unused_lock);
 	while (mm->num_unused < MM_UNUSED_TARGET) {
 		spin_unlock(&mm->unused_lock);
-		node = kzalloc(sizeof(*node), GFP_KERNEL);
+		node = kmem_cache_zalloc(drm_mm_node_cache, GFP_KERNEL);
 		spin_lock(&mm->unused_lock);
 
 		if (unlikely(node == NULL)) {
@@ -117,12 +130,13 @@ int drm_mm_pre_get(struct drm_mm *mm)
  * after the allocator is initialized, which helps with avoiding looped
  * depencies in the driver load sequence.
  *
- * drm_mm maintains a stack of most recently freed holes, which of all
- * simplistic datastructures seems to be a fairly decent approach to clustering
- * allocations and avoiding too much fragmentation. This means free space
- * searches are O(num_holes). Given that all the fancy features drm_mm supports
- * something better would be fairly complex and since gfx thrashing is a fairly
- * steep cliff not a real concern. Removing a node again is O(1).
+ * drm_mm indexes its holes in two RB-trees: one sorted by size, used for
+ * DRM_MM_SEARCH_BEST, and one sorted by address and augmented with the largest
+ * hole in each subtree, used for bottom-up and top-down searches. Holes which
+ * are too small are skipped a whole subtree at a time, so finding a candidate
+ * hole is O(log(num_holes)). Only holes which are big enough but are then
+ * rejected by alignment, range or color restrictions are visited one by one.
+ * Inserting and removing a node is O(log(num_holes)) as well.
  *
  * drm_mm supports a few features: Alignment and range restrictions can be
  * supplied. Further more every &drm_mm_node has a color value (which is just an
@@ -132,13 +146,314 @@ int drm_mm_pre_get(struct drm_mm *mm)
  * graphics TT.
  *
  * Two behaviors are supported for searching and allocating: bottom-up and top-down.
- * The default is bottom-up. Top-down allocation can be used if the memory area
- * has different restrictions, or just to reduce fragmentation.
+ * The default is bottom-up, which picks the lowest suitable hole. Top-down
+ * (DRM_MM_SEARCH_BELOW) picks the highest one. Top-down allocation can be used
+ * if the memory area has different restrictions, or just to reduce
+ * fragmentation.
  *
  * Finally iteration helpers to walk all nodes and all holes are provided as are
  * some basic allocator dumpers for debugging.
  */
 
+#define HOLE_ADDR(node) __drm_mm_hole_node_start(node)
+
+static inline struct drm_mm_node *rb_hole_size_to_node(struct rb_node *rb)
+{
+	return rb ? rb_entry(rb, struct drm_mm_node, rb_hole_size) : NULL;
+}
+
+static inline struct drm_mm_node *rb_hole_addr_to_node(struct rb_node *rb)
+{
+	return rb ? rb_entry(rb, struct drm_mm_node, rb_hole_addr) : NULL;
+}
+
+static inline u64 rb_subtree_max_hole(struct rb_node *rb)
+{
+	return rb ? rb_hole_addr_to_node(rb)->subtree_max_hole : 0;
+}
+
+static void augment_hole_compute(struct rb_node *rb)
+{
+	struct drm_mm_node *node;
+	u64 max_hole;
+
+	if (rb == NULL)
+		return;
+
+	node = rb_hole_addr_to_node(rb);
+	max_hole = node->hole_size;
+	max_hole = max(max_hole, rb_subtree_max_hole(rb->rb_left));
+	max_hole = max(max_hole, rb_subtree_max_hole(rb->rb_right));
+	node->subtree_max_hole = max_hole;
+}
+
+/*
+ * The RB-tree implementation has no augment callbacks, so the subtree maxima
+ * are repaired after the fact. Rebalancing only rotates nodes on the path from
+ * the modified position to the root, and any node it moves off that path ends
+ * up as a direct child of a node on it, with intact subtrees below. Recomputing
+ * both children and then the node itself while walking up therefore restores
+ * every stale value in O(log n).
+ */
+static void augment_hole_propagate(struct rb_node *rb)
+{
+	while (rb) {
+		augment_hole_compute(rb->rb_left);
+		augment_hole_compute(rb->rb_right);
+		augment_hole_compute(rb);
+		rb = rb_parent(rb);
+	}
+}
+
+static void insert_hole_size(struct rb_root *root, struct drm_mm_node *node)
+{
+	struct rb_node **link = &root->rb_node;
+	struct rb_node *parent = NULL;
+	u64 size = node->hole_size;
+
+	while (*link) {
+		parent = *link;
+		if (size < rb_hole_size_to_node(parent)->hole_size)
+			link = &parent->rb_left;
+		else
+			link = &parent->rb_right;
+	}
+
+	rb_link_node(&node->rb_hole_size, parent, link);
+	rb_insert_color(&node->rb_hole_size, root);
+}
+
+static void insert_hole_addr(struct rb_root *root, struct drm_mm_node *node)
+{
+	struct rb_node **link = &root->rb_node;
+	struct rb_node *parent = NULL;
+	u64 start = HOLE_ADDR(node);
+
+	while (*link) {
+		parent = *link;
+		if (start < HOLE_ADDR(rb_hole_addr_to_node(parent)))
+			link = &parent->rb_left;
+		else
+			link = &parent->rb_right;
+	}
+
+	node->subtree_max_hole = node->hole_size;
+	rb_link_node(&node->rb_hole_addr, parent, link);
+	rb_insert_color(&node->rb_hole_addr, root);
+	augment_hole_propagate(&node->rb_hole_addr);
+}
+
+static void rm_hole_addr(struct rb_root *root, struct drm_mm_node *node)
+{
+	struct rb_node *rb = &node->rb_hole_addr;
+	struct rb_node *fixup;
+
+	/*
+	 * With two children the successor is unlinked from its old position
+	 * and takes our place, so rebalancing starts at its old parent.
+	 */
+	if (rb->rb_left && rb->rb_right) {
+		struct rb_node *succ = rb->rb_right;
+
+		while (succ->rb_left)
+			succ = succ->rb_left;
+		fixup = rb_parent(succ) == rb ? succ : rb_parent(succ);
+	} else {
+		fixup = rb_parent(rb);
+	}
+
+	rb_erase(rb, root);
+	augment_hole_propagate(fixup);
+}
+
+static void add_hole(struct drm_mm_node *node)
+{
+	struct drm_mm *mm = node->mm;
+
+	node->hole_size =
+		__drm_mm_hole_node_end(node) - __drm_mm_hole_node_start(node);
+	node->hole_follows = 1;
+
+	list_add(&node->hole_stack, &mm->hole_stack);
+	insert_hole_size(&mm->holes_size, node);
+	insert_hole_addr(&mm->holes_addr, node);
+}
+
+static void rm_hole(struct drm_mm_node *node)
+{
+	struct drm_mm *mm = node->mm;
+
+	list_del_init(&node->hole_stack);
+	rb_erase(&node->rb_hole_size, &mm->holes_size);
+	rm_hole_addr(&mm->holes_addr, node);
+
+	node->hole_follows = 0;
+	node->hole_size = 0;
+}
+
+/* Returns the hole starting at or below @addr with the highest address. */
+static struct drm_mm_node *find_hole_addr(const struct drm_mm *mm, u64 addr)
+{
+	struct rb_node *rb = mm->holes_addr.rb_node;
+	struct drm_mm_node *node, *found = NULL;
+
+	while (rb) {
+		node = rb_hole_addr_to_node(rb);
+		if (HOLE_ADDR(node) <= addr) {
+			found = node;
+			rb = rb->rb_right;
+		} else {
+			rb = rb->rb_left;
+		}
+	}
+
+	return found;
+}
+
+/* Lowest-addressed hole of at least @size within the subtree at @rb. */
+static struct drm_mm_node *leftmost_hole(struct rb_node *rb, u64 size)
+{
+	struct drm_mm_node *node;
+
+	if (rb_subtree_max_hole(rb) < size)
+		return NULL;
+
+	for (;;) {
+		if (rb_subtree_max_hole(rb->rb_left) >= size) {
+			rb = rb->rb_left;
+			continue;
+		}
+
+		node = rb_hole_addr_to_node(rb);
+		if (node->hole_size >= size)
+			return node;
+
+		rb = rb->rb_right;
+	}
+}
+
+/* Highest-addressed hole of at least @size within the subtree at @rb. */
+static struct drm_mm_node *rightmost_hole(struct rb_node *rb, u64 size)
+{
+	struct drm_mm_node *node;
+
+	if (rb_subtree_max_hole(rb) < size)
+		return NULL;
+
+	for (;;) {
+		if (rb_subtree_max_hole(rb->rb_right) >= size) {
+			rb = rb->rb_right;
+			continue;
+		}
+
+		node = rb_hole_addr_to_node(rb);
+		if (node->hole_size >= size)
+			return node;
+
+		rb = rb->rb_left;
+	}
+}
+
+/* Next hole of at least @size above @node in address order. */
+static struct drm_mm_node *next_hole_low(struct drm_mm_node *node, u64 size)
+{
+	struct rb_node *rb = &node->rb_hole_addr;
+	struct rb_node *parent;
+
+	if (rb_subtree_max_hole(rb->rb_right) >= size)
+		return leftmost_hole(rb->rb_right, size);
+
+	while ((parent = rb_parent(rb)) != NULL) {
+		if (parent->rb_left == rb) {
+			node = rb_hole_addr_to_node(parent);
+			if (node->hole_size >= size)
+				return node;
+			if (rb_subtree_max_hole(parent->rb_right) >= size)
+				return leftmost_hole(parent->rb_right, size);
+		}
+		rb = parent;
+	}
+
+	return NULL;
+}
+
+/* Next hole of at least @size below @node in address order. */
+static struct drm_mm_node *next_hole_high(struct drm_mm_node *node, u64 size)
+{
+	struct rb_node *rb = &node->rb_hole_addr;
+	struct rb_node *parent;
+
+	if (rb_subtree_max_hole(rb->rb_left) >= size)
+		return rightmost_hole(rb->rb_left, size);
+
+	while ((parent = rb_parent(rb)) != NULL) {
+		if (parent->rb_right == rb) {
+			node = rb_hole_addr_to_node(parent);
+			if (node->hole_size >= size)
+				return node;
+			if (rb_subtree_max_hole(parent->rb_left) >= size)
+				return rightmost_hole(parent->rb_left, size);
+		}
+		rb = parent;
+	}
+
+	return NULL;
+}
+
+/* Lowest hole of at least @size which ends above @start. */
+static struct drm_mm_node *first_hole_low(const struct drm_mm *mm,
+					  u64 size, u64 start)
+{
+	struct drm_mm_node *node;
+
+	node = find_hole_addr(mm, start);
+	if (node == NULL)
+		return leftmost_hole(mm->holes_addr.rb_node, size);
+
+	if (node->hole_size >= size && HOLE_ADDR(node) + node->hole_size > start)
+		return node;
+
+	return next_hole_low(node, size);
+}
+
+/* Highest hole of at least @size which starts below @end. */
+static struct drm_mm_node *first_hole_high(const struct drm_mm *mm,
+					   u64 size, u64 end)
+{
+	struct drm_mm_node *node;
+
+	if (end == 0)
+		return NULL;
+
+	node = find_hole_addr(mm, end - 1);
+	if (node == NULL)
+		return NULL;
+
+	if (node->hole_size >= size)
+		return node;
+
+	return next_hole_high(node, size);
+}
+
+/* Smallest hole of at least @size. */
+static struct drm_mm_node *best_hole(const struct drm_mm *mm, u64 size)
+{
+	struct rb_node *rb = mm->holes_size.rb_node;
+	struct drm_mm_node *node, *best = NULL;
+
+	while (rb) {
+		node = rb_hole_size_to_node(rb);
+		if (size <= node->hole_size) {
+			best = node;
+			rb = rb->rb_left;
+		} else {
+			rb = rb->rb_right;
+		}
+	}
+
+	return best;
+}
+
 static void drm_mm_insert_helper(struct drm_mm_node *hole_node,
 				 struct drm_mm_node *node,
 				 u64 size, unsigned alignment,
@@ -175,10 +490,7 @@ static void drm_mm_insert_helper(struct drm_mm_node *hole_node,
 	BUG_ON(adj_start < hole_start);
 	BUG_ON(adj_end > hole_end);
 
-	if (adj_start == hole_start) {
-		hole_node->hole_follows = 0;
-		list_del(&hole_node->hole_stack);
-	}
+	rm_hole(hole_node);
 
 	node->start = adj_start;
 	node->size = size;
@@ -191,11 +503,12 @@ static void drm_mm_insert_helper(struct drm_mm_node *hole_node,
 
 	BUG_ON(node->start + node->size > adj_end);
 
+	if (adj_start != hole_start)
+		add_hole(hole_node);
+
 	node->hole_follows = 0;
-	if (__drm_mm_hole_node_start(node) < hole_end) {
-		list_add(&node->hole_stack, &mm->hole_stack);
-		node->hole_follows = 1;
-	}
+	if (__drm_mm_hole_node_start(node) < hole_end)
+		add_hole(node);
 }
 
 /**
@@ -222,31 +535,31 @@ int drm_mm_reserve_node(struct drm_mm *mm, struct drm_mm_node *node)
 	BUG_ON(node == NULL);
 
 	/* Find the relevant hole to add our node to */
-	drm_mm_for_each_hole(hole, mm, hole_start, hole_end) {
-		if (hole_start > node->start || hole_end < end)
-			continue;
+	hole = find_hole_addr(mm, node->start);
+	if (hole == NULL)
+		return -ENOSPC;
 
-		node->mm = mm;
-		node->allocated = 1;
+	hole_start = drm_mm_hole_node_start(hole);
+	hole_end = drm_mm_hole_node_end(hole);
+	if (hole_end < end)
+		return -ENOSPC;
 
-		INIT_LIST_HEAD(&node->hole_stack);
-		list_add(&node->node_list, &hole->node_list);
+	node->mm = mm;
+	node->allocated = 1;
 
-		if (node->start == hole_start) {
-			hole->hole_follows = 0;
-			list_del_init(&hole->hole_stack);
-		}
+	rm_hole(hole);
 
-		node->hole_follows = 0;
-		if (end != hole_end) {
-			list_add(&node->hole_stack, &mm->hole_stack);
-			node->hole_follows = 1;
-		}
+	INIT_LIST_HEAD(&node->hole_stack);
+	list_add(&node->node_list, &hole->node_list);
 
-		return 0;
-	}
+	if (node->start != hole_start)
+		add_hole(hole);
+
+	node->hole_follows = 0;
+	if (end != hole_end)
+		add_hole(node);
 
-	return -ENOSPC;
+	return 0;
 }
 EXPORT_SYMBOL(drm_mm_reserve_node);
 
@@ -339,10 +652,7 @@ static void drm_mm_insert_helper_range(struct drm_mm_node *hole_node,
 		}
 	}
 
-	if (adj_start == hole_start) {
-		hole_node->hole_follows = 0;
-		list_del(&hole_node->hole_stack);
-	}
+	rm_hole(hole_node);
 
 	node->start = adj_start;
 	node->size = size;
@@ -358,11 +668,12 @@ static void drm_mm_insert_helper_range(struct drm_mm_node *hole_node,
 	BUG_ON(node->start + node->size > adj_end);
 	BUG_ON(node->start + node->size > end);
 
+	if (adj_start != hole_start)
+		add_hole(hole_node);
+
 	node->hole_follows = 0;
-	if (__drm_mm_hole_node_start(node) < hole_end) {
-		list_add(&node->hole_stack, &mm->hole_stack);
-		node->hole_follows = 1;
-	}
+	if (__drm_mm_hole_node_start(node) < hole_end)
+		add_hole(node);
 }
 
 /**
@@ -414,7 +725,6 @@ EXPORT_SYMBOL(drm_mm_insert_node_in_range_generic);
  */
 void drm_mm_remove_node(struct drm_mm_node *node)
 {
-	struct drm_mm *mm = node->mm;
 	struct drm_mm_node *prev_node;
 
 	if (WARN_ON(!node->allocated))
@@ -429,19 +739,17 @@ void drm_mm_remove_node(struct drm_mm_node *node)
 	if (node->hole_follows) {
 		BUG_ON(__drm_mm_hole_node_start(node) ==
 		       __drm_mm_hole_node_end(node));
-		list_del(&node->hole_stack);
+		rm_hole(node);
 	} else
 		BUG_ON(__drm_mm_hole_node_start(node) !=
 		       __drm_mm_hole_node_end(node));
 
-
-	if (!prev_node->hole_follows) {
-		prev_node->hole_follows = 1;
-		list_add(&prev_node->hole_stack, &mm->hole_stack);
-	} else
-		list_move(&prev_node->hole_stack, &mm->hole_stack);
+	if (prev_node->hole_follows)
+		rm_hole(prev_node);
 
 	list_del(&node->node_list);
+	add_hole(prev_node);
+
 	node->allocated = 0;
 }
 EXPORT_SYMBOL(drm_mm_remove_node);
@@ -462,9 +770,11 @@ void drm_mm_put_block(struct drm_mm_node *node)
 	if (mm->num_unused < MM_UNUSED_TARGET) {
 		list_add(&node->node_list, &mm->unused_nodes);
 		++mm->num_unused;
-	} else
-		kfree(node);
+		node = NULL;
+	}
 	spin_unlock(&mm->unused_lock);
+
+	kmem_cache_free(drm_mm_node_cache, node);
 }
 
 static int check_free_hole(u64 start, u64 end, u64 size, unsigned alignment)
@@ -484,46 +794,84 @@ static int check_free_hole(u64 start, u64 end, u64 size, unsigned alignment)
 	return end >= start + size;
 }
 
-struct drm_mm_node *drm_mm_search_free_generic(const struct drm_mm *mm,
-						      u64 size,
-						      unsigned alignment,
-						      unsigned long color,
-						      enum drm_mm_search_flags flags)
+static bool drm_mm_hole_fits(const struct drm_mm *mm,
+			     struct drm_mm_node *entry,
+			     u64 size, unsigned alignment,
+			     unsigned long color,
+			     u64 start, u64 end)
 {
-	struct drm_mm_node *entry;
-	struct drm_mm_node *best;
-	u64 adj_start;
-	u64 adj_end;
-	u64 best_size;
-
-	BUG_ON(mm->scanned_blocks);
+	u64 adj_start = drm_mm_hole_node_start(entry);
+	u64 adj_end = drm_mm_hole_node_end(entry);
 
-	best = NULL;
-	best_size = ~0UL;
+	if (adj_start < start)
+		adj_start = start;
+	if (adj_end > end)
+		adj_end = end;
 
-	__drm_mm_for_each_hole(entry, mm, adj_start, adj_end,
-			       flags & DRM_MM_SEARCH_BELOW) {
-		u64 hole_size = adj_end - adj_start;
+	if (mm->color_adjust) {
+		mm->color_adjust(entry, color, &adj_start, &adj_end);
+		if (adj_end <= adj_start)
+			return false;
+	}
 
-		if (mm->color_adjust) {
-			mm->color_adjust(entry, color, &adj_start, &adj_end);
-			if (adj_end <= adj_start)
-				continue;
-		}
+	return check_free_hole(adj_start, adj_end, size, alignment);
+}
 
-		if (!check_free_hole(adj_start, adj_end, size, alignment))
-			continue;
+/*
+ * The trees only know the raw hole sizes, which are an upper bound for what
+ * is left after range clamping, color adjustment and alignment. Each candidate
+ * is therefore checked in full and the walk continues with the next one.
+ */
+static struct drm_mm_node *__drm_mm_search_free(const struct drm_mm *mm,
+						u64 size,
+						unsigned alignment,
+						unsigned long color,
+						u64 start,
+						u64 end,
+						enum drm_mm_search_flags flags)
+{
+	struct drm_mm_node *entry;
+	struct rb_node *rb;
 
-		if (!(flags & DRM_MM_SEARCH_BEST))
-			return entry;
+	BUG_ON(mm->scanned_blocks);
 
-		if (hole_size < best_size) {
-			best = entry;
-			best_size = hole_size;
+	if (flags & DRM_MM_SEARCH_BEST) {
+		for (entry = best_hole(mm, size); entry;
+		     rb = rb_next(&entry->rb_hole_size),
+		     entry = rb_hole_size_to_node(rb)) {
+			if (drm_mm_hole_fits(mm, entry, size, alignment, color,
+					     start, end))
+				return entry;
+		}
+	} else if (flags & DRM_MM_SEARCH_BELOW) {
+		for (entry = first_hole_high(mm, size, end);
+		     entry && HOLE_ADDR(entry) + entry->hole_size > start;
+		     entry = next_hole_high(entry, size)) {
+			if (drm_mm_hole_fits(mm, entry, size, alignment, color,
+					     start, end))
+				return entry;
+		}
+	} else {
+		for (entry = first_hole_low(mm, size, start);
+		     entry && HOLE_ADDR(entry) < end;
+		     entry = next_hole_low(entry, size)) {
+			if (drm_mm_hole_fits(mm, entry, size, alignment, color,
+					     start, end))
+				return entry;
 		}
 	}
 
-	return best;
+	return NULL;
+}
+
+struct drm_mm_node *drm_mm_search_free_generic(const struct drm_mm *mm,
+						      u64 size,
+						      unsigned alignment,
+						      unsigned long color,
+						      enum drm_mm_search_flags flags)
+{
+	return __drm_mm_search_free(mm, size, alignment, color,
+				    0, U64_MAX, flags);
 }
 
 struct drm_mm_node *drm_mm_search_free_in_range_generic(const struct drm_mm *mm,
@@ -534,45 +882,8 @@ struct drm_mm_node *drm_mm_search_free_in_range_generic(const struct drm_mm *mm,
 							u64 end,
 							enum drm_mm_search_flags flags)
 {
-	struct drm_mm_node *entry;
-	struct drm_mm_node *best;
-	u64 adj_start;
-	u64 adj_end;
-	u64 best_size;
-
-	BUG_ON(mm->scanned_blocks);
-
-	best = NULL;
-	best_size = ~0UL;
-
-	__drm_mm_for_each_hole(entry, mm, adj_start, adj_end,
-			       flags & DRM_MM_SEARCH_BELOW) {
-		u64 hole_size = adj_end - adj_start;
-
-		if (adj_start < start)
-			adj_start = start;
-		if (adj_end > end)
-			adj_end = end;
-
-		if (mm->color_adjust) {
-			mm->color_adjust(entry, color, &adj_start, &adj_end);
-			if (adj_end <= adj_start)
-				continue;
-		}
-
-		if (!check_free_hole(adj_start, adj_end, size, alignment))
-			continue;
-
-		if (!(flags & DRM_MM_SEARCH_BEST))
-			return entry;
-
-		if (hole_size < best_size) {
-			best = entry;
-			best_size = hole_size;
-		}
-	}
-
-	return best;
+	return __drm_mm_search_free(mm, size, alignment, color,
+				    start, end, flags);
 }
 
 /**
@@ -586,9 +897,19 @@ struct drm_mm_node *drm_mm_search_free_in_range_generic(const struct drm_mm *mm,
  */
 void drm_mm_replace_node(struct drm_mm_node *old, struct drm_mm_node *new)
 {
+	struct drm_mm *mm = old->mm;
+
 	list_replace(&old->node_list, &new->node_list);
 	list_replace(&old->hole_stack, &new->hole_stack);
+	if (old->hole_follows) {
+		rb_replace_node(&old->rb_hole_size, &new->rb_hole_size,
+				&mm->holes_size);
+		rb_replace_node(&old->rb_hole_addr, &new->rb_hole_addr,
+				&mm->holes_addr);
+	}
 	new->hole_follows = old->hole_follows;
+	new->hole_size = old->hole_size;
+	new->subtree_max_hole = old->subtree_max_hole;
 	new->mm = old->mm;
 	new->start = old->start;
 	new->size = old->size;
@@ -624,7 +945,8 @@ EXPORT_SYMBOL(drm_mm_replace_node);
  * removing an object is O(1), and since freeing a node is also O(1) the overall
  * complexity is O(scanned_objects). So like the free stack which needs to be
  * walked before a scan operation even begins this is linear in the number of
- * objects. It doesn't seem to hurt badly.
+ * objects. It doesn't seem to hurt badly. The hole trees are not touched while
+ * scanning, since the scan restores the exact previous allocator state.
  */
 
 /**
@@ -761,8 +1083,8 @@ EXPORT_SYMBOL(drm_mm_scan_add_block);
  * corrupted.
  *
  * When the scan list is empty, the selected memory nodes can be freed. An
- * immediately following drm_mm_search_free with !DRM_MM_SEARCH_BEST will then
- * return the just freed block (because its at the top of the free_stack list).
+ * immediately following drm_mm_search_free will then find the just freed block,
+ * or another hole which is at least as suitable.
  *
  * Returns:
  * True if this block should be evicted, false otherwise. Will always
@@ -816,6 +1138,8 @@ EXPORT_SYMBOL(drm_mm_clean);
 void drm_mm_init(struct drm_mm * mm, u64 start, u64 size)
 {
 	INIT_LIST_HEAD(&mm->hole_stack);
+	mm->holes_size = RB_ROOT;
+	mm->holes_addr = RB_ROOT;
 	INIT_LIST_HEAD(&mm->unused_nodes);
 	mm->num_unused = 0;
 	mm->scanned_blocks = 0;
@@ -823,14 +1147,13 @@ void drm_mm_init(struct drm_mm * mm, u64 start, u64 size)
 	/* Clever trick to avoid a special case in the free hole tracking. */
 	INIT_LIST_HEAD(&mm->head_node.node_list);
 	INIT_LIST_HEAD(&mm->head_node.hole_stack);
-	mm->head_node.hole_follows = 1;
 	mm->head_node.scanned_block = 0;
 	mm->head_node.scanned_prev_free = 0;
 	mm->head_node.scanned_next_free = 0;
 	mm->head_node.mm = mm;
 	mm->head_node.start = start + size;
 	mm->head_node.size = start - mm->head_node.start;
-	list_add_tail(&mm->head_node.hole_stack, &mm->hole_stack);
+	add_hole(&mm->head_node);
 
 	mm->color_adjust = NULL;
 }
@@ -845,8 +1168,18 @@ EXPORT_SYMBOL(drm_mm_init);
  */
 void drm_mm_takedown(struct drm_mm * mm)
 {
+	struct drm_mm_node *entry, *next;
+
 	WARN(!list_empty(&mm->head_node.node_list),
 	     "Memory manager not clean during takedown.\n");
+
+	spin_lock(&mm->unused_lock);
+	list_for_each_entry_safe(entry, next, &mm->unused_nodes, node_list) {
+		list_del(&entry->node_list);
+		kmem_cache_free(drm_mm_node_cache, entry);
+		--mm->num_unused;
+	}
+	spin_unlock(&mm->unused_lock);
 }
 EXPORT_SYMBOL(drm_mm_takedown);
 
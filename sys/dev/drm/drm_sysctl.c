@@ -47,6 +47,7 @@ static int	   drm_name_info DRM_SYSCTL_HANDLER_ARGS;
 static int	   drm_vm_info DRM_SYSCTL_HANDLER_ARGS;
 static int	   drm_clients_info DRM_SYSCTL_HANDLER_ARGS;
 static int	   drm_bufs_info DRM_SYSCTL_HANDLER_ARGS;
+static int	   drm_hashtab_info DRM_SYSCTL_HANDLER_ARGS;
 
 struct drm_sysctl_list {
 	const char *name;
@@ -56,6 +57,7 @@ struct drm_sysctl_list {
 	{"vm",	    drm_vm_info},
 	{"clients", drm_clients_info},
 	{"bufs",    drm_bufs_info},
+	{"hashtab", drm_hashtab_info},
 };
 #define DRM_SYSCTL_ENTRIES NELEM(drm_sysctl_list)
 
@@ -82,6 +84,7 @@ int drm_sysctl_init(struct drm_device *dev)
 	    OID_AUTO, info->name, CTLFLAG_RW, NULL, NULL);
 	if (!top)
 		return 1;
+	info->top = top;
 	
 	for (i = 0; i < DRM_SYSCTL_ENTRIES; i++) {
 		oid = SYSCTL_ADD_OID(&info->ctx,
@@ -300,3 +303,45 @@ done:
 	kfree(tempprivs);
 	return retcode;
 }
+
+/**
+ * Called when "/proc/dri/.../hashtab" is read.
+ *
+ * Prints chain length statistics of the map and GEM mmap offset hash tables.
+ */
+static int drm_hashtab_info DRM_SYSCTL_HANDLER_ARGS
+{
+	struct drm_device *dev = arg1;
+	struct drm_gem_mm *mm;
+	struct drm_ht_stats stats[2];
+	const char *names[2] = { "map", "gem_offset" };
+	char buf[128];
+	int retcode;
+	int i, j, n;
+
+	n = 0;
+	DRM_LOCK(dev);
+	if (dev->map_hash.table != NULL)
+		drm_ht_stats(&dev->map_hash, &stats[n++]);
+	else
+		names[0] = names[1];
+	mm = dev->mm_private;
+	if (mm != NULL)
+		drm_ht_stats(&mm->offset_hash, &stats[n++]);
+	DRM_UNLOCK(dev);
+
+	DRM_SYSCTL_PRINT("\ntable          items  buckets     used  max resizes"
+	    " chains 1..%d+\n", DRM_HT_CHAIN_HIST);
+	for (i = 0; i < n; i++) {
+		DRM_SYSCTL_PRINT("%-10s %9lu %8lu %8lu %4lu %7lu ", names[i],
+		    stats[i].items, stats[i].buckets, stats[i].used,
+		    stats[i].max_chain, stats[i].resizes);
+		for (j = 0; j < DRM_HT_CHAIN_HIST; j++)
+			DRM_SYSCTL_PRINT(" %lu", stats[i].chains[j]);
+		DRM_SYSCTL_PRINT("\n");
+	}
+	SYSCTL_OUT(req, "", 1);
+
+done:
+	return retcode;
+}
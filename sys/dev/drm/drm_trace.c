@@ -0,0 +1,251 @@
+/*
+ * Copyright (c) 2026 The DragonFly Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice unmodified, this list of conditions, and the following
+ *    disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/kernel.h>
+#include <sys/lock.h>
+#include <sys/sysctl.h>
+#include <sys/thread2.h>
+#include <machine/cpufunc.h>
+
+#include <drm/drmP.h>
+#include <drm/drm_tracebuf.h>
+
+/*
+ * Tracepoint backend.
+ *
+ * Each cpu has a single-producer ring of struct drm_trace_record.  Records
+ * are only ever appended by their own cpu inside a critical section, so the
+ * producer side needs no locks or atomics; it publishes a record by bumping
+ * head after filling it in.  The sysctl reader is the only consumer and
+ * advances tail once it has copied records out.  A full ring drops new
+ * records and counts them rather than overwriting unread ones.
+ *
+ * Rings are allocated the first time any event class is enabled and stay
+ * around until the module is unloaded.
+ */
+
+#define DRM_TRACE_RING_RECORDS	4096
+
+struct drm_trace_ring {
+	u_int		head;		/* owning cpu only */
+	u_long		lost;		/* owning cpu only */
+	u_int		tail __cachealign;	/* reader only */
+	struct drm_trace_record rec[] __cachealign;
+};
+
+u_int drm_trace_classes;
+
+static struct drm_trace_ring *drm_trace_rings[MAXCPU];
+static int drm_trace_ring_records = DRM_TRACE_RING_RECORDS;
+static struct lock drm_trace_lock;
+
+TUNABLE_INT("drm.trace.ring_records", &drm_trace_ring_records);
+
+SYSCTL_DECL(_hw_dri);
+static SYSCTL_NODE(_hw_dri, OID_AUTO, trace, CTLFLAG_RD, 0,
+    "DRM tracepoints");
+
+void
+drm_trace_record(u_int event, uint32_t arg0, uint64_t arg1, uint64_t arg2)
+{
+	struct drm_trace_ring *ring;
+	struct drm_trace_record *rec;
+	u_int head;
+
+	crit_enter();
+	ring = drm_trace_rings[mycpuid];
+	if (ring == NULL)
+		goto out;
+
+	head = ring->head;
+	if (head - ring->tail >= drm_trace_ring_records) {
+		ring->lost++;
+		goto out;
+	}
+
+	rec = &ring->rec[head & (drm_trace_ring_records - 1)];
+	rec->tsc = rdtsc();
+	rec->event = event;
+	rec->cpu = mycpuid;
+	rec->arg0 = arg0;
+	rec->arg1 = arg1;
+	rec->arg2 = arg2;
+	cpu_sfence();
+	ring->head = head + 1;
+out:
+	crit_exit();
+}
+
+static void
+drm_trace_alloc_rings(void)
+{
+	struct drm_trace_ring *ring;
+	size_t size;
+	int i;
+
+	size = sizeof(*ring) +
+	    drm_trace_ring_records * sizeof(struct drm_trace_record);
+	for (i = 0; i < ncpus; i++) {
+		if (drm_trace_rings[i] != NULL)
+			continue;
+		ring = kmalloc(size, M_DRM, M_WAITOK | M_ZERO);
+		cpu_sfence();
+		drm_trace_rings[i] = ring;
+	}
+}
+
+static int
+drm_trace_sysctl_classes(SYSCTL_HANDLER_ARGS)
+{
+	u_int val;
+	int error;
+
+	val = drm_trace_classes;
+	error = sysctl_handle_int(oidp, &val, 0, req);
+	if (error || req->newptr == NULL)
+		return error;
+
+	val &= (1U << DRM_TRACE_NCLASSES) - 1;
+	lockmgr(&drm_trace_lock, LK_EXCLUSIVE);
+	if (val)
+		drm_trace_alloc_rings();
+	drm_trace_classes = val;
+	lockmgr(&drm_trace_lock, LK_RELEASE);
+
+	return 0;
+}
+
+static int
+drm_trace_sysctl_lost(SYSCTL_HANDLER_ARGS)
+{
+	u_long val = 0;
+	int i;
+
+	for (i = 0; i < ncpus; i++) {
+		if (drm_trace_rings[i] != NULL)
+			val += drm_trace_rings[i]->lost;
+	}
+
+	return sysctl_handle_long(oidp, &val, 0, req);
+}
+
+/*
+ * Drain as many records as fit in the caller's buffer.  A size probe
+ * (oldptr == NULL) reports the number of pending bytes without consuming
+ * anything.
+ */
+static int
+drm_trace_sysctl_records(SYSCTL_HANDLER_ARGS)
+{
+	struct drm_trace_ring *ring;
+	u_int head, tail, n, idx, chunk;
+	size_t space;
+	int error = 0;
+	int i;
+
+	lockmgr(&drm_trace_lock, LK_EXCLUSIVE);
+	for (i = 0; i < ncpus && error == 0; i++) {
+		ring = drm_trace_rings[i];
+		if (ring == NULL)
+			continue;
+
+		head = ring->head;
+		cpu_lfence();
+		tail = ring->tail;
+		n = head - tail;
+		if (n == 0)
+			continue;
+
+		if (req->oldptr == NULL) {
+			error = SYSCTL_OUT(req, NULL,
+			    n * sizeof(struct drm_trace_record));
+			continue;
+		}
+
+		space = (req->oldlen - req->oldidx) /
+		    sizeof(struct drm_trace_record);
+		if (n > space)
+			n = space;
+		if (n == 0)
+			break;
+
+		idx = tail & (drm_trace_ring_records - 1);
+		chunk = min(n, drm_trace_ring_records - idx);
+		error = SYSCTL_OUT(req, &ring->rec[idx],
+		    chunk * sizeof(struct drm_trace_record));
+		if (error == 0 && chunk < n)
+			error = SYSCTL_OUT(req, &ring->rec[0],
+			    (n - chunk) * sizeof(struct drm_trace_record));
+		if (error)
+			break;
+
+		cpu_mfence();
+		ring->tail = tail + n;
+	}
+	lockmgr(&drm_trace_lock, LK_RELEASE);
+
+	return error;
+}
+
+SYSCTL_PROC(_hw_dri_trace, OID_AUTO, classes, CTLTYPE_UINT | CTLFLAG_RW,
+    NULL, 0, drm_trace_sysctl_classes, "IU",
+    "Bitmask of enabled event classes");
+SYSCTL_INT(_hw_dri_trace, OID_AUTO, ring_records, CTLFLAG_RD,
+    &drm_trace_ring_records, 0, "Records per cpu ring");
+SYSCTL_PROC(_hw_dri_trace, OID_AUTO, lost, CTLTYPE_ULONG | CTLFLAG_RD,
+    NULL, 0, drm_trace_sysctl_lost, "LU",
+    "Records dropped because a ring was full");
+SYSCTL_PROC(_hw_dri_trace, OID_AUTO, records, CTLTYPE_OPAQUE | CTLFLAG_RD,
+    NULL, 0, drm_trace_sysctl_records, "S,drm_trace_record",
+    "Drain pending trace records");
+
+void
+drm_trace_init(void)
+{
+	lockinit(&drm_trace_lock, "drmtrace", 0, 0);
+
+	/* The ring index is masked, so keep the size a power of two */
+	if (drm_trace_ring_records < 64)
+		drm_trace_ring_records = 64;
+	drm_trace_ring_records = 1 << fls(drm_trace_ring_records - 1);
+}
+
+void
+drm_trace_fini(void)
+{
+	int i;
+
+	drm_trace_classes = 0;
+	for (i = 0; i < ncpus; i++) {
+		if (drm_trace_rings[i] == NULL)
+			continue;
+		kfree(drm_trace_rings[i]);
+		drm_trace_rings[i] = NULL;
+	}
+	lockuninit(&drm_trace_lock);
+}
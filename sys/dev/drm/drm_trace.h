@@ -31,8 +31,25 @@
 #define trace_i915_ppgtt_create(base)
 #define trace_i915_ppgtt_release(base)
 
-#define trace_drm_vblank_event(a,b)
-#define trace_drm_vblank_event_delivered(a,b,c)
-#define trace_drm_vblank_event_queued(a,b,c)
+#include <drm/drm_tracebuf.h>
+
+static inline void
+trace_drm_vblank_event(int pipe, unsigned int seq)
+{
+	drm_trace(DRM_TRACE_VBLANK, pipe, seq, 0);
+}
+
+static inline void
+trace_drm_vblank_event_queued(pid_t pid, unsigned int pipe, unsigned int seq)
+{
+	drm_trace(DRM_TRACE_VBLANK_EVENT_QUEUED, pipe, seq, pid);
+}
+
+static inline void
+trace_drm_vblank_event_delivered(pid_t pid, unsigned int pipe,
+				 unsigned int seq)
+{
+	drm_trace(DRM_TRACE_VBLANK_EVENT_DELIVERED, pipe, seq, pid);
+}
 
 #endif /* _DRM_TRACE_H_ */
@@ -672,70 +672,182 @@ static bool validate_regs_sorted(struct intel_engine_cs *engine)
 	return true;
 }
 
-struct cmd_node {
-	const struct drm_i915_cmd_descriptor *desc;
-	struct hlist_node node;
-};
-
 /*
  * Different command ranges have different numbers of bits for the opcode. For
  * example, MI commands use bits 31:23 while 3D commands use bits 31:16. The
  * problem is that, for example, MI commands use bits 22:16 for other fields
- * such as GGTT vs PPGTT bits. If we include those bits in the mask then when
- * we mask a command from a batch it could hash to the wrong bucket due to
+ * such as GGTT vs PPGTT bits. If we include those bits in the index then when
+ * we mask a command from a batch it could land in the wrong bucket due to
  * non-opcode bits being set. But if we don't include those bits, some 3D
- * commands may hash to the same bucket due to not including opcode bits that
- * make the command unique. For now, we will risk hashing to the same bucket.
- *
- * If we attempt to generate a perfect hash, we should be able to look at bits
- * 31:29 of a command from a batch buffer and use the full mask for that
- * client. The existing INSTR_CLIENT_MASK/SHIFT defines can be used for this.
+ * commands may share a bucket due to not including opcode bits that
+ * make the command unique. For now, we will risk sharing buckets.
  */
-#define CMD_HASH_MASK STD_MI_OPCODE_MASK
+#define CMD_INDEX_SHIFT 23
+#define CMD_INDEX_SIZE (1 << (32 - CMD_INDEX_SHIFT))
+#define CMD_INDEX(cmd) ((cmd) >> CMD_INDEX_SHIFT)
 
-static int init_hash_table(struct intel_engine_cs *engine,
-			   const struct drm_i915_cmd_table *cmd_tables,
-			   int cmd_table_count)
+/*
+ * Command descriptors are indexed directly by the opcode bits of the command
+ * header. Each bucket is a contiguous run of candidate descriptors, so a lookup
+ * is one table access plus a short scan instead of a hash chain walk.
+ */
+struct i915_cmd_index {
+	u16 start[CMD_INDEX_SIZE + 1];
+	const struct drm_i915_cmd_descriptor *desc[];
+};
+
+/*
+ * The register whitelist of a ring, merged from all its tables and sorted by
+ * offset. Offsets are packed separately from the descriptors so that the
+ * binary search touches as few cachelines as possible. There is one index for
+ * ordinary clients and one which also contains the master-only registers.
+ */
+struct i915_reg_index {
+	int count;
+	const struct drm_i915_reg_descriptor **desc;
+	u32 addr[];
+};
+
+static int init_cmd_index(struct intel_engine_cs *engine,
+			  const struct drm_i915_cmd_table *cmd_tables,
+			  int cmd_table_count)
 {
-#if 0
+	struct i915_cmd_index *index;
+	u16 fill[CMD_INDEX_SIZE];
+	int count = 0;
 	int i, j;
 
-	hash_init(engine->cmd_hash);
+	for (i = 0; i < cmd_table_count; i++)
+		count += cmd_tables[i].count;
 
-	for (i = 0; i < cmd_table_count; i++) {
+	index = kzalloc(sizeof(*index) + count * sizeof(index->desc[0]),
+			GFP_KERNEL);
+	if (index == NULL)
+		return -ENOMEM;
+
+	for (i = 0; i < cmd_table_count; i++)
+		for (j = 0; j < cmd_tables[i].count; j++)
+			index->start[CMD_INDEX(cmd_tables[i].table[j].cmd.value) + 1]++;
+
+	for (i = 0; i < CMD_INDEX_SIZE; i++) {
+		index->start[i + 1] += index->start[i];
+		fill[i] = index->start[i];
+	}
+
+	/*
+	 * Later tables take precedence over earlier ones (e.g. the
+	 * Haswell-specific render commands over the common ones), so fill each
+	 * bucket back to front.
+	 */
+	for (i = cmd_table_count - 1; i >= 0; i--) {
 		const struct drm_i915_cmd_table *table = &cmd_tables[i];
 
-		for (j = 0; j < table->count; j++) {
+		for (j = table->count - 1; j >= 0; j--) {
 			const struct drm_i915_cmd_descriptor *desc =
 				&table->table[j];
-			struct cmd_node *desc_node =
-				kmalloc(sizeof(*desc_node), GFP_KERNEL);
 
-			if (!desc_node)
-				return -ENOMEM;
+			index->desc[fill[CMD_INDEX(desc->cmd.value)]++] = desc;
+		}
+	}
+
+	engine->cmd_index = index;
+
+	return 0;
+}
+
+static struct i915_reg_index *
+build_reg_index(const struct drm_i915_reg_table *tables, int count,
+		bool is_master)
+{
+	struct i915_reg_index *index;
+	int total = 0;
+	int i, j, k;
+
+	for (i = 0; i < count; i++)
+		total += tables[i].num_regs;
+
+	index = kzalloc(sizeof(*index) + total * sizeof(index->addr[0]),
+			GFP_KERNEL);
+	if (index == NULL)
+		return NULL;
+
+	index->desc = kcalloc(total ? total : 1, sizeof(*index->desc),
+			      GFP_KERNEL);
+	if (index->desc == NULL) {
+		kfree(index);
+		return NULL;
+	}
+
+	/*
+	 * A simple insertion sort, the tables are short and this only runs
+	 * once per ring. The first table listing a register wins, as it did
+	 * for the old table-by-table search.
+	 */
+	for (i = 0; i < count; i++) {
+		const struct drm_i915_reg_table *table = &tables[i];
 
-			desc_node->desc = desc;
-			hash_add(engine->cmd_hash, &desc_node->node,
-				 desc->cmd.value & CMD_HASH_MASK);
+		if (table->master && !is_master)
+			continue;
+
+		for (j = 0; j < table->num_regs; j++) {
+			u32 addr = i915_mmio_reg_offset(table->regs[j].addr);
+
+			for (k = index->count; k > 0; k--) {
+				if (index->addr[k - 1] <= addr)
+					break;
+			}
+
+			if (k > 0 && index->addr[k - 1] == addr)
+				continue;
+
+			memmove(&index->addr[k + 1], &index->addr[k],
+				(index->count - k) * sizeof(index->addr[0]));
+			memmove(&index->desc[k + 1], &index->desc[k],
+				(index->count - k) * sizeof(index->desc[0]));
+			index->addr[k] = addr;
+			index->desc[k] = &table->regs[j];
+			index->count++;
 		}
 	}
-#endif
+
+	return index;
+}
+
+static void free_reg_index(struct i915_reg_index *index)
+{
+	if (index == NULL)
+		return;
+
+	kfree(index->desc);
+	kfree(index);
+}
+
+static int init_reg_index(struct intel_engine_cs *engine)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(engine->reg_index); i++) {
+		engine->reg_index[i] = build_reg_index(engine->reg_tables,
+						       engine->reg_table_count,
+						       i);
+		if (engine->reg_index[i] == NULL)
+			return -ENOMEM;
+	}
 
 	return 0;
 }
 
-static void fini_hash_table(struct intel_engine_cs *engine)
+static void fini_indices(struct intel_engine_cs *engine)
 {
-#if 0
-	struct hlist_node *tmp;
-	struct cmd_node *desc_node;
 	int i;
 
-	hash_for_each_safe(engine->cmd_hash, i, tmp, desc_node, node) {
-		hash_del(&desc_node->node);
-		kfree(desc_node);
+	kfree(engine->cmd_index);
+	engine->cmd_index = NULL;
+
+	for (i = 0; i < ARRAY_SIZE(engine->reg_index); i++) {
+		free_reg_index(engine->reg_index[i]);
+		engine->reg_index[i] = NULL;
 	}
-#endif
 }
 
 /**
@@ -817,14 +929,14 @@ int i915_cmd_parser_init_ring(struct intel_engine_cs *engine)
 	BUG_ON(!validate_cmds_sorted(engine, cmd_tables, cmd_table_count));
 	BUG_ON(!validate_regs_sorted(engine));
 
-#if 0
-	WARN_ON(!hash_empty(engine->cmd_hash));
-#endif
+	WARN_ON(engine->cmd_index != NULL);
 
-	ret = init_hash_table(engine, cmd_tables, cmd_table_count);
+	ret = init_cmd_index(engine, cmd_tables, cmd_table_count);
+	if (ret == 0)
+		ret = init_reg_index(engine);
 	if (ret) {
 		DRM_ERROR("CMD: cmd_parser_init failed!\n");
-		fini_hash_table(engine);
+		fini_indices(engine);
 		return ret;
 	}
 
@@ -845,26 +957,25 @@ void i915_cmd_parser_fini_ring(struct intel_engine_cs *engine)
 	if (!engine->needs_cmd_parser)
 		return;
 
-	fini_hash_table(engine);
+	fini_indices(engine);
 }
 
 static const struct drm_i915_cmd_descriptor*
 find_cmd_in_table(struct intel_engine_cs *engine,
 		  u32 cmd_header)
 {
-#if 0
-	struct cmd_node *desc_node;
+	const struct i915_cmd_index *index = engine->cmd_index;
+	unsigned int bucket = CMD_INDEX(cmd_header);
+	int i;
 
-	hash_for_each_possible(engine->cmd_hash, desc_node, node,
-			       cmd_header & CMD_HASH_MASK) {
-		const struct drm_i915_cmd_descriptor *desc = desc_node->desc;
+	for (i = index->start[bucket]; i < index->start[bucket + 1]; i++) {
+		const struct drm_i915_cmd_descriptor *desc = index->desc[i];
 		u32 masked_cmd = desc->cmd.mask & cmd_header;
 		u32 masked_value = desc->cmd.value & desc->cmd.mask;
 
 		if (masked_cmd == masked_value)
 			return desc;
 	}
-#endif
 
 	return NULL;
 }
@@ -900,107 +1011,98 @@ find_cmd(struct intel_engine_cs *engine,
 	return default_desc;
 }
 
+/*
+ * Branch-free binary search for the last offset <= addr, the loop always runs
+ * log2(count) times and only the final compare decides the result.
+ */
 static const struct drm_i915_reg_descriptor *
-find_reg(const struct drm_i915_reg_descriptor *table,
-	 int count, u32 addr)
+find_reg(const struct i915_reg_index *index, u32 addr)
 {
-	int i;
-
-	for (i = 0; i < count; i++) {
-		if (i915_mmio_reg_offset(table[i].addr) == addr)
-			return &table[i];
-	}
+	const u32 *base = index->addr;
+	unsigned int n = index->count;
 
-	return NULL;
-}
+	if (n == 0)
+		return NULL;
 
-static const struct drm_i915_reg_descriptor *
-find_reg_in_tables(const struct drm_i915_reg_table *tables,
-		   int count, bool is_master, u32 addr)
-{
-	int i;
-	const struct drm_i915_reg_table *table;
-	const struct drm_i915_reg_descriptor *reg;
+	while (n > 1) {
+		unsigned int half = n / 2;
 
-	for (i = 0; i < count; i++) {
-		table = &tables[i];
-		if (!table->master || is_master) {
-			reg = find_reg(table->regs, table->num_regs,
-				       addr);
-			if (reg != NULL)
-				return reg;
-		}
+		base = base[half] <= addr ? base + half : base;
+		n -= half;
 	}
 
-	return NULL;
+	if (*base != addr)
+		return NULL;
+
+	return index->desc[base - index->addr];
 }
 
-static u32 *vmap_batch(struct drm_i915_gem_object *obj,
-		       unsigned start, unsigned len)
+/*
+ * The user batch is copied into the shadow batch just ahead of the parser, one
+ * chunk at a time, so that each command is validated while its copy is still
+ * hot in the cache rather than in a second walk over the whole shadow batch.
+ * Only the copy is ever inspected, so userspace cannot change a command after
+ * it has been checked.
+ */
+#define BATCH_COPY_CHUNK 4096
+
+struct batch_copy {
+	char *src;
+	char *dst;
+	u32 copied;
+	u32 len;
+	bool needs_clflush;
+};
+
+static void copy_batch_upto(struct batch_copy *bc, u32 end)
 {
-	int i;
-	void *addr = NULL;
-	struct sg_page_iter sg_iter;
-	int first_page = start >> PAGE_SHIFT;
-	int last_page = (len + start + 4095) >> PAGE_SHIFT;
-	int npages = last_page - first_page;
-	struct vm_page **pages;
-
-	pages = drm_malloc_ab(npages, sizeof(*pages));
-	if (pages == NULL) {
-		DRM_DEBUG_DRIVER("Failed to get space for pages\n");
-		goto finish;
-	}
+	u32 len;
 
-	i = 0;
-	for_each_sg_page(obj->pages->sgl, &sg_iter, obj->pages->nents, first_page) {
-		pages[i++] = sg_page_iter_page(&sg_iter);
-		if (i == npages)
-			break;
-	}
+	if (end <= bc->copied)
+		return;
 
-#if 0
-	addr = vmap(pages, i, 0, PAGE_KERNEL);
-	if (addr == NULL) {
-		DRM_DEBUG_DRIVER("Failed to vmap pages\n");
-		goto finish;
-	}
-#endif
+	end = min_t(u32, ALIGN(end, BATCH_COPY_CHUNK), bc->len);
+	len = end - bc->copied;
+
+	if (bc->needs_clflush)
+		drm_clflush_virt_range(bc->src + bc->copied, len);
+	memcpy(bc->dst + bc->copied, bc->src + bc->copied, len);
 
-finish:
-	if (pages)
-		drm_free_large(pages);
-	return (u32*)addr;
+	bc->copied = end;
 }
 
-/* Returns a vmap'd pointer to dest_obj, which the caller must unmap */
-static u32 *copy_batch(struct drm_i915_gem_object *dest_obj,
-		       struct drm_i915_gem_object *src_obj,
-		       u32 batch_start_offset,
-		       u32 batch_len)
+/*
+ * Maps the source and shadow batches for copy_batch_upto(). The mappings are
+ * cached on the objects by i915_gem_object_pin_map(), so a shadow batch which
+ * is recycled through the batch pool is only ever mapped once.
+ */
+static int copy_batch_begin(struct batch_copy *bc,
+			    struct drm_i915_gem_object *dest_obj,
+			    struct drm_i915_gem_object *src_obj,
+			    u32 batch_start_offset,
+			    u32 batch_len)
 {
 	int needs_clflush = 0;
-	char *src_base, *src;
-	void *dst = NULL;
+	void *src_base, *dst;
 	int ret;
 
 	if (batch_len > dest_obj->base.size ||
 	    batch_len + batch_start_offset > src_obj->base.size)
-		return ERR_PTR(-E2BIG);
+		return -E2BIG;
 
 	if (WARN_ON(dest_obj->pages_pin_count == 0))
-		return ERR_PTR(-ENODEV);
+		return -ENODEV;
 
 	ret = i915_gem_obj_prepare_shmem_read(src_obj, &needs_clflush);
 	if (ret) {
 		DRM_DEBUG_DRIVER("CMD: failed to prepare shadow batch\n");
-		return ERR_PTR(ret);
+		return ret;
 	}
 
-	src_base = (char *)vmap_batch(src_obj, batch_start_offset, batch_len);
-	if (!src_base) {
+	src_base = i915_gem_object_pin_map(src_obj);
+	if (IS_ERR(src_base)) {
 		DRM_DEBUG_DRIVER("CMD: Failed to vmap batch\n");
-		ret = -ENOMEM;
+		ret = PTR_ERR(src_base);
 		goto unpin_src;
 	}
 
@@ -1010,25 +1112,35 @@ static u32 *copy_batch(struct drm_i915_gem_object *dest_obj,
 		goto unmap_src;
 	}
 
-	dst = vmap_batch(dest_obj, 0, batch_len);
-	if (!dst) {
+	dst = i915_gem_object_pin_map(dest_obj);
+	if (IS_ERR(dst)) {
 		DRM_DEBUG_DRIVER("CMD: Failed to vmap shadow batch\n");
-		ret = -ENOMEM;
+		ret = PTR_ERR(dst);
 		goto unmap_src;
 	}
 
-	src = src_base + offset_in_page(batch_start_offset);
-	if (needs_clflush)
-		drm_clflush_virt_range(src, batch_len);
+	bc->src = (char *)src_base + batch_start_offset;
+	bc->dst = dst;
+	bc->copied = 0;
+	bc->len = batch_len;
+	bc->needs_clflush = needs_clflush;
 
-	memcpy(dst, src, batch_len);
+	return 0;
 
 unmap_src:
-	vunmap(src_base);
+	i915_gem_object_unpin_map(src_obj);
 unpin_src:
 	i915_gem_object_unpin_pages(src_obj);
+	return ret;
+}
 
-	return ret ? ERR_PTR(ret) : dst;
+static void copy_batch_end(struct batch_copy *bc,
+			   struct drm_i915_gem_object *dest_obj,
+			   struct drm_i915_gem_object *src_obj)
+{
+	i915_gem_object_unpin_map(dest_obj);
+	i915_gem_object_unpin_map(src_obj);
+	i915_gem_object_unpin_pages(src_obj);
 }
 
 /**
@@ -1081,10 +1193,8 @@ static bool check_cmd(const struct intel_engine_cs *engine,
 		     offset += step) {
 			const u32 reg_addr = cmd[offset] & desc->reg.mask;
 			const struct drm_i915_reg_descriptor *reg =
-				find_reg_in_tables(engine->reg_tables,
-						   engine->reg_table_count,
-						   is_master,
-						   reg_addr);
+				find_reg(engine->reg_index[is_master],
+					 reg_addr);
 
 			if (!reg) {
 				DRM_DEBUG_DRIVER("CMD: Rejected register 0x%08X in command: 0x%08X (ring=%d)\n",
@@ -1197,20 +1307,21 @@ int i915_parse_cmds(struct intel_engine_cs *engine,
 	u32 *cmd, *batch_base, *batch_end;
 	struct drm_i915_cmd_descriptor default_desc = { 0 };
 	bool oacontrol_set = false; /* OACONTROL tracking. See check_cmd() */
+	struct batch_copy bc;
 	int ret = 0;
 
-	batch_base = copy_batch(shadow_batch_obj, batch_obj,
-				batch_start_offset, batch_len);
-	if (IS_ERR(batch_base)) {
+	ret = copy_batch_begin(&bc, shadow_batch_obj, batch_obj,
+			       batch_start_offset, batch_len);
+	if (ret) {
 		DRM_DEBUG_DRIVER("CMD: Failed to copy batch\n");
-		return PTR_ERR(batch_base);
+		return ret;
 	}
 
 	/*
 	 * We use the batch length as size because the shadow object is as
-	 * large or larger and copy_batch() will write MI_NOPs to the extra
-	 * space. Parsing should be faster in some cases this way.
+	 * large or larger. Parsing should be faster in some cases this way.
 	 */
+	batch_base = (u32 *)bc.dst;
 	batch_end = batch_base + (batch_len / sizeof(*batch_end));
 
 	cmd = batch_base;
@@ -1218,6 +1329,8 @@ int i915_parse_cmds(struct intel_engine_cs *engine,
 		const struct drm_i915_cmd_descriptor *desc;
 		u32 length;
 
+		copy_batch_upto(&bc, (char *)(cmd + 1) - bc.dst);
+
 		if (*cmd == MI_BATCH_BUFFER_END)
 			break;
 
@@ -1253,6 +1366,8 @@ int i915_parse_cmds(struct intel_engine_cs *engine,
 			break;
 		}
 
+		copy_batch_upto(&bc, (char *)(cmd + length) - bc.dst);
+
 		if (!check_cmd(engine, desc, cmd, length, is_master,
 			       &oacontrol_set)) {
 			ret = -EINVAL;
@@ -1272,7 +1387,11 @@ int i915_parse_cmds(struct intel_engine_cs *engine,
 		ret = -EINVAL;
 	}
 
-	vunmap(batch_base);
+	/* Anything after the BBE is never executed, but keep the copy whole. */
+	if (ret == 0)
+		copy_batch_upto(&bc, batch_len);
+
+	copy_batch_end(&bc, shadow_batch_obj, batch_obj);
 
 	return ret;
 }
@@ -699,6 +699,18 @@ struct intel_uncore {
 		u32 val_reset;
 	} fw_domain[FW_DOMAIN_ID_COUNT];
 
+	/*
+	 * Forcewake domains needed to read and write each register range,
+	 * sorted by offset and covering all of the forcewake MMIO space
+	 * without holes. Built once at intel_uncore_init().
+	 */
+	struct intel_uncore_fw_range {
+		u32 start;
+		u16 read_domains;
+		u16 write_domains;
+	} fw_range[64];
+	unsigned int fw_range_count;
+
 	int unclaimed_mmio_check;
 };
 
@@ -843,6 +855,7 @@ struct i915_ctx_hang_stats {
  * @hang_stats: information about the role of this context in possible GPU
  *		hangs.
  * @ppgtt: virtual memory space used by this context.
+ * @priority: execlists submission priority, see I915_CONTEXT_PARAM_PRIORITY.
  * @legacy_hw_ctx: render context backing object and whether it is correctly
  *                initialized (legacy ring submission mechanism only).
  * @link: link in the global list of contexts.
@@ -859,6 +872,7 @@ struct intel_context {
 	struct drm_i915_file_private *file_priv;
 	struct i915_ctx_hang_stats hang_stats;
 	struct i915_hw_ppgtt *ppgtt;
+	int priority;
 
 	/* Legacy ring buffer submission */
 	struct {
@@ -874,6 +888,8 @@ struct intel_context {
 		struct i915_vma *lrc_vma;
 		u64 lrc_desc;
 		uint32_t *lrc_reg_state;
+		int queued;
+		int queue_level;
 	} engine[I915_NUM_ENGINES];
 
 	struct list_head link;
@@ -1282,11 +1298,45 @@ struct i915_gem_mm {
 
 	/** PPGTT used for aliasing the PPGTT with the GTT */
 	struct i915_hw_ppgtt *aliasing_ppgtt;
+	struct sysctl_ctx_list ppgtt_sysctl_ctx;
+
+	/** GTT mmap fault statistics, see i915_gem_fault() */
+	struct sysctl_ctx_list fault_sysctl_ctx;
+	unsigned long fault_count;
+	unsigned long fault_partial;
+	unsigned long fault_recycled;
+	uint64_t fault_ns;
+
+	/** Backing page lookup, see i915_gem_object_get_pages_gtt() */
+	struct sysctl_ctx_list pages_sysctl_ctx;
+	u_int pages_batch;
+	unsigned long pages_calls;
+	unsigned long pages_count;
+	uint64_t pages_ns;
+
+	/** Request wait tuning, see __i915_spin_request() */
+	struct sysctl_ctx_list wait_sysctl_ctx;
+	u_int spin_ns;
+
+	/** Per-engine batch pool statistics, see i915_gem_batch_pool.c */
+	struct sysctl_ctx_list pool_sysctl_ctx;
+
+	/** hw.dri.N.selftest, see i915_gem_selftest_sysctl_init() */
+	struct sysctl_ctx_list selftest_sysctl_ctx;
 
 	struct notifier_block oom_notifier;
 	struct notifier_block vmap_notifier;
 #if 0
 	struct shrinker shrinker;
+#else
+	/* vm_lowmem hook standing in for the Linux shrinker */
+	eventhandler_tag lowmem_handler;
+	struct sysctl_ctx_list shrinker_sysctl_ctx;
+	unsigned long shrinker_batch;
+	unsigned long shrinker_calls;
+	unsigned long shrinker_busy;
+	unsigned long shrinker_scanned;
+	unsigned long shrinker_reclaimed;
 #endif
 	bool shrinker_no_lock_stealing;
 
@@ -2334,11 +2384,18 @@ struct drm_i915_gem_request {
 	 *
 	 * All accesses to the queue are mediated by a spinlock
 	 * (ring->execlist_lock).
+	 *
+	 * Requests waiting for a free ELSP port sit on one of the per
+	 * priority FIFOs (ring->execlist_prio) instead, see
+	 * execlists_context_queue().
 	 */
 
 	/** Execlist link in the submission queue.*/
 	struct list_head execlist_link;
 
+	/** Time at which this request entered the execlist queue, in jiffies */
+	unsigned long execlist_queued;
+
 	/** Execlists no. of times this request has been sent to the ELSP */
 	int elsp_submitted;
 
@@ -38,12 +38,26 @@
 #include <linux/swap.h>
 #include <linux/pci.h>
 
+#include <sys/thread2.h>
+
 static void i915_gem_object_flush_gtt_write_domain(struct drm_i915_gem_object *obj);
 static void i915_gem_object_flush_cpu_write_domain(struct drm_i915_gem_object *obj);
 static void
 i915_gem_object_retire__write(struct drm_i915_gem_object *obj);
 static void
 i915_gem_object_retire__read(struct drm_i915_gem_object *obj, int ring);
+static void
+i915_gem_release_mmap_range(struct drm_i915_gem_object *obj,
+			    vm_pindex_t first, vm_pindex_t count);
+
+/* Pages per partial GGTT view used to GTT mmap large objects (1 MiB) */
+#define I915_GTT_PARTIAL_CHUNK	256
+
+/*
+ * Most backing pages wired per shmem_read_mapping_pages() call, the default
+ * of hw.dri.N.get_pages.batch
+ */
+#define I915_GEM_PAGE_BATCH	64
 
 static bool cpu_cache_is_coherent(struct drm_device *dev,
 				  enum i915_cache_level level)
@@ -361,13 +375,14 @@ out:
 
 void *i915_gem_object_alloc(struct drm_device *dev)
 {
-	return kmalloc(sizeof(struct drm_i915_gem_object),
-	    M_DRM, M_WAITOK | M_ZERO);
+	struct drm_i915_private *dev_priv = dev->dev_private;
+	return kmem_cache_zalloc(dev_priv->objects, GFP_KERNEL);
 }
 
 void i915_gem_object_free(struct drm_i915_gem_object *obj)
 {
-	kfree(obj);
+	struct drm_i915_private *dev_priv = obj->base.dev->dev_private;
+	kmem_cache_free(dev_priv->objects, obj);
 }
 
 static int
@@ -1141,49 +1156,163 @@ static bool missed_irq(struct drm_i915_private *dev_priv,
 	return test_bit(engine->id, &dev_priv->gpu_error.missed_irq_rings);
 }
 
-#if 0
-static int __i915_spin_request(struct drm_i915_gem_request *req, int state)
-{
-	unsigned long timeout;
-	unsigned cpu;
-
-	/* When waiting for high frequency requests, e.g. during synchronous
-	 * rendering split between the CPU and GPU, the finite amount of time
-	 * required to set up the irq and wait upon it limits the response
-	 * rate. By busywaiting on the request completion for a short while we
-	 * can service the high frequency waits as quick as possible. However,
-	 * if it is a slow request, we want to sleep as quickly as possible.
-	 * The tradeoff between waiting and sleeping is roughly the time it
-	 * takes to sleep on a request, on the order of a microsecond.
-	 */
+/*
+ * Optimistic spin before sleeping on a request.
+ *
+ * When waiting for high frequency requests, e.g. during synchronous
+ * rendering split between the CPU and GPU, the time required to set up
+ * the irq, sleep and be woken up again limits the response rate.  By
+ * busywaiting on the request completion for a few microseconds we can
+ * service those waits as quickly as possible, while slow requests still
+ * go to sleep almost immediately.
+ *
+ * The spin is bounded by dev_priv->mm.spin_ns and gives up the cpu as
+ * soon as another thread wants to run on it.
+ */
 
-	if (req->engine->irq_refcount)
-		return -EBUSY;
+/*
+ * Busywait until @done reports completion or @budget_ns has passed.  @done is
+ * first polled with lazy coherency and once more without it after the spin
+ * gives up.  Returns 0 on completion and -EAGAIN otherwise.
+ */
+static int i915_spin_until(bool (*done)(void *data, bool lazy_coherency),
+			   void *data, u64 budget_ns, bool interruptible)
+{
+	u64 timeout;
 
-	/* Only spin if we know the GPU is processing this request */
-	if (!i915_gem_request_started(req, true))
+	if (budget_ns == 0)
 		return -EAGAIN;
 
-	timeout = local_clock_us(&cpu) + 5;
-	while (!need_resched()) {
-		if (i915_gem_request_completed(req, true))
+	timeout = ktime_get_raw_ns() + budget_ns;
+	while (!any_resched_wanted()) {
+		if (done(data, true))
 			return 0;
 
-		if (signal_pending_state(state, current))
+		if (interruptible && signal_pending(curthread->td_lwp))
 			break;
 
-		if (busywait_stop(timeout, cpu))
+		if (ktime_get_raw_ns() > timeout)
 			break;
 
-		cpu_relax_lowlatency();
+		cpu_pause();
 	}
 
-	if (i915_gem_request_completed(req, false))
-		return 0;
+	return done(data, false) ? 0 : -EAGAIN;
+}
 
-	return -EAGAIN;
+static bool i915_spin_request_done(void *data, bool lazy_coherency)
+{
+	return i915_gem_request_completed(data, lazy_coherency);
+}
+
+static int __i915_spin_request(struct drm_i915_gem_request *req,
+			       bool interruptible)
+{
+	struct intel_engine_cs *engine = req->engine;
+	struct drm_i915_private *dev_priv = to_i915(engine->dev);
+	int ret;
+
+	if (dev_priv->mm.spin_ns == 0)
+		return -EAGAIN;
+
+	/* Somebody is already sleeping on this engine, join them */
+	if (engine->irq_refcount)
+		return -EBUSY;
+
+	/* Only spin if we know the GPU is processing this request */
+	if (!i915_gem_request_started(req, true))
+		return -EAGAIN;
+
+	ret = i915_spin_until(i915_spin_request_done, req,
+			      dev_priv->mm.spin_ns, interruptible);
+	if (ret == 0)
+		atomic_add_long(&engine->spin_hits, 1);
+	else
+		atomic_add_long(&engine->spin_misses, 1);
+	return ret;
+}
+
+/*
+ * Fake seqno source for the spin selftest: it completes on the @complete'th
+ * lazy poll, or only on the final coherent poll if @coherent_only is set.
+ */
+struct spin_test_source {
+	int polls;
+	int coherent_polls;
+	int complete;
+	bool coherent_only;
+};
+
+static bool spin_test_done(void *data, bool lazy_coherency)
+{
+	struct spin_test_source *src = data;
+
+	if (!lazy_coherency) {
+		src->coherent_polls++;
+		return src->coherent_only ||
+			(src->complete && src->polls >= src->complete);
+	}
+
+	return src->complete && ++src->polls >= src->complete;
+}
+
+static int i915_spin_selftest(struct drm_i915_private *dev_priv)
+{
+	struct spin_test_source src;
+	u64 start, elapsed;
+	int spun, ret;
+
+	/* A zero budget never polls the request */
+	memset(&src, 0, sizeof(src));
+	src.complete = 1;
+	ret = i915_spin_until(spin_test_done, &src, 0, false);
+	if (ret != -EAGAIN || src.polls || src.coherent_polls) {
+		DRM_ERROR("spin selftest: zero budget returned %d after %d polls\n",
+			  ret, src.polls + src.coherent_polls);
+		return -EINVAL;
+	}
+
+	/* Completion within the budget is a hit, without the final poll */
+	memset(&src, 0, sizeof(src));
+	src.complete = 3;
+	ret = i915_spin_until(spin_test_done, &src, NSEC_PER_SEC, false);
+	if (ret != 0 || src.polls != 3 || src.coherent_polls) {
+		DRM_ERROR("spin selftest: completion returned %d after %d+%d polls\n",
+			  ret, src.polls, src.coherent_polls);
+		return -EINVAL;
+	}
+
+	/* A source that never completes spins out the budget and misses */
+	memset(&src, 0, sizeof(src));
+	start = ktime_get_raw_ns();
+	ret = i915_spin_until(spin_test_done, &src, 50000, false);
+	elapsed = ktime_get_raw_ns() - start;
+	spun = src.polls;
+	if (ret != -EAGAIN || src.coherent_polls != 1) {
+		DRM_ERROR("spin selftest: timeout returned %d after %d+%d polls\n",
+			  ret, src.polls, src.coherent_polls);
+		return -EINVAL;
+	}
+	if (elapsed < 50000 && !any_resched_wanted()) {
+		DRM_ERROR("spin selftest: gave up after %llu of 50000ns\n",
+			  (unsigned long long)elapsed);
+		return -EINVAL;
+	}
+
+	/* Completion seen only by the coherent read still counts as a hit */
+	memset(&src, 0, sizeof(src));
+	src.coherent_only = true;
+	ret = i915_spin_until(spin_test_done, &src, 10000, false);
+	if (ret != 0 || src.coherent_polls != 1) {
+		DRM_ERROR("spin selftest: coherent completion returned %d\n",
+			  ret);
+		return -EINVAL;
+	}
+
+	DRM_INFO("spin selftest passed, timeout after %d polls in %llu ns\n",
+		 spun, (unsigned long long)elapsed);
+	return 0;
 }
-#endif
 
 /**
  * __i915_wait_request - wait until execution of request has finished
@@ -1244,12 +1373,10 @@ int __i915_wait_request(struct drm_i915_gem_request *req,
 
 	trace_i915_gem_request_wait_begin(req);
 
-	/* Optimistic spin for the next jiffie before touching IRQs */
-#if 0
-	ret = __i915_spin_request(req);
+	/* Optimistic spin for a few microseconds before touching IRQs */
+	ret = __i915_spin_request(req, interruptible);
 	if (ret == 0)
 		goto out;
-#endif
 
 	if (!irq_test_in_progress && WARN_ON(!engine->irq_get(engine))) {
 		ret = -ENODEV;
@@ -1747,6 +1874,43 @@ out:
 	return (error);
 }
 
+/*
+ * Limit the partial views of a single object to a quarter of the aperture
+ * by unbinding its least recently faulted windows, so that streaming
+ * through a huge object does not push everything else out of the aperture.
+ */
+static void
+i915_gem_object_trim_partial(struct drm_i915_gem_object *obj)
+{
+	struct drm_i915_private *dev_priv = to_i915(obj->base.dev);
+	struct i915_vma *vma, *next;
+	unsigned int count = 0, max;
+
+	max = dev_priv->ggtt.mappable_end /
+	      (4 * IDX_TO_OFF(I915_GTT_PARTIAL_CHUNK));
+
+	list_for_each_entry(vma, &obj->vma_list, obj_link) {
+		if (vma->is_ggtt &&
+		    vma->ggtt_view.type == I915_GGTT_VIEW_PARTIAL)
+			count++;
+	}
+
+	list_for_each_entry_safe(vma, next, &obj->vma_list, obj_link) {
+		if (count < max)
+			break;
+
+		if (!vma->is_ggtt ||
+		    vma->ggtt_view.type != I915_GGTT_VIEW_PARTIAL ||
+		    vma->pin_count)
+			continue;
+
+		if (i915_vma_unbind(vma) == 0) {
+			dev_priv->mm.fault_recycled++;
+			count--;
+		}
+	}
+}
+
 /**
  * i915_gem_fault - fault a page into the GTT
  *
@@ -1792,10 +1956,13 @@ int i915_gem_fault(vm_object_t vm_obj, vm_ooffset_t offset, int prot, vm_page_t
 	struct drm_i915_private *dev_priv = to_i915(dev);
 	struct i915_ggtt *ggtt = &dev_priv->ggtt;
 	struct i915_ggtt_view view = i915_ggtt_view_normal;
+	struct i915_vma *vma;
 	unsigned long page_offset;
+	vm_ooffset_t view_offset;
 	vm_page_t m, oldm = NULL;
 	int ret = 0;
 	bool write = !!(prot & VM_PROT_WRITE);
+	u64 fault_start = ktime_get_raw_ns();
 
 	intel_runtime_pm_get(dev_priv);
 
@@ -1824,21 +1991,28 @@ retry:
 		goto unlock;
 	}
 
-	/* Use a partial view if the object is bigger than the aperture. */
-	if (obj->base.size >= ggtt->mappable_end &&
-	    obj->tiling_mode == I915_TILING_NONE) {
-#if 0
-		static const unsigned int chunk_size = 256; // 1 MiB
-
+	/*
+	 * Use a partial view if the object would take up too much of the
+	 * aperture, unless it already happens to be mappable as a whole.
+	 */
+	view = i915_ggtt_view_normal;
+	view_offset = 0;
+	if (obj->tiling_mode == I915_TILING_NONE &&
+	    obj->base.size > ggtt->mappable_end / 2 &&
+	    !(i915_gem_obj_ggtt_bound(obj) && obj->map_and_fenceable)) {
 		memset(&view, 0, sizeof(view));
 		view.type = I915_GGTT_VIEW_PARTIAL;
-		view.params.partial.offset = rounddown(page_offset, chunk_size);
+		view.params.partial.offset =
+			rounddown(OFF_TO_IDX(page_offset), I915_GTT_PARTIAL_CHUNK);
 		view.params.partial.size =
 			min_t(unsigned int,
-			      chunk_size,
-			      (vma->vm_end - vma->vm_start)/PAGE_SIZE -
+			      I915_GTT_PARTIAL_CHUNK,
+			      OFF_TO_IDX(obj->base.size) -
 			      view.params.partial.offset);
-#endif
+		view_offset = IDX_TO_OFF(view.params.partial.offset);
+
+		if (!i915_gem_obj_ggtt_bound_view(obj, &view))
+			i915_gem_object_trim_partial(obj);
 	}
 
 	/* Now pin it into the GTT if needed */
@@ -1846,6 +2020,11 @@ retry:
 	if (ret)
 		goto unlock;
 
+	/* Keep obj->vma_list in LRU order for i915_gem_object_trim_partial */
+	vma = i915_gem_obj_to_ggtt_view(obj, &view);
+	if (view.type == I915_GGTT_VIEW_PARTIAL)
+		list_move_tail(&vma->obj_link, &obj->vma_list);
+
 	ret = i915_gem_object_set_to_gtt_domain(obj, write);
 	if (ret)
 		goto unpin;
@@ -1907,7 +2086,7 @@ retry:
 
 	/* Finally, remap it using the new GTT offset */
 	m = vm_phys_fictitious_to_vm_page(ggtt->mappable_base +
-			i915_gem_obj_ggtt_offset_view(obj, &view) + offset);
+			vma->node.start + offset - view_offset);
 	if (m == NULL) {
 		ret = -EFAULT;
 		goto unpin;
@@ -1925,53 +2104,20 @@ retry:
 	}
 	m->valid = VM_PAGE_BITS_ALL;
 
-#if 0
-	if (unlikely(view.type == I915_GGTT_VIEW_PARTIAL)) {
-		/* Overriding existing pages in partial view does not cause
-		 * us any trouble as TLBs are still valid because the fault
-		 * is due to userspace losing part of the mapping or never
-		 * having accessed it before (at this partials' range).
-		 */
-		unsigned long base = vma->vm_start +
-				     (view.params.partial.offset << PAGE_SHIFT);
-		unsigned int i;
-
-		for (i = 0; i < view.params.partial.size; i++) {
-			ret = vm_insert_pfn(vma, base + i * PAGE_SIZE, pfn + i);
-			if (ret)
-				break;
-		}
-
-		obj->fault_mappable = true;
-	} else {
-		if (!obj->fault_mappable) {
-			unsigned long size = min_t(unsigned long,
-						   vma->vm_end - vma->vm_start,
-						   obj->base.size);
-			int i;
-
-			for (i = 0; i < size >> PAGE_SHIFT; i++) {
-				ret = vm_insert_pfn(vma,
-						    (unsigned long)vma->vm_start + i * PAGE_SIZE,
-						    pfn + i);
-				if (ret)
-					break;
-			}
-
-			obj->fault_mappable = true;
-		} else
-			ret = vm_insert_pfn(vma,
-					    (unsigned long)vmf->virtual_address,
-					    pfn + page_offset);
-#endif
-			vm_page_insert(m, vm_obj, OFF_TO_IDX(offset));
-#if 0
-	}
-#endif
+	/*
+	 * Pages faulted through a partial view are released again by
+	 * i915_gem_release_mmap_range() when that view is unbound.
+	 */
+	vm_page_insert(m, vm_obj, OFF_TO_IDX(offset));
 
 have_page:
 	*mres = m;
 
+	dev_priv->mm.fault_count++;
+	if (view.type == I915_GGTT_VIEW_PARTIAL)
+		dev_priv->mm.fault_partial++;
+	dev_priv->mm.fault_ns += ktime_get_raw_ns() - fault_start;
+
 	i915_gem_object_ggtt_unpin_view(obj, &view);
 	mutex_unlock(&dev->struct_mutex);
 	ret = VM_PAGER_OK;
@@ -2027,6 +2173,34 @@ done:
 	return ret;
 }
 
+/*
+ * Revoke the CPU's PTEs for pages [first, first + count) of a GTT mmap.
+ * Used for the whole object by i915_gem_release_mmap() and for a single
+ * window when a partial GGTT view is unbound.
+ */
+static void
+i915_gem_release_mmap_range(struct drm_i915_gem_object *obj,
+			    vm_pindex_t first, vm_pindex_t count)
+{
+	vm_object_t devobj;
+	vm_page_t m;
+	vm_pindex_t i;
+
+	devobj = cdev_pager_lookup(obj);
+	if (devobj == NULL)
+		return;
+
+	VM_OBJECT_LOCK(devobj);
+	for (i = first; i < first + count; i++) {
+		m = vm_page_lookup_busy_wait(devobj, i, TRUE, "915unm");
+		if (m == NULL)
+			continue;
+		cdev_pager_free_page(devobj, m);
+	}
+	VM_OBJECT_UNLOCK(devobj);
+	vm_object_deallocate(devobj);
+}
+
 /**
  * i915_gem_release_mmap - remove physical page mappings
  * @obj: obj in question
@@ -2044,10 +2218,6 @@ done:
 void
 i915_gem_release_mmap(struct drm_i915_gem_object *obj)
 {
-	vm_object_t devobj;
-	vm_page_t m;
-	int i, page_count;
-
 	/* Serialisation between user GTT access and our code depends upon
 	 * revoking the CPU's PTE whilst the mutex is held. The next user
 	 * pagefault then has to wait until we release the mutex.
@@ -2057,20 +2227,7 @@ i915_gem_release_mmap(struct drm_i915_gem_object *obj)
 	if (!obj->fault_mappable)
 		return;
 
-	devobj = cdev_pager_lookup(obj);
-	if (devobj != NULL) {
-		page_count = OFF_TO_IDX(obj->base.size);
-
-		VM_OBJECT_LOCK(devobj);
-		for (i = 0; i < page_count; i++) {
-			m = vm_page_lookup_busy_wait(devobj, i, TRUE, "915unm");
-			if (m == NULL)
-				continue;
-			cdev_pager_free_page(devobj, m);
-		}
-		VM_OBJECT_UNLOCK(devobj);
-		vm_object_deallocate(devobj);
-	}
+	i915_gem_release_mmap_range(obj, 0, OFF_TO_IDX(obj->base.size));
 
 	/* Ensure that the CPU's PTE are revoked and there are not outstanding
 	 * memory transactions from userspace before we return. The TLB
@@ -2374,7 +2531,10 @@ i915_gem_object_get_pages_gtt(struct drm_i915_gem_object *obj)
 	struct scatterlist *sg;
 	struct sg_page_iter sg_iter;
 	struct vm_page *page;
+	struct vm_page *pages[I915_GEM_PAGE_BATCH];
 	unsigned long last_pfn = 0;	/* suppress gcc warning */
+	uint64_t start_ns;
+	int batch, n, j;
 	int ret;
 
 	/* Assert that the object is not currently in any GPU domain. As it
@@ -2388,6 +2548,9 @@ i915_gem_object_get_pages_gtt(struct drm_i915_gem_object *obj)
 	if (st == NULL)
 		return -ENOMEM;
 
+	start_ns = ktime_get_raw_ns();
+	batch = clamp_t(int, dev_priv->mm.pages_batch, 1, I915_GEM_PAGE_BATCH);
+
 	page_count = obj->base.size / PAGE_SIZE;
 	if (sg_alloc_table(st, page_count, GFP_KERNEL)) {
 		kfree(st);
@@ -2403,45 +2566,52 @@ i915_gem_object_get_pages_gtt(struct drm_i915_gem_object *obj)
 	VM_OBJECT_LOCK(vm_obj);
 	sg = st->sgl;
 	st->nents = 0;
-	for (i = 0; i < page_count; i++) {
-		page = shmem_read_mapping_page(vm_obj, i);
-		if (IS_ERR(page)) {
+	for (i = 0; i < page_count; i += n) {
+		/* Pull the pages in by runs rather than one lookup each */
+		n = min(page_count - i, batch);
+		n = shmem_read_mapping_pages(vm_obj, i, pages, n);
+		if (n < 0) {
 			i915_gem_shrink(dev_priv,
 					page_count,
 					I915_SHRINK_BOUND |
 					I915_SHRINK_UNBOUND |
 					I915_SHRINK_PURGEABLE);
-			page = shmem_read_mapping_page(vm_obj, i);
+			n = shmem_read_mapping_pages(vm_obj, i, pages, 1);
 		}
-		if (IS_ERR(page)) {
+		if (n < 0) {
 			/* We've tried hard to allocate the memory by reaping
 			 * our own buffer, now let the real VM do its job and
 			 * go down in flames if truly OOM.
 			 */
 			i915_gem_shrink_all(dev_priv);
-			page = shmem_read_mapping_page(vm_obj, i);
-			if (IS_ERR(page)) {
-				ret = PTR_ERR(page);
+			n = shmem_read_mapping_pages(vm_obj, i, pages, 1);
+			if (n < 0) {
+				ret = n;
 				goto err_pages;
 			}
 		}
+
+		for (j = 0; j < n; j++) {
+			page = pages[j];
 #ifdef CONFIG_SWIOTLB
-		if (swiotlb_nr_tbl()) {
-			st->nents++;
-			sg_set_page(sg, page, PAGE_SIZE, 0);
-			sg = sg_next(sg);
-			continue;
-		}
-#endif
-		if (!i || page_to_pfn(page) != last_pfn + 1) {
-			if (i)
+			if (swiotlb_nr_tbl()) {
+				st->nents++;
+				sg_set_page(sg, page, PAGE_SIZE, 0);
 				sg = sg_next(sg);
-			st->nents++;
-			sg_set_page(sg, page, PAGE_SIZE, 0);
-		} else {
-			sg->length += PAGE_SIZE;
+				continue;
+			}
+#endif
+			/* Coalesce physically contiguous pages as they arrive */
+			if (!(i + j) || page_to_pfn(page) != last_pfn + 1) {
+				if (i + j)
+					sg = sg_next(sg);
+				st->nents++;
+				sg_set_page(sg, page, PAGE_SIZE, 0);
+			} else {
+				sg->length += PAGE_SIZE;
+			}
+			last_pfn = page_to_pfn(page);
 		}
-		last_pfn = page_to_pfn(page);
 
 		/* Check that the i965g/gm workaround works. */
 	}
@@ -2452,6 +2622,10 @@ i915_gem_object_get_pages_gtt(struct drm_i915_gem_object *obj)
 	obj->pages = st;
 	VM_OBJECT_UNLOCK(vm_obj);
 
+	dev_priv->mm.pages_calls++;
+	dev_priv->mm.pages_count += page_count;
+	dev_priv->mm.pages_ns += ktime_get_raw_ns() - start_ns;
+
 	ret = i915_gem_gtt_prepare_object(obj);
 	if (ret)
 		goto err_pages;
@@ -2857,7 +3031,7 @@ void i915_gem_request_free(struct kref *req_ref)
 		i915_gem_context_unreference(ctx);
 	}
 
-	kfree(req);
+	kmem_cache_free(req->i915->requests, req);
 }
 
 static inline int
@@ -2883,7 +3057,7 @@ __i915_gem_request_alloc(struct intel_engine_cs *engine,
 	if (ret)
 		return ret;
 
-	req = kzalloc(sizeof(*req), GFP_KERNEL);
+	req = kmem_cache_zalloc(dev_priv->requests, GFP_KERNEL);
 	if (req == NULL)
 		return -ENOMEM;
 
@@ -2933,7 +3107,7 @@ __i915_gem_request_alloc(struct intel_engine_cs *engine,
 	return 0;
 
 err:
-	kfree(req);
+	kmem_cache_free(dev_priv->requests, req);
 	return ret;
 }
 
@@ -3021,12 +3195,7 @@ static void i915_gem_reset_engine_cleanup(struct drm_i915_private *dev_priv,
 		/* Ensure irq handler finishes or is cancelled. */
 		tasklet_kill(&engine->irq_tasklet);
 
-		spin_lock_bh(&engine->execlist_lock);
-		/* list_splice_tail_init checks for empty lists */
-		list_splice_tail_init(&engine->execlist_queue,
-				      &engine->execlist_retired_req_list);
-		spin_unlock_bh(&engine->execlist_lock);
-
+		intel_execlists_cancel_requests(engine);
 		intel_execlists_retire_requests(engine);
 	}
 
@@ -3149,7 +3318,8 @@ i915_gem_retire_requests(struct drm_device *dev)
 		idle &= list_empty(&engine->request_list);
 		if (i915.enable_execlists) {
 			spin_lock_bh(&engine->execlist_lock);
-			idle &= list_empty(&engine->execlist_queue);
+			idle &= list_empty(&engine->execlist_queue) &&
+				engine->execlist_prio_mask == 0;
 			spin_unlock_bh(&engine->execlist_lock);
 
 			intel_execlists_retire_requests(engine);
@@ -3203,7 +3373,8 @@ i915_gem_idle_work_handler(struct work_struct *work)
 
 	if (mutex_trylock(&dev->struct_mutex)) {
 		for_each_engine(engine, dev_priv)
-			i915_gem_batch_pool_fini(&engine->batch_pool);
+			i915_gem_batch_pool_trim(&engine->batch_pool,
+						 engine->batch_pool.low);
 
 		mutex_unlock(&dev->struct_mutex);
 	}
@@ -3510,6 +3681,13 @@ static int __i915_vma_unbind(struct i915_vma *vma, bool wait)
 		ret = i915_gem_object_put_fence(obj);
 		if (ret)
 			return ret;
+	} else if (vma->is_ggtt &&
+		   vma->ggtt_view.type == I915_GGTT_VIEW_PARTIAL &&
+		   obj->fault_mappable) {
+		/* Revoke just the window that was faulted in through us */
+		i915_gem_release_mmap_range(obj,
+					    vma->ggtt_view.params.partial.offset,
+					    vma->ggtt_view.params.partial.size);
 	}
 
 	trace_i915_vma_unbind(vma);
@@ -3736,6 +3914,13 @@ i915_gem_object_bind_to_vm(struct drm_i915_gem_object *obj,
 		if (ret)
 			goto err_free_vma;
 	} else {
+		/*
+		 * Prefer a 2M aligned slot if that lets part of the object
+		 * be mapped with 2M pages, but never evict just to get one.
+		 */
+		bool huge = alignment < I915_GTT_PAGE_SIZE_2M &&
+			    i915_ppgtt_can_map_huge(vm, obj);
+
 		if (flags & PIN_HIGH) {
 			search_flag = DRM_MM_SEARCH_BELOW;
 			alloc_flag = DRM_MM_CREATE_TOP;
@@ -3746,11 +3931,17 @@ i915_gem_object_bind_to_vm(struct drm_i915_gem_object *obj,
 
 search_free:
 		ret = drm_mm_insert_node_in_range_generic(&vm->mm, &vma->node,
-							  size, alignment,
+							  size,
+							  huge ? I915_GTT_PAGE_SIZE_2M :
+								 alignment,
 							  obj->cache_level,
 							  start, end,
 							  search_flag,
 							  alloc_flag);
+		if (ret && huge) {
+			huge = false;
+			goto search_free;
+		}
 		if (ret) {
 			ret = i915_gem_evict_something(dev, vm, size, alignment,
 						       obj->cache_level,
@@ -4345,8 +4536,14 @@ i915_vma_misplaced(struct i915_vma *vma, uint32_t alignment, uint64_t flags)
 	    vma->node.start & (alignment - 1))
 		return true;
 
-	if (flags & PIN_MAPPABLE && !obj->map_and_fenceable)
-		return true;
+	/* Only the normal view tracks mappability in the object */
+	if (flags & PIN_MAPPABLE) {
+		if (vma->ggtt_view.type == I915_GGTT_VIEW_NORMAL ?
+		    !obj->map_and_fenceable :
+		    vma->node.start + vma->node.size >
+		    to_i915(obj->base.dev)->ggtt.mappable_end)
+			return true;
+	}
 
 	if (flags & PIN_OFFSET_BIAS &&
 	    vma->node.start < (flags & PIN_OFFSET_MASK))
@@ -4713,7 +4910,8 @@ static bool discard_backing_storage(struct drm_i915_gem_object *obj)
 #if 0
 	return atomic_long_read(&obj->base.filp->f_count) == 1;
 #else
-	return false;
+	/* Every CPU mmap takes a reference on the backing VM object */
+	return obj->base.vm_obj->ref_count == 1;
 #endif
 }
 
@@ -4825,7 +5023,7 @@ void i915_gem_vma_destroy(struct i915_vma *vma)
 
 	list_del(&vma->obj_link);
 
-	kfree(vma);
+	kmem_cache_free(to_i915(vma->obj->base.dev)->vmas, vma);
 }
 
 static void
@@ -5228,12 +5426,250 @@ i915_gem_load_init_fences(struct drm_i915_private *dev_priv)
 	i915_gem_detect_bit_6_swizzle(dev);
 }
 
+static int
+i915_gem_fault_sysctl_latency(SYSCTL_HANDLER_ARGS)
+{
+	struct drm_i915_private *dev_priv = arg1;
+	u_long val = 0;
+
+	if (dev_priv->mm.fault_count)
+		val = dev_priv->mm.fault_ns / dev_priv->mm.fault_count;
+
+	return sysctl_handle_long(oidp, &val, 0, req);
+}
+
+static void
+i915_gem_fault_sysctl_init(struct drm_i915_private *dev_priv)
+{
+	struct drm_device *dev = dev_priv->dev;
+	struct sysctl_ctx_list *ctx = &dev_priv->mm.fault_sysctl_ctx;
+	struct sysctl_oid *top;
+
+	sysctl_ctx_init(ctx);
+	if (dev->sysctl == NULL || dev->sysctl->top == NULL)
+		return;
+
+	top = SYSCTL_ADD_NODE(ctx, SYSCTL_CHILDREN(dev->sysctl->top),
+	    OID_AUTO, "gtt_fault", CTLFLAG_RD, NULL, "GTT mmap faults");
+	if (top == NULL)
+		return;
+
+	SYSCTL_ADD_ULONG(ctx, SYSCTL_CHILDREN(top), OID_AUTO, "count",
+	    CTLFLAG_RD, &dev_priv->mm.fault_count,
+	    "Pages faulted in through the aperture");
+	SYSCTL_ADD_ULONG(ctx, SYSCTL_CHILDREN(top), OID_AUTO, "partial",
+	    CTLFLAG_RD, &dev_priv->mm.fault_partial,
+	    "Pages faulted in through partial views");
+	SYSCTL_ADD_ULONG(ctx, SYSCTL_CHILDREN(top), OID_AUTO, "recycled",
+	    CTLFLAG_RD, &dev_priv->mm.fault_recycled,
+	    "Partial views unbound to make room for newer windows");
+	SYSCTL_ADD_PROC(ctx, SYSCTL_CHILDREN(top), OID_AUTO, "avg_ns",
+	    CTLTYPE_ULONG | CTLFLAG_RD, dev_priv, 0,
+	    i915_gem_fault_sysctl_latency, "LU", "Average fault latency");
+}
+
+static int
+i915_gem_pages_sysctl_latency(SYSCTL_HANDLER_ARGS)
+{
+	struct drm_i915_private *dev_priv = arg1;
+	u_long val = 0;
+
+	if (dev_priv->mm.pages_count)
+		val = dev_priv->mm.pages_ns / dev_priv->mm.pages_count;
+
+	return sysctl_handle_long(oidp, &val, 0, req);
+}
+
+static void
+i915_gem_pages_sysctl_init(struct drm_i915_private *dev_priv)
+{
+	struct drm_device *dev = dev_priv->dev;
+	struct sysctl_ctx_list *ctx = &dev_priv->mm.pages_sysctl_ctx;
+	struct sysctl_oid *top;
+
+	sysctl_ctx_init(ctx);
+	if (dev->sysctl == NULL || dev->sysctl->top == NULL)
+		return;
+
+	top = SYSCTL_ADD_NODE(ctx, SYSCTL_CHILDREN(dev->sysctl->top),
+	    OID_AUTO, "get_pages", CTLFLAG_RD, NULL,
+	    "Backing page lookup for shmem objects");
+	if (top == NULL)
+		return;
+
+	SYSCTL_ADD_UINT(ctx, SYSCTL_CHILDREN(top), OID_AUTO, "batch",
+	    CTLFLAG_RW, &dev_priv->mm.pages_batch, 0,
+	    "Pages wired per lookup, 1 looks up each page on its own");
+	SYSCTL_ADD_ULONG(ctx, SYSCTL_CHILDREN(top), OID_AUTO, "calls",
+	    CTLFLAG_RD, &dev_priv->mm.pages_calls,
+	    "Objects whose backing pages were looked up");
+	SYSCTL_ADD_ULONG(ctx, SYSCTL_CHILDREN(top), OID_AUTO, "count",
+	    CTLFLAG_RD, &dev_priv->mm.pages_count,
+	    "Backing pages looked up");
+	SYSCTL_ADD_PROC(ctx, SYSCTL_CHILDREN(top), OID_AUTO, "avg_ns",
+	    CTLTYPE_ULONG | CTLFLAG_RD, dev_priv, 0,
+	    i915_gem_pages_sysctl_latency, "LU",
+	    "Average lookup time per page");
+}
+
+static const char * const i915_engine_sysctl_names[I915_NUM_ENGINES] = {
+	[RCS] = "rcs", [BCS] = "bcs", [VCS] = "vcs",
+	[VCS2] = "vcs2", [VECS] = "vecs",
+};
+
+static void
+i915_gem_wait_sysctl_init(struct drm_i915_private *dev_priv)
+{
+	struct drm_device *dev = dev_priv->dev;
+	struct sysctl_ctx_list *ctx = &dev_priv->mm.wait_sysctl_ctx;
+	struct intel_engine_cs *engine;
+	struct sysctl_oid *top, *oid;
+	int i;
+
+	sysctl_ctx_init(ctx);
+	if (dev->sysctl == NULL || dev->sysctl->top == NULL)
+		return;
+
+	top = SYSCTL_ADD_NODE(ctx, SYSCTL_CHILDREN(dev->sysctl->top),
+	    OID_AUTO, "wait", CTLFLAG_RD, NULL, "GEM request waits");
+	if (top == NULL)
+		return;
+
+	SYSCTL_ADD_UINT(ctx, SYSCTL_CHILDREN(top), OID_AUTO, "spin_ns",
+	    CTLFLAG_RW, &dev_priv->mm.spin_ns, 0,
+	    "Busy-poll a started request this long before sleeping");
+
+	for (i = 0; i < I915_NUM_ENGINES; i++) {
+		if ((INTEL_INFO(dev_priv)->ring_mask & (1 << i)) == 0)
+			continue;
+
+		engine = &dev_priv->engine[i];
+		oid = SYSCTL_ADD_NODE(ctx, SYSCTL_CHILDREN(top), OID_AUTO,
+		    i915_engine_sysctl_names[i], CTLFLAG_RD, NULL, NULL);
+		if (oid == NULL)
+			continue;
+
+		SYSCTL_ADD_ULONG(ctx, SYSCTL_CHILDREN(oid), OID_AUTO,
+		    "spin_hits", CTLFLAG_RD, &engine->spin_hits,
+		    "Waits that completed while spinning");
+		SYSCTL_ADD_ULONG(ctx, SYSCTL_CHILDREN(oid), OID_AUTO,
+		    "spin_misses", CTLFLAG_RD, &engine->spin_misses,
+		    "Waits that spun and then had to sleep");
+	}
+}
+
+static void
+i915_gem_batch_pool_sysctl(struct drm_i915_private *dev_priv)
+{
+	struct drm_device *dev = dev_priv->dev;
+	struct sysctl_ctx_list *ctx = &dev_priv->mm.pool_sysctl_ctx;
+	struct sysctl_oid *top;
+	int i;
+
+	sysctl_ctx_init(ctx);
+	if (dev->sysctl == NULL || dev->sysctl->top == NULL)
+		return;
+
+	top = SYSCTL_ADD_NODE(ctx, SYSCTL_CHILDREN(dev->sysctl->top),
+	    OID_AUTO, "batch_pool", CTLFLAG_RD, NULL,
+	    "Command parser shadow batch pools");
+	if (top == NULL)
+		return;
+
+	for (i = 0; i < I915_NUM_ENGINES; i++) {
+		if ((INTEL_INFO(dev_priv)->ring_mask & (1 << i)) == 0)
+			continue;
+
+		i915_gem_batch_pool_sysctl_init(&dev_priv->engine[i].batch_pool,
+						ctx, top,
+						i915_engine_sysctl_names[i]);
+	}
+}
+
+/*
+ * Self-checks of internal algorithms against mock state.  Writing a non-zero
+ * value to hw.dri.N.selftest.<name> runs the check; the write fails if it
+ * does, with details in the kernel log.
+ */
+static const struct i915_selftest {
+	const char *name;
+	int (*func)(struct drm_i915_private *dev_priv);
+	const char *descr;
+} i915_selftests[] = {
+	{ "execlists", intel_execlists_selftest,
+	  "Check the execlists submission queue order" },
+	{ "spin", i915_spin_selftest,
+	  "Check the request spin against a fake seqno source" },
+	{ "batch_pool", i915_gem_batch_pool_selftest,
+	  "Replay a recorded size trace through a batch pool" },
+};
+
+static int
+i915_gem_selftest_sysctl(SYSCTL_HANDLER_ARGS)
+{
+	struct drm_i915_private *dev_priv = arg1;
+	int val = 0;
+	int error;
+
+	error = sysctl_handle_int(oidp, &val, 0, req);
+	if (error || req->newptr == NULL || val == 0)
+		return error;
+
+	return -i915_selftests[arg2].func(dev_priv);
+}
+
+static void
+i915_gem_selftest_sysctl_init(struct drm_i915_private *dev_priv)
+{
+	struct drm_device *dev = dev_priv->dev;
+	struct sysctl_ctx_list *ctx = &dev_priv->mm.selftest_sysctl_ctx;
+	struct sysctl_oid *top;
+	int i;
+
+	sysctl_ctx_init(ctx);
+	if (dev->sysctl == NULL || dev->sysctl->top == NULL)
+		return;
+
+	top = SYSCTL_ADD_NODE(ctx, SYSCTL_CHILDREN(dev->sysctl->top),
+	    OID_AUTO, "selftest", CTLFLAG_RD, NULL, "Internal self-checks");
+	if (top == NULL)
+		return;
+
+	for (i = 0; i < ARRAY_SIZE(i915_selftests); i++)
+		SYSCTL_ADD_PROC(ctx, SYSCTL_CHILDREN(top), OID_AUTO,
+		    i915_selftests[i].name, CTLTYPE_INT | CTLFLAG_RW,
+		    dev_priv, i, i915_gem_selftest_sysctl, "I",
+		    i915_selftests[i].descr);
+}
+
 void
 i915_gem_load_init(struct drm_device *dev)
 {
 	struct drm_i915_private *dev_priv = dev->dev_private;
+	int unit = device_get_unit(dev->dev->bsddev);
+	char name[32];
 	int i;
 
+	/* The names key hw.dri.slab, so keep them unique per device */
+	ksnprintf(name, sizeof(name), "i915_gem_object_%d", unit);
+	dev_priv->objects =
+		kmem_cache_create(name,
+				  sizeof(struct drm_i915_gem_object), 0,
+				  SLAB_HWCACHE_ALIGN,
+				  NULL);
+	ksnprintf(name, sizeof(name), "i915_gem_vma_%d", unit);
+	dev_priv->vmas =
+		kmem_cache_create(name,
+				  sizeof(struct i915_vma), 0,
+				  SLAB_HWCACHE_ALIGN,
+				  NULL);
+	ksnprintf(name, sizeof(name), "i915_gem_request_%d", unit);
+	dev_priv->requests =
+		kmem_cache_create(name,
+				  sizeof(struct drm_i915_gem_request), 0,
+				  SLAB_HWCACHE_ALIGN,
+				  NULL);
+
 	INIT_LIST_HEAD(&dev_priv->vm_list);
 	INIT_LIST_HEAD(&dev_priv->context_list);
 	INIT_LIST_HEAD(&dev_priv->mm.unbound_list);
@@ -5266,17 +5702,32 @@ i915_gem_load_init(struct drm_device *dev)
 	dev_priv->mm.interruptible = true;
 
 	lockinit(&dev_priv->fb_tracking.lock, "drmftl", 0, LK_CANRECURSE);
+
+	/* About the cost of sleeping and being woken up again */
+	dev_priv->mm.spin_ns = 5000;
+
+	dev_priv->mm.pages_batch = I915_GEM_PAGE_BATCH;
+
+	i915_gem_fault_sysctl_init(dev_priv);
+	i915_gem_pages_sysctl_init(dev_priv);
+	i915_gem_wait_sysctl_init(dev_priv);
+	i915_gem_batch_pool_sysctl(dev_priv);
+	i915_gem_selftest_sysctl_init(dev_priv);
 }
 
 void i915_gem_load_cleanup(struct drm_device *dev)
 {
-#if 0
 	struct drm_i915_private *dev_priv = to_i915(dev);
 
+	sysctl_ctx_free(&dev_priv->mm.selftest_sysctl_ctx);
+	sysctl_ctx_free(&dev_priv->mm.pool_sysctl_ctx);
+	sysctl_ctx_free(&dev_priv->mm.wait_sysctl_ctx);
+	sysctl_ctx_free(&dev_priv->mm.pages_sysctl_ctx);
+	sysctl_ctx_free(&dev_priv->mm.fault_sysctl_ctx);
+
 	kmem_cache_destroy(dev_priv->requests);
 	kmem_cache_destroy(dev_priv->vmas);
 	kmem_cache_destroy(dev_priv->objects);
-#endif
 }
 
 void i915_gem_release(struct drm_device *dev, struct drm_file *file)
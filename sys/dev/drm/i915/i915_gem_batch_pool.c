@@ -39,6 +39,41 @@
  * extended to support other uses cases should they arise.
  */
 
+/*
+ * Objects are kept in size classes spaced at powers of two and 1.5 times
+ * powers of two.  Everything in a class is allocated at the class size, so
+ * any idle object of the class fits and a lookup only has to look at the
+ * oldest entry.  Larger requests share the last class and are allocated
+ * at their exact size.
+ */
+static const unsigned int batch_pool_class_pages[] = {
+	1, 2, 3, 4, 6, 8, 12, 16, 24, 32, 48, 64
+};
+
+static int batch_pool_class(size_t size)
+{
+	size_t pages = size >> PAGE_SHIFT;
+	int n;
+
+	BUILD_BUG_ON(ARRAY_SIZE(batch_pool_class_pages) + 1 !=
+		     I915_BATCH_POOL_CLASSES);
+
+	for (n = 0; n < ARRAY_SIZE(batch_pool_class_pages); n++) {
+		if (pages <= batch_pool_class_pages[n])
+			break;
+	}
+
+	return n;
+}
+
+static void batch_pool_release(struct i915_gem_batch_pool *pool,
+			       struct drm_i915_gem_object *obj)
+{
+	pool->size -= obj->base.size;
+	list_del(&obj->batch_pool_link);
+	drm_gem_object_unreference(&obj->base);
+}
+
 /**
  * i915_gem_batch_pool_init() - initialize a batch buffer pool
  * @dev: the drm device
@@ -50,6 +85,9 @@ void i915_gem_batch_pool_init(struct drm_device *dev,
 	int n;
 
 	pool->dev = dev;
+	pool->size = 0;
+	pool->high = 8 * 1024 * 1024;
+	pool->low = 1024 * 1024;
 
 	for (n = 0; n < ARRAY_SIZE(pool->cache_list); n++)
 		INIT_LIST_HEAD(&pool->cache_list[n]);
@@ -74,8 +112,73 @@ void i915_gem_batch_pool_fini(struct i915_gem_batch_pool *pool)
 						 struct drm_i915_gem_object,
 						 batch_pool_link);
 
-			list_del(&obj->batch_pool_link);
-			drm_gem_object_unreference(&obj->base);
+			batch_pool_release(pool, obj);
+		}
+	}
+}
+
+/**
+ * i915_gem_batch_pool_trim() - shrink a batch buffer pool
+ * @pool: the batch buffer pool
+ * @target: number of bytes the pool may keep
+ *
+ * Releases idle buffers, least recently used first within each size class
+ * and largest classes first, until the pool holds no more than @target
+ * bytes or only busy buffers are left.
+ *
+ * Note: Callers must hold the struct_mutex.
+ */
+void i915_gem_batch_pool_trim(struct i915_gem_batch_pool *pool,
+			      u_long target)
+{
+	struct drm_i915_gem_object *obj, *next;
+	int n;
+
+	WARN_ON(!mutex_is_locked(&pool->dev->struct_mutex));
+
+	for (n = ARRAY_SIZE(pool->cache_list) - 1; n >= 0; n--) {
+		list_for_each_entry_safe(obj, next, &pool->cache_list[n],
+					 batch_pool_link) {
+			if (pool->size <= target)
+				return;
+
+			/* The batches are strictly LRU ordered */
+			if (obj->active)
+				break;
+
+			/* Still being filled in by the command parser */
+			if (obj->pages_pin_count)
+				continue;
+
+			batch_pool_release(pool, obj);
+			pool->evictions++;
+		}
+	}
+}
+
+/*
+ * Hand busy buffers over to the requests still using them until the pool
+ * holds no more than @target bytes.  An active object is kept alive by its
+ * request and freed once that retires.  Only buffers still being filled in
+ * by the command parser stay behind.
+ */
+static void batch_pool_drop_busy(struct i915_gem_batch_pool *pool,
+				 u_long target)
+{
+	struct drm_i915_gem_object *obj, *next;
+	int n;
+
+	for (n = ARRAY_SIZE(pool->cache_list) - 1; n >= 0; n--) {
+		list_for_each_entry_safe(obj, next, &pool->cache_list[n],
+					 batch_pool_link) {
+			if (pool->size <= target)
+				return;
+
+			if (obj->pages_pin_count)
+				continue;
+
+			batch_pool_release(pool, obj);
+			pool->dropped++;
 		}
 	}
 }
@@ -89,6 +192,10 @@ void i915_gem_batch_pool_fini(struct i915_gem_batch_pool *pool)
  * with the pages pinned. The caller must i915_gem_object_unpin_pages()
  * on the returned object.
  *
+ * The pool never caches more than its high mark, plus buffers larger than
+ * that or still pinned by the command parser: when trimming idle buffers
+ * is not enough, busy ones are released to their requests.
+ *
  * Note: Callers must hold the struct_mutex
  *
  * Return: the buffer object or an error pointer
@@ -104,13 +211,8 @@ i915_gem_batch_pool_get(struct i915_gem_batch_pool *pool,
 
 	WARN_ON(!mutex_is_locked(&pool->dev->struct_mutex));
 
-	/* Compute a power-of-two bucket, but throw everything greater than
-	 * 16KiB into the same bucket: i.e. the the buckets hold objects of
-	 * (1 page, 2 pages, 4 pages, 8+ pages).
-	 */
-	n = fls(size >> PAGE_SHIFT) - 1;
-	if (n >= ARRAY_SIZE(pool->cache_list))
-		n = ARRAY_SIZE(pool->cache_list) - 1;
+	size = PAGE_ALIGN(size);
+	n = batch_pool_class(size);
 	list = &pool->cache_list[n];
 
 	list_for_each_entry_safe(tmp, next, list, batch_pool_link) {
@@ -120,8 +222,7 @@ i915_gem_batch_pool_get(struct i915_gem_batch_pool *pool,
 
 		/* While we're looping, do some clean up */
 		if (tmp->madv == __I915_MADV_PURGED) {
-			list_del(&tmp->batch_pool_link);
-			drm_gem_object_unreference(&tmp->base);
+			batch_pool_release(pool, tmp);
 			continue;
 		}
 
@@ -134,18 +235,221 @@ i915_gem_batch_pool_get(struct i915_gem_batch_pool *pool,
 	if (obj == NULL) {
 		int ret;
 
+		pool->misses++;
+
+		if (n < ARRAY_SIZE(batch_pool_class_pages))
+			size = (size_t)batch_pool_class_pages[n] << PAGE_SHIFT;
+
+		if (pool->size + size > pool->high) {
+			i915_gem_batch_pool_trim(pool, pool->low);
+
+			/* Everything left is busy, stop caching it */
+			if (pool->size + size > pool->high)
+				batch_pool_drop_busy(pool, pool->high > size ?
+						     pool->high - size : 0);
+		}
+
 		obj = i915_gem_alloc_object(pool->dev, size);
 		if (obj == NULL)
 			return ERR_PTR(-ENOMEM);
 
 		ret = i915_gem_object_get_pages(obj);
-		if (ret)
+		if (ret) {
+			drm_gem_object_unreference(&obj->base);
 			return ERR_PTR(ret);
+		}
 
 		obj->madv = I915_MADV_DONTNEED;
+		pool->size += obj->base.size;
+	} else {
+		pool->hits++;
 	}
 
 	list_move_tail(&obj->batch_pool_link, list);
 	i915_gem_object_pin_pages(obj);
 	return obj;
 }
+
+/*
+ * Shadow batch sizes, in pages, recorded from the command parser on a
+ * desktop session: mostly single page batches with the odd large one.
+ */
+static const unsigned int batch_pool_test_trace[] = {
+	1, 2, 1, 4, 1, 16, 2, 1, 3, 1, 64, 1, 8, 1, 2, 64, 1, 32, 1, 4,
+};
+
+#define BATCH_POOL_TEST_HIGH	(1024 * 1024)
+#define BATCH_POOL_TEST_LOW	(256 * 1024)
+#define BATCH_POOL_TEST_BUSY	(2 * ARRAY_SIZE(batch_pool_test_trace))
+
+/*
+ * Replay batch_pool_test_trace through a private pool.  While every buffer
+ * goes idle straight away a second pass must be served entirely from the
+ * pool.  While every buffer stays busy, as if still executing, the pool must
+ * still never cache more than its high mark.
+ */
+static int batch_pool_test_run(struct i915_gem_batch_pool *pool,
+			       struct drm_i915_gem_object **busy)
+{
+	struct drm_i915_gem_object *obj;
+	u_long misses;
+	int pass, i, n;
+
+	for (pass = 0; pass < 2; pass++) {
+		misses = pool->misses;
+		for (i = 0; i < ARRAY_SIZE(batch_pool_test_trace); i++) {
+			obj = i915_gem_batch_pool_get(pool,
+			    batch_pool_test_trace[i] << PAGE_SHIFT);
+			if (IS_ERR(obj))
+				return PTR_ERR(obj);
+			i915_gem_object_unpin_pages(obj);
+
+			if (pool->size > pool->high) {
+				DRM_ERROR("batch pool selftest: idle pool holds %lu bytes\n",
+					  pool->size);
+				return -EINVAL;
+			}
+		}
+	}
+	if (pool->misses != misses) {
+		DRM_ERROR("batch pool selftest: %lu misses replaying an idle trace\n",
+			  pool->misses - misses);
+		return -EINVAL;
+	}
+
+	/* Hold a reference for the pretend request, as move_to_active does */
+	n = 0;
+	for (pass = 0; pass < 2; pass++) {
+		for (i = 0; i < ARRAY_SIZE(batch_pool_test_trace); i++) {
+			obj = i915_gem_batch_pool_get(pool,
+			    batch_pool_test_trace[i] << PAGE_SHIFT);
+			if (IS_ERR(obj))
+				return PTR_ERR(obj);
+			i915_gem_object_unpin_pages(obj);
+
+			drm_gem_object_reference(&obj->base);
+			obj->active = 1;
+			busy[n++] = obj;
+
+			if (pool->size > pool->high) {
+				DRM_ERROR("batch pool selftest: busy pool holds %lu bytes\n",
+					  pool->size);
+				return -EINVAL;
+			}
+		}
+	}
+	if (pool->dropped == 0) {
+		DRM_ERROR("batch pool selftest: busy trace never hit the high mark\n");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/**
+ * i915_gem_batch_pool_selftest() - replay a recorded allocation trace
+ * @dev_priv: i915 device
+ *
+ * Return: 0 if the pool behaved, a negative errno otherwise.
+ */
+int i915_gem_batch_pool_selftest(struct drm_i915_private *dev_priv)
+{
+	struct drm_device *dev = dev_priv->dev;
+	struct drm_i915_gem_object **busy;
+	struct i915_gem_batch_pool pool;
+	int i, ret;
+
+	busy = kcalloc(BATCH_POOL_TEST_BUSY, sizeof(*busy), GFP_KERNEL);
+	if (busy == NULL)
+		return -ENOMEM;
+
+	memset(&pool, 0, sizeof(pool));
+	i915_gem_batch_pool_init(dev, &pool);
+	pool.high = BATCH_POOL_TEST_HIGH;
+	pool.low = BATCH_POOL_TEST_LOW;
+
+	mutex_lock(&dev->struct_mutex);
+	ret = batch_pool_test_run(&pool, busy);
+
+	/* Retire the pretend requests */
+	for (i = 0; i < BATCH_POOL_TEST_BUSY && busy[i]; i++) {
+		busy[i]->active = 0;
+		drm_gem_object_unreference(&busy[i]->base);
+	}
+	i915_gem_batch_pool_fini(&pool);
+	mutex_unlock(&dev->struct_mutex);
+
+	if (ret == 0)
+		DRM_INFO("batch pool selftest passed, %lu hits %lu misses %lu dropped\n",
+			 pool.hits, pool.misses, pool.dropped);
+	kfree(busy);
+	return ret;
+}
+
+/*
+ * hw.dri.N.batch_pool.<engine>.{high,low}; arg2 selects high.  A low mark
+ * above the high mark is rejected.
+ */
+static int
+batch_pool_sysctl_limit(SYSCTL_HANDLER_ARGS)
+{
+	struct i915_gem_batch_pool *pool = arg1;
+	struct drm_device *dev = pool->dev;
+	u_long val;
+	int error;
+
+	val = arg2 ? pool->high : pool->low;
+	error = sysctl_handle_long(oidp, &val, 0, req);
+	if (error || req->newptr == NULL)
+		return error;
+
+	mutex_lock(&dev->struct_mutex);
+	if (arg2 ? val < pool->low : val > pool->high) {
+		error = EINVAL;
+	} else if (arg2) {
+		pool->high = val;
+	} else {
+		pool->low = val;
+	}
+	mutex_unlock(&dev->struct_mutex);
+
+	return error;
+}
+
+/**
+ * i915_gem_batch_pool_sysctl_init() - export batch pool statistics
+ * @pool: the batch buffer pool
+ * @ctx: sysctl context owning the new nodes
+ * @parent: node to attach the pool's node to
+ * @name: name of the pool's node
+ */
+void i915_gem_batch_pool_sysctl_init(struct i915_gem_batch_pool *pool,
+				     struct sysctl_ctx_list *ctx,
+				     struct sysctl_oid *parent,
+				     const char *name)
+{
+	struct sysctl_oid *oid;
+
+	oid = SYSCTL_ADD_NODE(ctx, SYSCTL_CHILDREN(parent), OID_AUTO,
+	    name, CTLFLAG_RD, NULL, NULL);
+	if (oid == NULL)
+		return;
+
+	SYSCTL_ADD_ULONG(ctx, SYSCTL_CHILDREN(oid), OID_AUTO, "hits",
+	    CTLFLAG_RD, &pool->hits, "Requests served from the pool");
+	SYSCTL_ADD_ULONG(ctx, SYSCTL_CHILDREN(oid), OID_AUTO, "misses",
+	    CTLFLAG_RD, &pool->misses, "Requests that allocated a new buffer");
+	SYSCTL_ADD_ULONG(ctx, SYSCTL_CHILDREN(oid), OID_AUTO, "evictions",
+	    CTLFLAG_RD, &pool->evictions, "Idle buffers released by trimming");
+	SYSCTL_ADD_ULONG(ctx, SYSCTL_CHILDREN(oid), OID_AUTO, "size",
+	    CTLFLAG_RD, &pool->size, "Bytes held by the pool");
+	SYSCTL_ADD_ULONG(ctx, SYSCTL_CHILDREN(oid), OID_AUTO, "dropped",
+	    CTLFLAG_RD, &pool->dropped,
+	    "Busy buffers released to stay under the high mark");
+	SYSCTL_ADD_PROC(ctx, SYSCTL_CHILDREN(oid), OID_AUTO, "high",
+	    CTLTYPE_ULONG | CTLFLAG_RW, pool, 1, batch_pool_sysctl_limit,
+	    "LU", "Most bytes the pool caches");
+	SYSCTL_ADD_PROC(ctx, SYSCTL_CHILDREN(oid), OID_AUTO, "low",
+	    CTLTYPE_ULONG | CTLFLAG_RW, pool, 0, batch_pool_sysctl_limit,
+	    "LU", "Bytes kept when trimming or idle");
+}
@@ -27,16 +27,35 @@
 
 #include "i915_drv.h"
 
+/* 12 size classes from 1 to 64 pages, plus one for anything larger */
+#define I915_BATCH_POOL_CLASSES	13
+
 struct i915_gem_batch_pool {
 	struct drm_device *dev;
-	struct list_head cache_list[4];
+	struct list_head cache_list[I915_BATCH_POOL_CLASSES];
+	u_long size;		/* bytes of objects held by the pool */
+	u_long high;		/* most bytes cached, trim down to low past it */
+	u_long low;		/* kept across idle periods */
+	u_long hits;
+	u_long misses;
+	u_long evictions;
+	u_long dropped;
 };
 
+struct drm_i915_private;
+
 /* i915_gem_batch_pool.c */
 void i915_gem_batch_pool_init(struct drm_device *dev,
 			      struct i915_gem_batch_pool *pool);
 void i915_gem_batch_pool_fini(struct i915_gem_batch_pool *pool);
+void i915_gem_batch_pool_trim(struct i915_gem_batch_pool *pool,
+			      u_long target);
 struct drm_i915_gem_object*
 i915_gem_batch_pool_get(struct i915_gem_batch_pool *pool, size_t size);
+int i915_gem_batch_pool_selftest(struct drm_i915_private *dev_priv);
+void i915_gem_batch_pool_sysctl_init(struct i915_gem_batch_pool *pool,
+				     struct sysctl_ctx_list *ctx,
+				     struct sysctl_oid *parent,
+				     const char *name);
 
 #endif /* I915_GEM_BATCH_POOL_H */
@@ -943,6 +943,9 @@ int i915_gem_context_getparam_ioctl(struct drm_device *dev, void *data,
 	case I915_CONTEXT_PARAM_NO_ZEROMAP:
 		args->value = ctx->flags & CONTEXT_NO_ZEROMAP;
 		break;
+	case I915_CONTEXT_PARAM_PRIORITY:
+		args->value = ctx->priority;
+		break;
 	case I915_CONTEXT_PARAM_GTT_SIZE:
 		if (ctx->ppgtt)
 			args->value = ctx->ppgtt->base.total;
@@ -996,6 +999,20 @@ int i915_gem_context_setparam_ioctl(struct drm_device *dev, void *data,
 			ctx->flags |= args->value ? CONTEXT_NO_ZEROMAP : 0;
 		}
 		break;
+	case I915_CONTEXT_PARAM_PRIORITY:
+		if (args->size)
+			ret = -EINVAL;
+		else if ((s64)args->value > I915_CONTEXT_MAX_USER_PRIORITY ||
+			 (s64)args->value < I915_CONTEXT_MIN_USER_PRIORITY)
+			ret = -EINVAL;
+		else if ((s64)args->value > I915_CONTEXT_DEFAULT_PRIORITY &&
+			 !capable(CAP_SYS_ADMIN))
+			ret = -EPERM;
+		else if (!i915.enable_execlists)
+			ret = -ENODEV;
+		else
+			ctx->priority = args->value;
+		break;
 	default:
 		ret = -EINVAL;
 		break;
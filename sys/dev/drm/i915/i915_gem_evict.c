@@ -46,6 +46,106 @@ mark_free(struct i915_vma *vma, struct list_head *unwind)
 	return drm_mm_scan_add_block(&vma->node);
 }
 
+static bool
+evict_vma_in_range(struct i915_vma *vma, unsigned long start, unsigned long end)
+{
+	return vma != NULL && drm_mm_node_allocated(&vma->node) &&
+		vma->node.start < end &&
+		vma->node.start + vma->node.size > start;
+}
+
+static void
+evict_wait_for(struct drm_i915_gem_request **wait,
+	       struct drm_i915_gem_request *req)
+{
+	if (req == NULL || i915_gem_request_completed(req, true))
+		return;
+
+	if (*wait == NULL || i915_seqno_passed(req->seqno, (*wait)->seqno))
+		*wait = req;
+}
+
+/* Newest request of @ctx still on the request list of @engine. */
+static struct drm_i915_gem_request *
+evict_last_ctx_request(struct intel_engine_cs *engine,
+		       struct intel_context *ctx)
+{
+	struct drm_i915_gem_request *req;
+
+	list_for_each_entry_reverse(req, &engine->request_list, list) {
+		if (req->ctx == ctx)
+			return req;
+	}
+
+	return NULL;
+}
+
+/*
+ * Wait for the requests holding pins on vmas of @vm within [@start, @end).
+ * Those are pinned vmas that are still active, and with execlists the logical
+ * ring context images and ringbuffers in the GGTT, which stay pinned until
+ * every request of their context on that engine has retired.  Only the
+ * engines running such a context are waited upon; the kernel context is
+ * pinned for good and is skipped.  Returns -ENOENT if there was nothing to
+ * wait for.
+ */
+static int
+evict_wait_pinned(struct drm_i915_private *dev_priv,
+		  struct i915_address_space *vm,
+		  unsigned long start, unsigned long end)
+{
+	struct drm_i915_gem_request *wait[I915_NUM_ENGINES] = { NULL };
+	struct intel_engine_cs *engine;
+	struct intel_context *ctx;
+	struct i915_vma *vma;
+	int ret = -ENOENT;
+	int i;
+
+	if (i915.enable_execlists && i915_is_ggtt(vm)) {
+		list_for_each_entry(ctx, &dev_priv->context_list, link) {
+			if (ctx == dev_priv->kernel_context)
+				continue;
+
+			for_each_engine(engine, dev_priv) {
+				struct intel_ringbuffer *ringbuf;
+
+				i = engine->id;
+				if (ctx->engine[i].pin_count == 0)
+					continue;
+
+				ringbuf = ctx->engine[i].ringbuf;
+				if (!evict_vma_in_range(ctx->engine[i].lrc_vma,
+							start, end) &&
+				    !evict_vma_in_range(ringbuf ? ringbuf->vma : NULL,
+							start, end))
+					continue;
+
+				evict_wait_for(&wait[i],
+					       evict_last_ctx_request(engine, ctx));
+			}
+		}
+	}
+
+	list_for_each_entry(vma, &vm->active_list, vm_link) {
+		if (!vma->pin_count || !evict_vma_in_range(vma, start, end))
+			continue;
+
+		for (i = 0; i < I915_NUM_ENGINES; i++)
+			evict_wait_for(&wait[i], vma->obj->last_read_req[i]);
+	}
+
+	for (i = 0; i < I915_NUM_ENGINES; i++) {
+		if (wait[i] == NULL)
+			continue;
+
+		ret = i915_wait_request(wait[i]);
+		if (ret)
+			return ret;
+	}
+
+	return ret;
+}
+
 /**
  * i915_gem_evict_something - Evict vmas to make room for binding a new one
  * @dev: drm_device
@@ -148,8 +248,39 @@ none:
 	if (flags & PIN_NONBLOCK)
 		return -ENOSPC;
 
-	/* Only idle the GPU and repeat the search once */
-	if (pass++ == 0) {
+	/*
+	 * Active vmas were already part of the scan and unbinding them waits
+	 * only for their own rendering, so idling the whole GPU buys nothing
+	 * for them.  What can still help is releasing pins held on behalf of
+	 * outstanding requests: first by retiring whatever has completed,
+	 * then by waiting for just the requests holding those pins, and
+	 * only as a last resort, and only with legacy ringbuffer contexts,
+	 * by idling the GPU.
+	 */
+	switch (pass++) {
+	case 0:
+		i915_gem_retire_requests(dev);
+		goto search_again;
+	case 1:
+		ret = evict_wait_pinned(to_i915(dev), vm, start, end);
+		if (ret == 0) {
+			i915_gem_retire_requests(dev);
+			goto search_again;
+		}
+		if (ret != -ENOENT)
+			return ret;
+		/* fall through */
+	case 2:
+		/*
+		 * Legacy ringbuffer contexts stay pinned until the engine
+		 * switches away from them, which only idling forces.  With
+		 * execlists every pin that a wait can release was covered
+		 * above, so idling would only stall unrelated engines.
+		 */
+		pass = 3;
+		if (i915.enable_execlists)
+			break;
+
 		ret = i915_gpu_idle(dev);
 		if (ret)
 			return ret;
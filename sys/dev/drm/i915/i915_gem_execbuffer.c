@@ -271,139 +271,219 @@ relocation_target(struct drm_i915_gem_relocation_entry *reloc,
 	return gen8_canonical_addr((int)reloc->delta + target_offset);
 }
 
-static int
-relocate_entry_cpu(struct drm_i915_gem_object *obj,
-		   struct drm_i915_gem_relocation_entry *reloc,
-		   uint64_t target_offset)
-{
-	struct drm_device *dev = obj->base.dev;
-	uint32_t page_offset = offset_in_page(reloc->offset);
-	uint64_t delta = relocation_target(reloc, target_offset);
+/*
+ * Relocations into an object are written through a small cache which keeps
+ * the page last written to mapped, so that a run of relocations landing in
+ * the same page maps it, and looks up its backing page, only once.  The
+ * object is moved into the domain used for the writes when the first
+ * relocation actually needs patching, rather than for every entry.
+ *
+ * Without LLC the writes go through the CPU cache and must be flushed out.
+ * Each cacheline is flushed before it is first written, in case it holds
+ * stale data, and the range written to a page is flushed in one go when the
+ * page is unmapped instead of flushing around every dword.  Only the last
+ * pre-flushed line is remembered.  The callers group relocations by page
+ * but keep them in user order within one, so a line revisited later is
+ * flushed again, which costs a flush but writes back nothing lost.
+ */
+enum reloc_mode {
+	RELOC_NONE = 0,
+	RELOC_CPU,
+	RELOC_GTT,
+	RELOC_CLFLUSH,
+};
+
+struct reloc_cache {
+	struct drm_i915_gem_object *obj;
+	enum reloc_mode mode;
+	unsigned long page;
 	char *vaddr;
-	int ret;
+	uint32_t line;		/* last pre-flushed cacheline, RELOC_CLFLUSH */
+	uint32_t lo, hi;	/* range written, RELOC_CLFLUSH only */
+};
 
-	ret = i915_gem_object_set_to_cpu_domain(obj, true);
-	if (ret)
-		return ret;
+static void
+reloc_cache_init(struct reloc_cache *cache, struct drm_i915_gem_object *obj)
+{
+	cache->obj = obj;
+	cache->mode = RELOC_NONE;
+	cache->vaddr = NULL;
+}
 
-	vaddr = kmap_atomic(i915_gem_object_get_dirty_page(obj,
-				reloc->offset >> PAGE_SHIFT));
-	*(uint32_t *)(vaddr + page_offset) = lower_32_bits(delta);
+static void
+reloc_cache_unmap(struct reloc_cache *cache)
+{
+	if (cache->vaddr == NULL)
+		return;
 
-	if (INTEL_INFO(dev)->gen >= 8) {
-		page_offset = offset_in_page(page_offset + sizeof(uint32_t));
+	if (cache->mode == RELOC_GTT) {
+		io_mapping_unmap_atomic((void __iomem *)cache->vaddr);
+	} else {
+		if (cache->mode == RELOC_CLFLUSH && cache->lo < cache->hi)
+			drm_clflush_virt_range(cache->vaddr + cache->lo,
+					       cache->hi - cache->lo);
+		kunmap_atomic(cache->vaddr);
+	}
+	cache->vaddr = NULL;
+}
 
-		if (page_offset == 0) {
-			kunmap_atomic(vaddr);
-			vaddr = kmap_atomic(i915_gem_object_get_dirty_page(obj,
-			    (reloc->offset + sizeof(uint32_t)) >> PAGE_SHIFT));
-		}
+static int
+reloc_cache_prepare(struct reloc_cache *cache)
+{
+	struct drm_i915_gem_object *obj = cache->obj;
+	int ret;
 
-		*(uint32_t *)(vaddr + page_offset) = upper_32_bits(delta);
-	}
+	if (cache->mode != RELOC_NONE)
+		return 0;
 
-	kunmap_atomic(vaddr);
+	if (use_cpu_reloc(obj)) {
+		ret = i915_gem_object_set_to_cpu_domain(obj, true);
+		if (ret)
+			return ret;
+		cache->mode = RELOC_CPU;
+	} else if (obj->map_and_fenceable) {
+		ret = i915_gem_object_set_to_gtt_domain(obj, true);
+		if (ret)
+			return ret;
+		ret = i915_gem_object_put_fence(obj);
+		if (ret)
+			return ret;
+		cache->mode = RELOC_GTT;
+	} else if (static_cpu_has(X86_FEATURE_CLFLUSH)) {
+		ret = i915_gem_object_set_to_gtt_domain(obj, true);
+		if (ret)
+			return ret;
+		cache->mode = RELOC_CLFLUSH;
+	} else {
+		WARN_ONCE(1, "Impossible case in relocation handling\n");
+		return -ENODEV;
+	}
 
 	return 0;
 }
 
-static int
-relocate_entry_gtt(struct drm_i915_gem_object *obj,
-		   struct drm_i915_gem_relocation_entry *reloc,
-		   uint64_t target_offset)
+static char *
+reloc_cache_map(struct reloc_cache *cache, unsigned long page)
 {
-	struct drm_device *dev = obj->base.dev;
-	struct drm_i915_private *dev_priv = to_i915(dev);
-	struct i915_ggtt *ggtt = &dev_priv->ggtt;
-	uint64_t delta = relocation_target(reloc, target_offset);
-	uint64_t offset;
-	void __iomem *reloc_page;
-	int ret;
+	struct drm_i915_gem_object *obj = cache->obj;
 
-	ret = i915_gem_object_set_to_gtt_domain(obj, true);
-	if (ret)
-		return ret;
+	if (cache->vaddr != NULL && cache->page == page)
+		return cache->vaddr;
 
-	ret = i915_gem_object_put_fence(obj);
-	if (ret)
-		return ret;
+	reloc_cache_unmap(cache);
 
-	/* Map the page containing the relocation we're going to perform.  */
-	offset = i915_gem_obj_ggtt_offset(obj);
-	offset += reloc->offset;
-	reloc_page = io_mapping_map_atomic_wc(ggtt->mappable,
-					      offset & ~PAGE_MASK);
-	iowrite32(lower_32_bits(delta), reloc_page + offset_in_page(offset));
-
-	if (INTEL_INFO(dev)->gen >= 8) {
-		offset += sizeof(uint32_t);
-
-		if (offset_in_page(offset) == 0) {
-			io_mapping_unmap_atomic(reloc_page);
-			reloc_page =
-				io_mapping_map_atomic_wc(ggtt->mappable,
-							 offset);
-		}
+	if (cache->mode == RELOC_GTT) {
+		struct i915_ggtt *ggtt = &to_i915(obj->base.dev)->ggtt;
+		uint64_t offset;
 
-		iowrite32(upper_32_bits(delta),
-			  reloc_page + offset_in_page(offset));
+		offset = i915_gem_obj_ggtt_offset(obj) +
+			 ((uint64_t)page << PAGE_SHIFT);
+		cache->vaddr = (char __force *)
+			io_mapping_map_atomic_wc(ggtt->mappable, offset);
+	} else {
+		cache->vaddr = kmap_atomic(i915_gem_object_get_dirty_page(obj,
+									 page));
 	}
+	cache->page = page;
+	cache->line = PAGE_SIZE;
+	cache->lo = PAGE_SIZE;
+	cache->hi = 0;
 
-	io_mapping_unmap_atomic(reloc_page);
-
-	return 0;
+	return cache->vaddr;
 }
 
 static void
-clflush_write32(void *addr, uint32_t value)
+reloc_cache_write32(struct reloc_cache *cache, uint64_t offset, uint32_t value)
 {
-	/* This is not a fast path, so KISS. */
-	drm_clflush_virt_range(addr, sizeof(uint32_t));
-	*(uint32_t *)addr = value;
-	drm_clflush_virt_range(addr, sizeof(uint32_t));
+	uint32_t page_offset = offset_in_page(offset);
+	uint32_t line;
+	char *vaddr;
+
+	vaddr = reloc_cache_map(cache, offset >> PAGE_SHIFT);
+
+	switch (cache->mode) {
+	case RELOC_GTT:
+		iowrite32(value, (void __iomem *)(vaddr + page_offset));
+		break;
+	case RELOC_CLFLUSH:
+		line = rounddown(page_offset, cpu_clflush_line_size);
+		if (line != cache->line) {
+			drm_clflush_virt_range(vaddr + line,
+					       cpu_clflush_line_size);
+			cache->line = line;
+		}
+		*(uint32_t *)(vaddr + page_offset) = value;
+		cache->lo = min(cache->lo, page_offset);
+		cache->hi = max_t(uint32_t, cache->hi,
+				  page_offset + sizeof(uint32_t));
+		break;
+	default:
+		*(uint32_t *)(vaddr + page_offset) = value;
+		break;
+	}
 }
 
 static int
-relocate_entry_clflush(struct drm_i915_gem_object *obj,
-		       struct drm_i915_gem_relocation_entry *reloc,
-		       uint64_t target_offset)
+relocate_entry(struct reloc_cache *cache,
+	       struct drm_i915_gem_relocation_entry *reloc,
+	       uint64_t target_offset)
 {
-	struct drm_device *dev = obj->base.dev;
-	uint32_t page_offset = offset_in_page(reloc->offset);
+	struct drm_device *dev = cache->obj->base.dev;
 	uint64_t delta = relocation_target(reloc, target_offset);
-	char *vaddr;
 	int ret;
 
-	ret = i915_gem_object_set_to_gtt_domain(obj, true);
+	ret = reloc_cache_prepare(cache);
 	if (ret)
 		return ret;
 
-	vaddr = kmap_atomic(i915_gem_object_get_dirty_page(obj,
-				reloc->offset >> PAGE_SHIFT));
-	clflush_write32(vaddr + page_offset, lower_32_bits(delta));
+	reloc_cache_write32(cache, reloc->offset, lower_32_bits(delta));
+	if (INTEL_INFO(dev)->gen >= 8)
+		reloc_cache_write32(cache, reloc->offset + sizeof(uint32_t),
+				    upper_32_bits(delta));
 
-	if (INTEL_INFO(dev)->gen >= 8) {
-		page_offset = offset_in_page(page_offset + sizeof(uint32_t));
+	return 0;
+}
 
-		if (page_offset == 0) {
-			kunmap_atomic(vaddr);
-			vaddr = kmap_atomic(i915_gem_object_get_dirty_page(obj,
-			    (reloc->offset + sizeof(uint32_t)) >> PAGE_SHIFT));
-		}
+/*
+ * Order a chunk of relocations by the page they patch so that writes to
+ * the same page are grouped together.  Userspace mostly emits them in
+ * order already, which insertion sort handles in a single pass.  The sort
+ * is stable and only looks at the page, so within a page the entries keep
+ * their user order: where relocations overlap, such as a 64-bit gen8 entry
+ * and one 4 bytes into it, the last one written still wins.  A 64-bit
+ * entry may straddle two pages; a chunk holding one is left in user order.
+ */
+static void
+reloc_sort(const struct drm_i915_gem_relocation_entry *r, uint16_t *order,
+	   int count)
+{
+	uint64_t page;
+	int i, j;
 
-		clflush_write32(vaddr + page_offset, upper_32_bits(delta));
+	for (i = 0; i < count; i++) {
+		if (offset_in_page(r[i].offset) > PAGE_SIZE - sizeof(uint64_t)) {
+			for (j = 0; j < count; j++)
+				order[j] = j;
+			return;
+		}
 	}
 
-	kunmap_atomic(vaddr);
-
-	return 0;
+	for (i = 0; i < count; i++) {
+		page = r[i].offset >> PAGE_SHIFT;
+		for (j = i;
+		     j > 0 && (r[order[j - 1]].offset >> PAGE_SHIFT) > page;
+		     j--)
+			order[j] = order[j - 1];
+		order[j] = i;
+	}
 }
 
 static int
-i915_gem_execbuffer_relocate_entry(struct drm_i915_gem_object *obj,
+i915_gem_execbuffer_relocate_entry(struct reloc_cache *cache,
 				   struct eb_vmas *eb,
 				   struct drm_i915_gem_relocation_entry *reloc)
 {
+	struct drm_i915_gem_object *obj = cache->obj;
 	struct drm_device *dev = obj->base.dev;
 	struct drm_gem_object *target_obj;
 	struct drm_i915_gem_object *target_i915_obj;
@@ -485,17 +565,7 @@ i915_gem_execbuffer_relocate_entry(struct drm_i915_gem_object *obj,
 	if (obj->active && (curthread->td_flags & TDF_NOFAULT))
 		return -EFAULT;
 
-	if (use_cpu_reloc(obj))
-		ret = relocate_entry_cpu(obj, reloc, target_offset);
-	else if (obj->map_and_fenceable)
-		ret = relocate_entry_gtt(obj, reloc, target_offset);
-	else if (static_cpu_has(X86_FEATURE_CLFLUSH))
-		ret = relocate_entry_clflush(obj, reloc, target_offset);
-	else {
-		WARN_ONCE(1, "Impossible case in relocation handling\n");
-		ret = -ENODEV;
-	}
-
+	ret = relocate_entry(cache, reloc, target_offset);
 	if (ret)
 		return ret;
 
@@ -511,11 +581,18 @@ i915_gem_execbuffer_relocate_vma(struct i915_vma *vma,
 {
 #define N_RELOC(x) ((x) / sizeof(struct drm_i915_gem_relocation_entry))
 	struct drm_i915_gem_relocation_entry stack_reloc[N_RELOC(512)];
+	uint16_t order[N_RELOC(512)];
 	struct drm_i915_gem_relocation_entry __user *user_relocs;
 	struct drm_i915_gem_exec_object2 *entry = vma->exec_entry;
-	int remain, ret;
+	struct reloc_cache cache;
+	unsigned long updated;
+	int remain, ret = 0;
+	int i;
+
+	BUILD_BUG_ON(N_RELOC(512) > BITS_PER_LONG);
 
 	user_relocs = u64_to_user_ptr(entry->relocs_ptr);
+	reloc_cache_init(&cache, vma->obj);
 
 	remain = entry->relocation_count;
 	while (remain) {
@@ -525,27 +602,44 @@ i915_gem_execbuffer_relocate_vma(struct i915_vma *vma,
 			count = ARRAY_SIZE(stack_reloc);
 		remain -= count;
 
-		if (__copy_from_user_inatomic(r, user_relocs, count*sizeof(r[0])))
-			return -EFAULT;
+		if (__copy_from_user_inatomic(r, user_relocs, count*sizeof(r[0]))) {
+			ret = -EFAULT;
+			break;
+		}
+
+		reloc_sort(r, order, count);
 
-		do {
-			u64 offset = r->presumed_offset;
+		updated = 0;
+		for (i = 0; i < count; i++) {
+			u64 offset = r[order[i]].presumed_offset;
 
-			ret = i915_gem_execbuffer_relocate_entry(vma->obj, eb, r);
+			ret = i915_gem_execbuffer_relocate_entry(&cache, eb,
+								 &r[order[i]]);
 			if (ret)
-				return ret;
+				break;
 
-			if (r->presumed_offset != offset &&
-			    __put_user(r->presumed_offset, &user_relocs->presumed_offset)) {
-				return -EFAULT;
+			if (r[order[i]].presumed_offset != offset)
+				updated |= 1UL << order[i];
+		}
+
+		/* Report back whatever was written, even on failure */
+		for (i = 0; i < count; i++) {
+			if ((updated & (1UL << i)) &&
+			    __put_user(r[i].presumed_offset,
+				       &user_relocs[i].presumed_offset)) {
+				ret = -EFAULT;
+				break;
 			}
+		}
+		if (ret)
+			break;
 
-			user_relocs++;
-			r++;
-		} while (--count);
+		user_relocs += count;
 	}
 
-	return 0;
+	reloc_cache_unmap(&cache);
+
+	return ret;
 #undef N_RELOC
 }
 
@@ -555,15 +649,29 @@ i915_gem_execbuffer_relocate_vma_slow(struct i915_vma *vma,
 				      struct drm_i915_gem_relocation_entry *relocs)
 {
 	const struct drm_i915_gem_exec_object2 *entry = vma->exec_entry;
-	int i, ret;
+	uint16_t order[64];
+	struct reloc_cache cache;
+	int remain, count, i, ret = 0;
 
-	for (i = 0; i < entry->relocation_count; i++) {
-		ret = i915_gem_execbuffer_relocate_entry(vma->obj, eb, &relocs[i]);
-		if (ret)
-			return ret;
+	reloc_cache_init(&cache, vma->obj);
+
+	for (remain = entry->relocation_count; remain; remain -= count) {
+		count = min_t(int, remain, ARRAY_SIZE(order));
+
+		reloc_sort(relocs, order, count);
+		for (i = 0; i < count; i++) {
+			ret = i915_gem_execbuffer_relocate_entry(&cache, eb,
+							 &relocs[order[i]]);
+			if (ret)
+				goto out;
+		}
+		relocs += count;
 	}
 
-	return 0;
+out:
+	reloc_cache_unmap(&cache);
+
+	return ret;
 }
 
 static int
@@ -774,11 +882,16 @@ i915_gem_execbuffer_reserve(struct intel_engine_cs *engine,
 	 *
 	 * This avoid unnecessary unbinding of later objects in order to make
 	 * room for the earlier objects *unless* we need to defragment.
+	 *
+	 * Nothing touches the new bindings until relocation, so the GGTT TLB
+	 * flush is done once per pass rather than once per object.
 	 */
 	retry = 0;
 	do {
 		int ret = 0;
 
+		i915_ggtt_defer_flush(to_i915(engine->dev));
+
 		/* Unbind any ill-fitting objects or pin. */
 		list_for_each_entry(vma, vmas, exec_list) {
 			if (!drm_mm_node_allocated(&vma->node))
@@ -806,6 +919,8 @@ i915_gem_execbuffer_reserve(struct intel_engine_cs *engine,
 		}
 
 err:
+		i915_ggtt_flush_deferred(to_i915(engine->dev));
+
 		if (ret != -ENOSPC || retry++)
 			return ret;
 
@@ -703,6 +703,103 @@ static int gen8_48b_mm_switch(struct i915_hw_ppgtt *ppgtt,
 	return gen8_write_pdp(req, 0, px_dma(&ppgtt->pml4));
 }
 
+static void mark_tlbs_dirty(struct i915_hw_ppgtt *ppgtt);
+
+/*
+ * 2M pages are only used with 48bit PPGTT on gen9+, where the PS bit in
+ * the PDE is known to work.  64K pages need an entire page table to be
+ * 64K-only, which placement cannot guarantee, so they are not used.
+ */
+static bool gen8_ppgtt_huge(struct i915_address_space *vm)
+{
+	return INTEL_INFO(vm->dev)->gen >= 9 && USES_FULL_48BIT_PPGTT(vm->dev);
+}
+
+static void gen8_ppgtt_set_huge_pde(struct i915_hw_ppgtt *ppgtt,
+				    struct i915_page_directory *pd,
+				    unsigned pde, dma_addr_t addr,
+				    enum i915_cache_level level)
+{
+	gen8_pde_t *page_directory = kmap_px(pd);
+	gen8_pte_t pte = gen8_pte_encode(addr, level, true);
+
+	/*
+	 * PS sits where the PTE has PAT, which moves up to bit 12, so the
+	 * PDE selects the same PPAT entry as the 4K PTEs would.
+	 */
+	if (pte & _PAGE_PAT)
+		pte = (pte & ~(gen8_pte_t)_PAGE_PAT) | GEN8_PDE_PAT_2M;
+	page_directory[pde] = pte | GEN8_PDE_PS_2M;
+	kunmap_px(ppgtt, page_directory);
+
+	if (!__test_and_set_bit(pde, pd->huge_pdes))
+		ppgtt->base.huge_mapped += I915_GTT_PAGE_SIZE_2M;
+	mark_tlbs_dirty(ppgtt);
+}
+
+/* Point a 2M PDE back at its page table */
+static void gen8_ppgtt_clear_huge_pde(struct i915_hw_ppgtt *ppgtt,
+				      struct i915_page_directory *pd,
+				      unsigned pde)
+{
+	gen8_pde_t *page_directory = kmap_px(pd);
+
+	page_directory[pde] = gen8_pde_encode(px_dma(pd->page_table[pde]),
+					      I915_CACHE_LLC);
+	kunmap_px(ppgtt, page_directory);
+
+	__clear_bit(pde, pd->huge_pdes);
+	ppgtt->base.huge_mapped -= I915_GTT_PAGE_SIZE_2M;
+	mark_tlbs_dirty(ppgtt);
+}
+
+/*
+ * Whether the next GEN8_PTES pages of the iterator are one 2M aligned,
+ * dma contiguous chunk.
+ */
+static bool gen8_ppgtt_sg_huge(struct sg_page_iter *sg_iter)
+{
+	if (sg_page_iter_dma_address(sg_iter) & (I915_GTT_PAGE_SIZE_2M - 1))
+		return false;
+
+	return sg_page_count(sg_iter->sg) - sg_iter->sg_pgoffset >= GEN8_PTES;
+}
+
+/**
+ * i915_ppgtt_can_map_huge - check whether an object benefits from 2M PDEs
+ * @vm: address space the object is about to be bound into
+ * @obj: object with its backing pages attached
+ *
+ * Returns true if @vm supports 2M pages and some 2M aligned chunk of the
+ * object's pages would line up with a 2M aligned GTT offset, in which case
+ * the caller should ask for 2M alignment so gen8_ppgtt_insert_pte_entries()
+ * can map that chunk with a single PDE.
+ */
+bool i915_ppgtt_can_map_huge(struct i915_address_space *vm,
+			     struct drm_i915_gem_object *obj)
+{
+	struct scatterlist *sg;
+	u64 offset = 0;
+	u64 skip;
+	int i;
+
+	if (vm->is_ggtt || !gen8_ppgtt_huge(vm))
+		return false;
+
+	if (obj->base.size < I915_GTT_PAGE_SIZE_2M || obj->pages == NULL)
+		return false;
+
+	for_each_sg(obj->pages->sgl, sg, obj->pages->nents, i) {
+		skip = -sg_dma_address(sg) & (I915_GTT_PAGE_SIZE_2M - 1);
+		if (((offset + skip) & (I915_GTT_PAGE_SIZE_2M - 1)) == 0 &&
+		    skip + I915_GTT_PAGE_SIZE_2M <= sg->length)
+			return true;
+		offset += sg->length;
+	}
+
+	return false;
+}
+
 static void gen8_ppgtt_clear_pte_range(struct i915_address_space *vm,
 				       struct i915_page_directory_pointer *pdp,
 				       uint64_t start,
@@ -737,6 +834,9 @@ static void gen8_ppgtt_clear_pte_range(struct i915_address_space *vm,
 		if (WARN_ON(!px_page(pt)))
 			break;
 
+		if (test_bit(pde, pd->huge_pdes))
+			gen8_ppgtt_clear_huge_pde(ppgtt, pd, pde);
+
 		last_pte = pte + num_entries;
 		if (last_pte > GEN8_PTES)
 			last_pte = GEN8_PTES;
@@ -794,14 +894,32 @@ gen8_ppgtt_insert_pte_entries(struct i915_address_space *vm,
 	unsigned pdpe = gen8_pdpe_index(start);
 	unsigned pde = gen8_pde_index(start);
 	unsigned pte = gen8_pte_index(start);
+	const bool huge = gen8_ppgtt_huge(vm);
+	unsigned i;
 
 	pt_vaddr = NULL;
 
 	while (__sg_page_iter_next(sg_iter)) {
+		struct i915_page_directory *pd = pdp->page_directory[pdpe];
+
+		if (pte == 0 && huge && gen8_ppgtt_sg_huge(sg_iter)) {
+			gen8_ppgtt_set_huge_pde(ppgtt, pd, pde,
+						sg_page_iter_dma_address(sg_iter),
+						cache_level);
+			for (i = 1; i < GEN8_PTES; i++)
+				__sg_page_iter_next(sg_iter);
+			if (++pde == I915_PDES) {
+				if (++pdpe == I915_PDPES_PER_PDP(vm->dev))
+					break;
+				pde = 0;
+			}
+			continue;
+		}
+
 		if (pt_vaddr == NULL) {
-			struct i915_page_directory *pd = pdp->page_directory[pdpe];
-			struct i915_page_table *pt = pd->page_table[pde];
-			pt_vaddr = kmap_px(pt);
+			if (test_bit(pde, pd->huge_pdes))
+				gen8_ppgtt_clear_huge_pde(ppgtt, pd, pde);
+			pt_vaddr = kmap_px(pd->page_table[pde]);
 		}
 
 		pt_vaddr[pte] =
@@ -1284,6 +1402,8 @@ static int gen8_alloc_va_range_3lvl(struct i915_address_space *vm,
 			/* Map the PDE to the page table */
 			page_directory[pde] = gen8_pde_encode(px_dma(pt),
 							      I915_CACHE_LLC);
+			if (__test_and_clear_bit(pde, pd->huge_pdes))
+				vm->huge_mapped -= I915_GTT_PAGE_SIZE_2M;
 			trace_i915_page_table_entry_map(&ppgtt->base, pde, pt,
 							gen8_pte_index(start),
 							gen8_pte_count(start, length),
@@ -2357,6 +2477,46 @@ static void gen8_set_pte(void __iomem *addr, gen8_pte_t pte)
 #endif
 }
 
+/**
+ * i915_ggtt_defer_flush - start batching GGTT TLB flushes
+ * @dev_priv: i915 device
+ *
+ * GGTT binds normally end with a posting read of the last PTE written and
+ * a GFX_FLSH_CNTL write.  Until the matching i915_ggtt_flush_deferred()
+ * they only note the last PTE written, and the posting read and flush are
+ * done once at the end, so binding many objects costs a single flush.
+ * Nothing may use the new GGTT mappings before then.  Calls nest and must
+ * be made under struct_mutex.
+ */
+void i915_ggtt_defer_flush(struct drm_i915_private *dev_priv)
+{
+	dev_priv->ggtt.flush_defer++;
+}
+
+/**
+ * i915_ggtt_flush_deferred - end batching GGTT TLB flushes
+ * @dev_priv: i915 device
+ *
+ * Flushes the GGTT TLBs if any PTEs were written since the outermost
+ * i915_ggtt_defer_flush().
+ */
+void i915_ggtt_flush_deferred(struct drm_i915_private *dev_priv)
+{
+	struct i915_ggtt *ggtt = &dev_priv->ggtt;
+
+	if (WARN_ON(ggtt->flush_defer == 0))
+		return;
+
+	if (--ggtt->flush_defer || ggtt->flush_posting == NULL)
+		return;
+
+	/* Posting read of the last PTE written, see gen8_ggtt_insert_entries */
+	(void)readl(ggtt->flush_posting);
+	ggtt->flush_posting = NULL;
+
+	i915_ggtt_flush(dev_priv);
+}
+
 static void gen8_ggtt_insert_entries(struct i915_address_space *vm,
 				     struct sg_table *st,
 				     uint64_t start,
@@ -2367,19 +2527,33 @@ static void gen8_ggtt_insert_entries(struct i915_address_space *vm,
 	unsigned first_entry = start >> PAGE_SHIFT;
 	gen8_pte_t __iomem *gtt_entries =
 		(gen8_pte_t __iomem *)ggtt->gsm + first_entry;
+	const gen8_pte_t pte_flags = gen8_pte_encode(0, level, true);
 	int i = 0;
-	struct sg_page_iter sg_iter;
+	struct scatterlist *sg;
 	dma_addr_t addr = 0; /* shut up gcc */
+	unsigned npages;
+	int n;
 	int rpm_atomic_seq;
 
 	rpm_atomic_seq = assert_rpm_atomic_begin(dev_priv);
 
-	for_each_sg_page(st->sgl, &sg_iter, st->nents, 0) {
-		addr = sg_dma_address(sg_iter.sg) +
-			(sg_iter.sg_pgoffset << PAGE_SHIFT);
-		gen8_set_pte(&gtt_entries[i],
-			     gen8_pte_encode(addr, level, true));
-		i++;
+	/*
+	 * Walk the dma runs rather than individual pages and stream out
+	 * pre-encoded 64bit PTEs; the GSM is mapped write-combining.
+	 */
+	for_each_sg(st->sgl, sg, st->nents, n) {
+		addr = sg_dma_address(sg);
+		for (npages = sg_page_count(sg); npages; npages--) {
+			gen8_set_pte(&gtt_entries[i++], pte_flags | addr);
+			addr += PAGE_SIZE;
+		}
+	}
+	addr -= PAGE_SIZE;
+
+	if (ggtt->flush_defer) {
+		if (i != 0)
+			ggtt->flush_posting = &gtt_entries[i-1];
+		goto out;
 	}
 
 	/*
@@ -2390,8 +2564,7 @@ static void gen8_ggtt_insert_entries(struct i915_address_space *vm,
 	 * hardware should work, we must keep this posting read for paranoia.
 	 */
 	if (i != 0)
-		WARN_ON(readq(&gtt_entries[i-1])
-			!= gen8_pte_encode(addr, level, true));
+		WARN_ON(readq(&gtt_entries[i-1]) != (pte_flags | addr));
 
 	/* This next bit makes the above posting read even more important. We
 	 * want to flush the TLBs only after we're certain all the PTE updates
@@ -2400,6 +2573,7 @@ static void gen8_ggtt_insert_entries(struct i915_address_space *vm,
 	I915_WRITE(GFX_FLSH_CNTL_GEN6, GFX_FLSH_CNTL_EN);
 	POSTING_READ(GFX_FLSH_CNTL_GEN6);
 
+out:
 	assert_rpm_atomic_end(dev_priv, rpm_atomic_seq);
 }
 
@@ -2466,6 +2640,12 @@ static void gen6_ggtt_insert_entries(struct i915_address_space *vm,
 		i++;
 	}
 
+	if (ggtt->flush_defer) {
+		if (i != 0)
+			ggtt->flush_posting = &gtt_entries[i-1];
+		goto out;
+	}
+
 	/* XXX: This serves as a posting read to make sure that the PTE has
 	 * actually been updated. There is some concern that even though
 	 * registers and PTEs are within the same BAR that they are potentially
@@ -2484,6 +2664,7 @@ static void gen6_ggtt_insert_entries(struct i915_address_space *vm,
 	I915_WRITE(GFX_FLSH_CNTL_GEN6, GFX_FLSH_CNTL_EN);
 	POSTING_READ(GFX_FLSH_CNTL_GEN6);
 
+out:
 	assert_rpm_atomic_end(dev_priv, rpm_atomic_seq);
 }
 
@@ -2846,6 +3027,8 @@ void i915_ggtt_cleanup_hw(struct drm_device *dev)
 	struct drm_i915_private *dev_priv = to_i915(dev);
 	struct i915_ggtt *ggtt = &dev_priv->ggtt;
 
+	sysctl_ctx_free(&dev_priv->mm.ppgtt_sysctl_ctx);
+
 	if (dev_priv->mm.aliasing_ppgtt) {
 		struct i915_hw_ppgtt *ppgtt = dev_priv->mm.aliasing_ppgtt;
 
@@ -3186,6 +3369,127 @@ static void i915_gmch_remove(struct i915_address_space *vm)
 	intel_gmch_remove();
 }
 
+#define I915_PPGTT_STAT_BOUND	0
+#define I915_PPGTT_STAT_HUGE	1
+
+static u_long
+i915_ppgtt_vm_bound(struct i915_address_space *vm)
+{
+	struct i915_vma *vma;
+	u_long val = 0;
+
+	list_for_each_entry(vma, &vm->active_list, vm_link)
+		val += vma->node.size;
+	list_for_each_entry(vma, &vm->inactive_list, vm_link)
+		val += vma->node.size;
+
+	return val;
+}
+
+static int
+i915_ppgtt_sysctl_stat(SYSCTL_HANDLER_ARGS)
+{
+	struct drm_i915_private *dev_priv = arg1;
+	struct drm_device *dev = dev_priv->dev;
+	struct i915_address_space *vm;
+	u_long val = 0;
+
+	mutex_lock(&dev->struct_mutex);
+	list_for_each_entry(vm, &dev_priv->vm_list, global_link) {
+		if (vm->is_ggtt)
+			continue;
+		if (arg2 == I915_PPGTT_STAT_HUGE)
+			val += vm->huge_mapped;
+		else
+			val += i915_ppgtt_vm_bound(vm);
+	}
+	mutex_unlock(&dev->struct_mutex);
+
+	return sysctl_handle_long(oidp, &val, 0, req);
+}
+
+struct i915_ppgtt_ctx_stat {
+	pid_t pid;
+	int handle;
+	u_long bound;
+	u_long huge_mapped;
+};
+
+/*
+ * One line per context with its own PPGTT.  The numbers are gathered under
+ * struct_mutex and only copied out once it has been dropped.
+ */
+static int
+i915_ppgtt_sysctl_contexts(SYSCTL_HANDLER_ARGS)
+{
+	struct drm_i915_private *dev_priv = arg1;
+	struct drm_device *dev = dev_priv->dev;
+	struct i915_ppgtt_ctx_stat *st;
+	struct intel_context *ctx;
+	char buf[128];
+	int i, n = 0;
+	int error;
+
+	mutex_lock(&dev->struct_mutex);
+	list_for_each_entry(ctx, &dev_priv->context_list, link)
+		n++;
+	st = kcalloc(max(n, 1), sizeof(*st), GFP_KERNEL);
+	n = 0;
+	list_for_each_entry(ctx, &dev_priv->context_list, link) {
+		if (ctx->ppgtt == NULL)
+			continue;
+		st[n].pid = ctx->file_priv ? ctx->file_priv->file->pid : 0;
+		st[n].handle = ctx->user_handle;
+		st[n].bound = i915_ppgtt_vm_bound(&ctx->ppgtt->base);
+		st[n].huge_mapped = ctx->ppgtt->base.huge_mapped;
+		n++;
+	}
+	mutex_unlock(&dev->struct_mutex);
+
+	ksnprintf(buf, sizeof(buf), "\n%8s %8s %14s %14s", "pid", "context",
+	    "bound", "huge_mapped");
+	error = SYSCTL_OUT(req, buf, strlen(buf));
+	for (i = 0; i < n && error == 0; i++) {
+		ksnprintf(buf, sizeof(buf), "\n%8d %8d %14lu %14lu",
+		    st[i].pid, st[i].handle, st[i].bound, st[i].huge_mapped);
+		error = SYSCTL_OUT(req, buf, strlen(buf));
+	}
+	if (error == 0)
+		error = SYSCTL_OUT(req, "", 1);
+	kfree(st);
+
+	return error;
+}
+
+static void
+i915_ppgtt_sysctl_init(struct drm_i915_private *dev_priv)
+{
+	struct drm_device *dev = dev_priv->dev;
+	struct sysctl_ctx_list *ctx = &dev_priv->mm.ppgtt_sysctl_ctx;
+	struct sysctl_oid *top;
+
+	sysctl_ctx_init(ctx);
+	if (dev->sysctl == NULL || dev->sysctl->top == NULL)
+		return;
+
+	top = SYSCTL_ADD_NODE(ctx, SYSCTL_CHILDREN(dev->sysctl->top),
+	    OID_AUTO, "ppgtt", CTLFLAG_RD, NULL, "Per-process GTTs");
+	if (top == NULL)
+		return;
+
+	SYSCTL_ADD_PROC(ctx, SYSCTL_CHILDREN(top), OID_AUTO,
+	    "bound", CTLTYPE_ULONG | CTLFLAG_RD, dev_priv, I915_PPGTT_STAT_BOUND,
+	    i915_ppgtt_sysctl_stat, "LU", "Bytes bound into PPGTTs");
+	SYSCTL_ADD_PROC(ctx, SYSCTL_CHILDREN(top), OID_AUTO,
+	    "huge_mapped", CTLTYPE_ULONG | CTLFLAG_RD, dev_priv,
+	    I915_PPGTT_STAT_HUGE, i915_ppgtt_sysctl_stat, "LU",
+	    "Bytes of PPGTT bindings mapped with 2M pages");
+	SYSCTL_ADD_PROC(ctx, SYSCTL_CHILDREN(top), OID_AUTO,
+	    "contexts", CTLTYPE_STRING | CTLFLAG_RD, dev_priv, 0,
+	    i915_ppgtt_sysctl_contexts, "A",
+	    "Bytes bound and mapped with 2M pages per context PPGTT");
+}
+
 /**
  * i915_ggtt_init_hw - Initialize GGTT hardware
  * @dev: DRM device
@@ -3259,6 +3563,8 @@ int i915_ggtt_init_hw(struct drm_device *dev)
 	i915.enable_ppgtt = sanitize_enable_ppgtt(dev, i915.enable_ppgtt);
 	DRM_DEBUG_DRIVER("ppgtt mode: %i\n", i915.enable_ppgtt);
 
+	i915_ppgtt_sysctl_init(dev_priv);
+
 	return 0;
 
 out_gtt_cleanup:
@@ -3346,7 +3652,7 @@ __i915_gem_vma_create(struct drm_i915_gem_object *obj,
 	if (WARN_ON(i915_is_ggtt(vm) != !!ggtt_view))
 		return ERR_PTR(-EINVAL);
 
-	vma = kzalloc(sizeof(*vma), GFP_KERNEL);
+	vma = kmem_cache_zalloc(to_i915(obj->base.dev)->vmas, GFP_KERNEL);
 	if (vma == NULL)
 		return ERR_PTR(-ENOMEM);
 
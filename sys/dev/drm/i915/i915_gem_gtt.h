@@ -108,6 +108,11 @@ typedef uint64_t gen8_ppgtt_pml4e_t;
 #define GEN8_LEGACY_PDPES		4
 #define GEN8_PTES			I915_PTES(sizeof(gen8_pte_t))
 
+/* A PDE with PS set maps a 2M page directly; PS takes the place of PAT */
+#define GEN8_PDE_PS_2M			(1 << 7)
+#define GEN8_PDE_PAT_2M			(1 << 12) /* PAT moves here with PS */
+#define I915_GTT_PAGE_SIZE_2M		(1ULL << GEN8_PDE_SHIFT)
+
 #define I915_PDPES_PER_PDP(dev) (USES_FULL_48BIT_PPGTT(dev) ?\
 				 GEN8_PML4ES_PER_PML4 : GEN8_LEGACY_PDPES)
 
@@ -249,6 +254,7 @@ struct i915_page_directory {
 	struct i915_page_dma base;
 
 	unsigned long *used_pdes;
+	DECLARE_BITMAP(huge_pdes, I915_PDES);	/* PDEs with PS set */
 	struct i915_page_table *page_table[I915_PDES]; /* PDEs */
 };
 
@@ -272,6 +278,7 @@ struct i915_address_space {
 	struct list_head global_link;
 	u64 start;		/* Start offset always 0 for dri2 */
 	u64 total;		/* size addr space maps (ex. 2GB for ggtt) */
+	u64 huge_mapped;	/* bytes mapped through 2M PDEs */
 
 	bool is_ggtt;
 
@@ -356,6 +363,10 @@ struct i915_ggtt {
 
 	bool do_idle_maps;
 
+	/* Deferred GGTT TLB flush, see i915_ggtt_defer_flush() */
+	int flush_defer;
+	void __iomem *flush_posting;
+
 	int mtrr;
 
 	int (*probe)(struct i915_ggtt *ggtt);
@@ -517,6 +528,8 @@ int i915_ggtt_init_hw(struct drm_device *dev);
 int i915_ggtt_enable_hw(struct drm_device *dev);
 void i915_gem_init_ggtt(struct drm_device *dev);
 void i915_ggtt_cleanup_hw(struct drm_device *dev);
+void i915_ggtt_defer_flush(struct drm_i915_private *dev_priv);
+void i915_ggtt_flush_deferred(struct drm_i915_private *dev_priv);
 
 int i915_ppgtt_init(struct drm_device *dev, struct i915_hw_ppgtt *ppgtt);
 int i915_ppgtt_init_hw(struct drm_device *dev);
@@ -524,6 +537,8 @@ int i915_ppgtt_init_ring(struct drm_i915_gem_request *req);
 void i915_ppgtt_release(struct kref *kref);
 struct i915_hw_ppgtt *i915_ppgtt_create(struct drm_device *dev,
 					struct drm_i915_file_private *fpriv);
+bool i915_ppgtt_can_map_huge(struct i915_address_space *vm,
+			     struct drm_i915_gem_object *obj);
 static inline void i915_ppgtt_get(struct i915_hw_ppgtt *ppgtt)
 {
 	if (ppgtt)
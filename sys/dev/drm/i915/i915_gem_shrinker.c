@@ -165,6 +165,8 @@ i915_gem_shrink(struct drm_i915_private *dev_priv,
 			obj = list_first_entry(phase->list,
 					       typeof(*obj), global_list);
 			list_move_tail(&obj->global_list, &still_in_list);
+			dev_priv->mm.shrinker_scanned +=
+				obj->base.size >> PAGE_SHIFT;
 
 			if (flags & I915_SHRINK_PURGEABLE &&
 			    obj->madv != I915_MADV_DONTNEED)
@@ -197,6 +199,7 @@ i915_gem_shrink(struct drm_i915_private *dev_priv,
 	}
 
 	i915_gem_retire_requests(dev_priv->dev);
+	dev_priv->mm.shrinker_reclaimed += count;
 
 	return count;
 }
@@ -404,6 +407,89 @@ i915_gem_shrinker_vmap(struct notifier_block *nb, unsigned long event, void *ptr
 }
 #endif
 
+/*
+ * Default number of pages the vm_lowmem hook tries to release from idle
+ * objects once all purgeable objects have been discarded.
+ */
+#define I915_SHRINK_LOWMEM_BATCH	1024
+
+/*
+ * DragonFly has no shrinker registry; the pageout daemon instead invokes
+ * the vm_lowmem event handlers when free memory runs short.  Purgeable
+ * (I915_MADV_DONTNEED) objects are dropped first since their contents may
+ * be discarded outright, then up to shrinker_batch pages of idle bound and
+ * unbound objects are released to swap.  We are called from the pageout
+ * daemon, which may well be what the struct_mutex holder is waiting on,
+ * so never block on the lock and simply skip this round if it is busy.
+ */
+static void
+i915_gem_shrinker_lowmem(void *arg)
+{
+	struct drm_i915_private *dev_priv = arg;
+	struct drm_device *dev = dev_priv->dev;
+	unsigned long freed;
+	bool was_interruptible;
+
+	dev_priv->mm.shrinker_calls++;
+
+	if (!mutex_trylock(&dev->struct_mutex)) {
+		dev_priv->mm.shrinker_busy++;
+		return;
+	}
+
+	was_interruptible = dev_priv->mm.interruptible;
+	dev_priv->mm.interruptible = false;
+
+	freed = i915_gem_shrink(dev_priv, -1UL,
+				I915_SHRINK_BOUND |
+				I915_SHRINK_UNBOUND |
+				I915_SHRINK_PURGEABLE);
+	if (freed < dev_priv->mm.shrinker_batch)
+		freed += i915_gem_shrink(dev_priv,
+					 dev_priv->mm.shrinker_batch - freed,
+					 I915_SHRINK_BOUND |
+					 I915_SHRINK_UNBOUND);
+
+	dev_priv->mm.interruptible = was_interruptible;
+	mutex_unlock(&dev->struct_mutex);
+
+	if (freed)
+		DRM_DEBUG("lowmem: released %lu pages\n", freed);
+}
+
+static void
+i915_gem_shrinker_sysctl_init(struct drm_i915_private *dev_priv)
+{
+	struct drm_device *dev = dev_priv->dev;
+	struct sysctl_ctx_list *ctx = &dev_priv->mm.shrinker_sysctl_ctx;
+	struct sysctl_oid *top;
+
+	sysctl_ctx_init(ctx);
+	if (dev->sysctl == NULL || dev->sysctl->top == NULL)
+		return;
+
+	top = SYSCTL_ADD_NODE(ctx, SYSCTL_CHILDREN(dev->sysctl->top),
+	    OID_AUTO, "shrinker", CTLFLAG_RD, NULL, "GEM shrinker");
+	if (top == NULL)
+		return;
+
+	SYSCTL_ADD_ULONG(ctx, SYSCTL_CHILDREN(top), OID_AUTO, "batch",
+	    CTLFLAG_RW, &dev_priv->mm.shrinker_batch,
+	    "Pages of idle objects released per lowmem event");
+	SYSCTL_ADD_ULONG(ctx, SYSCTL_CHILDREN(top), OID_AUTO, "calls",
+	    CTLFLAG_RD, &dev_priv->mm.shrinker_calls,
+	    "Number of lowmem events received");
+	SYSCTL_ADD_ULONG(ctx, SYSCTL_CHILDREN(top), OID_AUTO, "busy",
+	    CTLFLAG_RD, &dev_priv->mm.shrinker_busy,
+	    "Lowmem events skipped because struct_mutex was held");
+	SYSCTL_ADD_ULONG(ctx, SYSCTL_CHILDREN(top), OID_AUTO, "scanned",
+	    CTLFLAG_RD, &dev_priv->mm.shrinker_scanned,
+	    "Pages of backing storage scanned");
+	SYSCTL_ADD_ULONG(ctx, SYSCTL_CHILDREN(top), OID_AUTO, "reclaimed",
+	    CTLFLAG_RD, &dev_priv->mm.shrinker_reclaimed,
+	    "Pages of backing storage released");
+}
+
 /**
  * i915_gem_shrinker_init - Initialize i915 shrinker
  * @dev_priv: i915 device
@@ -412,6 +498,11 @@ i915_gem_shrinker_vmap(struct notifier_block *nb, unsigned long event, void *ptr
  */
 void i915_gem_shrinker_init(struct drm_i915_private *dev_priv)
 {
+	dev_priv->mm.shrinker_batch = I915_SHRINK_LOWMEM_BATCH;
+	i915_gem_shrinker_sysctl_init(dev_priv);
+
+	dev_priv->mm.lowmem_handler = EVENTHANDLER_REGISTER(vm_lowmem,
+	    i915_gem_shrinker_lowmem, dev_priv, EVENTHANDLER_PRI_ANY);
 #if 0
 	dev_priv->mm.shrinker.scan_objects = i915_gem_shrinker_scan;
 	dev_priv->mm.shrinker.count_objects = i915_gem_shrinker_count;
@@ -439,4 +530,6 @@ void i915_gem_shrinker_cleanup(struct drm_i915_private *dev_priv)
 	WARN_ON(unregister_oom_notifier(&dev_priv->mm.oom_notifier));
 	unregister_shrinker(&dev_priv->mm.shrinker);
 #endif
+	EVENTHANDLER_DEREGISTER(vm_lowmem, dev_priv->mm.lowmem_handler);
+	sysctl_ctx_free(&dev_priv->mm.shrinker_sysctl_ctx);
 }
@@ -31,16 +31,57 @@
 #include <linux/types.h>
 
 #include <drm/drmP.h>
+#include <drm/drm_tracebuf.h>
 #include "i915_drv.h"
 #include "intel_drv.h"
 #include "intel_ringbuffer.h"
 
+/*
+ * Only the tracepoints below feed the drm_trace ring buffers; the remaining
+ * ones are still compiled out.  Record layouts are described next to the
+ * event ids in drm_tracebuf.h.
+ */
+
+static inline uint32_t
+i915_trace_engine(struct intel_engine_cs *engine)
+{
+	return (engine->dev->primary->index << 8) | engine->id;
+}
+
+static inline void
+i915_trace_request(u_int event, struct drm_i915_gem_request *req,
+		   uint64_t arg2)
+{
+	if (drm_trace_enabled(DRM_TRACE_CLASS_REQUEST))
+		drm_trace_record(event, i915_trace_engine(req->engine),
+				 req->seqno, arg2);
+}
+
+static inline void
+trace_i915_flip_request(int plane, struct drm_i915_gem_object *obj)
+{
+	drm_trace(DRM_TRACE_I915_FLIP_REQUEST, plane, (uintptr_t)obj, 0);
+}
+
+static inline void
+trace_i915_flip_complete(int plane, struct drm_i915_gem_object *obj)
+{
+	drm_trace(DRM_TRACE_I915_FLIP_COMPLETE, plane, (uintptr_t)obj, 0);
+}
 
-#define trace_i915_flip_complete(a,b)
-#define trace_i915_flip_request(a,b)
+static inline void
+trace_i915_gem_evict(struct drm_device *dev, u64 size, u64 align,
+		     unsigned flags)
+{
+	drm_trace(DRM_TRACE_I915_EVICT, dev->primary->index, size,
+		  (align << 32) | flags);
+}
 
-#define trace_i915_gem_evict(a,b,c,d)
-#define trace_i915_gem_evict_everything(a)
+static inline void
+trace_i915_gem_evict_everything(struct drm_device *dev)
+{
+	drm_trace(DRM_TRACE_I915_EVICT_EVERYTHING, dev->primary->index, 0, 0);
+}
 
 static inline void
 trace_i915_gem_object_change_domain(struct drm_i915_gem_object *obj, u32 read, u32 write)
@@ -54,27 +95,92 @@ trace_i915_gem_object_change_domain(struct drm_i915_gem_object *obj, u32 read, u
 #define trace_i915_gem_object_pread(obj, offset, size)
 #define trace_i915_gem_object_pwrite(obj, offset, size)
 
-#define trace_i915_gem_request_add(req)
+static inline void
+trace_i915_gem_request_add(struct drm_i915_gem_request *req)
+{
+	i915_trace_request(DRM_TRACE_I915_REQUEST_ADD, req, req->tail);
+}
+
 #define trace_i915_gem_request_complete(ring)
-#define trace_i915_gem_request_notify(ring)
-#define trace_i915_gem_request_retire(req)
-#define trace_i915_gem_request_wait_begin(req)
-#define trace_i915_gem_request_wait_end(req)
 
-#define trace_i915_gem_ring_dispatch(a,b)
+static inline void
+trace_i915_gem_request_notify(struct intel_engine_cs *engine)
+{
+	if (drm_trace_enabled(DRM_TRACE_CLASS_REQUEST))
+		drm_trace_record(DRM_TRACE_I915_REQUEST_NOTIFY,
+				 i915_trace_engine(engine),
+				 engine->get_seqno(engine), 0);
+}
+
+static inline void
+trace_i915_gem_request_retire(struct drm_i915_gem_request *req)
+{
+	i915_trace_request(DRM_TRACE_I915_REQUEST_RETIRE, req, 0);
+}
+
+static inline void
+trace_i915_gem_request_wait_begin(struct drm_i915_gem_request *req)
+{
+	i915_trace_request(DRM_TRACE_I915_REQUEST_WAIT_BEGIN, req, 0);
+}
+
+static inline void
+trace_i915_gem_request_wait_end(struct drm_i915_gem_request *req)
+{
+	i915_trace_request(DRM_TRACE_I915_REQUEST_WAIT_END, req, 0);
+}
+
+static inline void
+trace_i915_gem_ring_dispatch(struct drm_i915_gem_request *req, u32 flags)
+{
+	i915_trace_request(DRM_TRACE_I915_REQUEST_DISPATCH, req, flags);
+}
+
 #define trace_i915_gem_ring_flush(a,b,c)
-#define trace_i915_gem_ring_sync_to(from, to, seqno)
 
-#define trace_i915_gem_shrink(dev_priv, target, flags)
+static inline void
+trace_i915_gem_ring_sync_to(struct drm_i915_gem_request *to_req,
+			    struct intel_engine_cs *from,
+			    struct drm_i915_gem_request *from_req)
+{
+	if (drm_trace_enabled(DRM_TRACE_CLASS_REQUEST))
+		drm_trace_record(DRM_TRACE_I915_RING_SYNC_TO,
+				 i915_trace_engine(to_req->engine),
+				 from_req->seqno, i915_trace_engine(from));
+}
+
+static inline void
+trace_i915_gem_shrink(struct drm_i915_private *dev_priv,
+		      unsigned long target, unsigned flags)
+{
+	drm_trace(DRM_TRACE_I915_SHRINK, dev_priv->dev->primary->index,
+		  target, flags);
+}
 
 #define trace_i915_reg_rw(a,b,c,d,trace)
 
 #define trace_intel_gpu_freq_change(a)
 
-#define trace_i915_vma_bind(vma, map_and_fenceable)
-#define trace_i915_vma_unbind(vma)
+static inline void
+trace_i915_vma_bind(struct i915_vma *vma, u64 flags)
+{
+	drm_trace(DRM_TRACE_I915_VMA_BIND, flags, vma->node.start,
+		  vma->node.size);
+}
+
+static inline void
+trace_i915_vma_unbind(struct i915_vma *vma)
+{
+	drm_trace(DRM_TRACE_I915_VMA_UNBIND, 0, vma->node.start,
+		  vma->node.size);
+}
 
-#define trace_i915_gem_evict_vm(vm)
+static inline void
+trace_i915_gem_evict_vm(struct i915_address_space *vm)
+{
+	drm_trace(DRM_TRACE_I915_EVICT_VM, vm->dev->primary->index,
+		  (uintptr_t)vm, 0);
+}
 
 #define trace_i915_pipe_update_start(crtc)
 #define trace_i915_pipe_update_vblank_evaded(crtc)
@@ -431,10 +431,126 @@ static void execlists_submit_requests(struct drm_i915_gem_request *rq0,
 	spin_unlock_irq(&dev_priv->uncore.lock);
 }
 
+/*
+ * Requests which have not been handed to the ELSP yet wait on one FIFO per
+ * context priority.  All pending requests of a context stay on the level
+ * they were first queued at, even if the context priority changes in the
+ * meantime, so that a context's requests are always submitted in ring order.
+ *
+ * To bound starvation, the head of each FIFO gains one level for every
+ * EXECLISTS_AGE_MS it has been waiting.  Ties go to the higher base level.
+ */
+#define EXECLISTS_AGE_MS	20
+
+static struct drm_i915_gem_request *
+execlists_first_pending(struct intel_engine_cs *engine, int *levelp)
+{
+	struct drm_i915_gem_request *req, *best = NULL;
+	unsigned long age = msecs_to_jiffies(EXECLISTS_AGE_MS);
+	unsigned long prio, best_prio = 0;
+	unsigned int mask = engine->execlist_prio_mask;
+	int level;
+
+	while (mask) {
+		level = fls(mask) - 1;
+		mask &= ~(1U << level);
+
+		req = list_first_entry(&engine->execlist_prio[level],
+				       struct drm_i915_gem_request,
+				       execlist_link);
+		prio = level + (jiffies - req->execlist_queued) / age;
+		if (best == NULL || prio > best_prio) {
+			best = req;
+			best_prio = prio;
+			*levelp = level;
+		}
+	}
+
+	return best;
+}
+
+static void execlists_dequeue(struct intel_engine_cs *engine,
+			      struct drm_i915_gem_request *req, int level)
+{
+	list_del_init(&req->execlist_link);
+	if (list_empty(&engine->execlist_prio[level]))
+		engine->execlist_prio_mask &= ~(1U << level);
+	req->ctx->engine[engine->id].queued--;
+}
+
+/*
+ * Fold pending requests of @req's context into @req: a later tail of the
+ * same context covers the workload of the earlier ones, so only the last
+ * request needs to be submitted.  @req is replaced in place on whatever list
+ * it currently sits on.
+ */
+static struct drm_i915_gem_request *
+execlists_coalesce(struct intel_engine_cs *engine,
+		   struct drm_i915_gem_request *req)
+{
+	struct drm_i915_gem_request *next;
+	int level;
+
+	while ((next = execlists_first_pending(engine, &level)) != NULL &&
+	       next->ctx == req->ctx) {
+		execlists_dequeue(engine, next, level);
+		next->elsp_submitted = req->elsp_submitted;
+		list_replace(&req->execlist_link, &next->execlist_link);
+		list_add_tail(&req->execlist_link,
+			      &engine->execlist_retired_req_list);
+		req = next;
+	}
+
+	return req;
+}
+
+/*
+ * Choose what goes into the ELSP ports.  execlist_queue holds what the
+ * hardware currently has in its ports.  With both ports busy there is
+ * nothing to do until the next context switch; otherwise resubmit the
+ * running context (picking up any new requests for it) and fill the second
+ * port with the best pending request of another context.  Returns false if
+ * the ports are to be left alone.
+ */
+static bool execlists_pick(struct intel_engine_cs *engine,
+			   struct drm_i915_gem_request **req0p,
+			   struct drm_i915_gem_request **req1p)
+{
+	struct drm_i915_gem_request *req0, *req1;
+	int level;
+
+	req0 = list_first_entry_or_null(&engine->execlist_queue,
+					struct drm_i915_gem_request,
+					execlist_link);
+	if (req0 != NULL) {
+		if (!list_is_last(&req0->execlist_link,
+				  &engine->execlist_queue))
+			return false;
+	} else {
+		req0 = execlists_first_pending(engine, &level);
+		if (unlikely(!req0))
+			return false;
+		execlists_dequeue(engine, req0, level);
+		list_add_tail(&req0->execlist_link, &engine->execlist_queue);
+	}
+	req0 = execlists_coalesce(engine, req0);
+
+	req1 = execlists_first_pending(engine, &level);
+	if (req1 != NULL) {
+		execlists_dequeue(engine, req1, level);
+		list_add_tail(&req1->execlist_link, &engine->execlist_queue);
+		req1 = execlists_coalesce(engine, req1);
+		WARN_ON(req1->elsp_submitted);
+	}
+
+	*req0p = req0;
+	*req1p = req1;
+	return true;
+}
+
 static void execlists_context_unqueue(struct intel_engine_cs *engine)
 {
-	struct drm_i915_gem_request *req0 = NULL, *req1 = NULL;
-	struct drm_i915_gem_request *cursor, *tmp;
+	struct drm_i915_gem_request *req0, *req1;
 
 	assert_spin_locked(&engine->execlist_lock);
 
@@ -444,26 +560,7 @@ static void execlists_context_unqueue(struct intel_engine_cs *engine)
 	 */
 	WARN_ON(!intel_irqs_enabled(engine->dev->dev_private));
 
-	/* Try to read in pairs */
-	list_for_each_entry_safe(cursor, tmp, &engine->execlist_queue,
-				 execlist_link) {
-		if (!req0) {
-			req0 = cursor;
-		} else if (req0->ctx == cursor->ctx) {
-			/* Same ctx: ignore first request, as second request
-			 * will update tail past first request's workload */
-			cursor->elsp_submitted = req0->elsp_submitted;
-			list_move_tail(&req0->execlist_link,
-				       &engine->execlist_retired_req_list);
-			req0 = cursor;
-		} else {
-			req1 = cursor;
-			WARN_ON(req1->elsp_submitted);
-			break;
-		}
-	}
-
-	if (unlikely(!req0))
+	if (!execlists_pick(engine, &req0, &req1))
 		return;
 
 	if (req0->elsp_submitted & engine->idle_lite_restore_wa) {
@@ -606,43 +703,278 @@ static void intel_lrc_irq_handler(unsigned long data)
 		DRM_ERROR("More than two context complete events?\n");
 }
 
+/*
+ * Put @request on the FIFO of its context's level.  If the context already
+ * has the tail of that FIFO, the new request takes its place instead.
+ */
+static void execlists_enqueue(struct intel_engine_cs *engine,
+			      struct drm_i915_gem_request *request)
+{
+	struct intel_context *ctx = request->ctx;
+	struct list_head *fifo;
+	int level;
+
+	if (ctx->engine[engine->id].queued == 0)
+		ctx->engine[engine->id].queue_level =
+			ctx->priority - I915_CONTEXT_MIN_USER_PRIORITY;
+	level = ctx->engine[engine->id].queue_level;
+	fifo = &engine->execlist_prio[level];
+	request->execlist_queued = jiffies;
+
+	if (!list_empty(fifo)) {
+		struct drm_i915_gem_request *tail_req;
+
+		tail_req = list_last_entry(fifo,
+					   struct drm_i915_gem_request,
+					   execlist_link);
+
+		/*
+		 * Same ctx: the new tail covers the previous request, which
+		 * keeps its place in the queue and its age.
+		 */
+		if (ctx == tail_req->ctx) {
+			request->execlist_queued = tail_req->execlist_queued;
+			list_replace(&tail_req->execlist_link,
+				     &request->execlist_link);
+			list_add_tail(&tail_req->execlist_link,
+				      &engine->execlist_retired_req_list);
+			return;
+		}
+	}
+
+	list_add_tail(&request->execlist_link, fifo);
+	engine->execlist_prio_mask |= 1U << level;
+	ctx->engine[engine->id].queued++;
+}
+
 static void execlists_context_queue(struct drm_i915_gem_request *request)
 {
 	struct intel_engine_cs *engine = request->engine;
-	struct drm_i915_gem_request *cursor;
-	int num_elements = 0;
+	struct intel_context *ctx = request->ctx;
 
-	if (request->ctx != request->i915->kernel_context)
-		intel_lr_context_pin(request->ctx, engine);
+	if (ctx != request->i915->kernel_context)
+		intel_lr_context_pin(ctx, engine);
 
 	i915_gem_request_reference(request);
 
 	spin_lock_bh(&engine->execlist_lock);
 
-	list_for_each_entry(cursor, &engine->execlist_queue, execlist_link)
-		if (++num_elements > 2)
-			break;
+	execlists_enqueue(engine, request);
+	if (list_empty(&engine->execlist_queue))
+		execlists_context_unqueue(engine);
 
-	if (num_elements > 2) {
-		struct drm_i915_gem_request *tail_req;
+	spin_unlock_bh(&engine->execlist_lock);
+}
 
-		tail_req = list_last_entry(&engine->execlist_queue,
-					   struct drm_i915_gem_request,
-					   execlist_link);
+/**
+ * intel_execlists_cancel_requests() - drop all queued execlists requests
+ * @engine: Engine Command Streamer to clean up.
+ *
+ * Moves both the requests owned by the hardware and those still waiting for
+ * an ELSP port to the retired list, e.g. after a GPU reset.
+ */
+void intel_execlists_cancel_requests(struct intel_engine_cs *engine)
+{
+	struct drm_i915_gem_request *req;
+	int level;
+
+	spin_lock_bh(&engine->execlist_lock);
+	/* list_splice_tail_init checks for empty lists */
+	list_splice_tail_init(&engine->execlist_queue,
+			      &engine->execlist_retired_req_list);
+	for (level = 0; level < I915_PRIORITY_LEVELS; level++) {
+		list_for_each_entry(req, &engine->execlist_prio[level],
+				    execlist_link)
+			req->ctx->engine[engine->id].queued = 0;
+		list_splice_tail_init(&engine->execlist_prio[level],
+				      &engine->execlist_retired_req_list);
+	}
+	engine->execlist_prio_mask = 0;
+	spin_unlock_bh(&engine->execlist_lock);
+}
+
+/*
+ * Self-check of the submission queue ordering.  Requests of mock contexts
+ * are queued on a mock engine, then the ports are drained the way context
+ * switch interrupts would drain them, and the order in which requests leave
+ * the ports is compared against the expected one.  Nothing touches the
+ * hardware.
+ */
+#define EXECLISTS_TEST_CTXS	3
+#define EXECLISTS_TEST_REQS	4
+
+struct execlists_test {
+	struct intel_engine_cs *engine;
+	struct intel_context *ctx[EXECLISTS_TEST_CTXS];
+	struct drm_i915_gem_request *req[EXECLISTS_TEST_REQS];
+	int nreq;
+};
+
+static void execlists_test_reset(struct execlists_test *t,
+				 const int *priority)
+{
+	struct intel_engine_cs *engine = t->engine;
+	int i;
+
+	INIT_LIST_HEAD(&engine->execlist_queue);
+	INIT_LIST_HEAD(&engine->execlist_retired_req_list);
+	for (i = 0; i < I915_PRIORITY_LEVELS; i++)
+		INIT_LIST_HEAD(&engine->execlist_prio[i]);
+	engine->execlist_prio_mask = 0;
+
+	for (i = 0; i < EXECLISTS_TEST_CTXS; i++) {
+		t->ctx[i]->priority = priority[i];
+		t->ctx[i]->engine[engine->id].queued = 0;
+	}
+	for (i = 0; i < EXECLISTS_TEST_REQS; i++)
+		memset(t->req[i], 0, sizeof(*t->req[i]));
+	t->nreq = 0;
+}
 
-		if (request->ctx == tail_req->ctx) {
-			WARN(tail_req->elsp_submitted != 0,
-				"More than 2 already-submitted reqs queued\n");
-			list_move_tail(&tail_req->execlist_link,
-				       &engine->execlist_retired_req_list);
+/* Queue request @label of context @ctx, @age_ms old */
+static void execlists_test_queue(struct execlists_test *t, int ctx,
+				 u32 label, unsigned int age_ms)
+{
+	struct drm_i915_gem_request *req = t->req[t->nreq++];
+
+	req->ctx = t->ctx[ctx];
+	req->seqno = label;
+	INIT_LIST_HEAD(&req->execlist_link);
+	execlists_enqueue(t->engine, req);
+	req->execlist_queued -= msecs_to_jiffies(age_ms);
+}
+
+/* Let the mock hardware complete everything, checking the order */
+static int execlists_test_drain(struct execlists_test *t, const char *name,
+				const u32 *expect, int count)
+{
+	struct drm_i915_gem_request *req0, *req1, *head;
+	int i = 0;
+
+	for (;;) {
+		execlists_pick(t->engine, &req0, &req1);
+		head = list_first_entry_or_null(&t->engine->execlist_queue,
+						struct drm_i915_gem_request,
+						execlist_link);
+		if (head == NULL)
+			break;
+		list_del_init(&head->execlist_link);
+
+		if (i == count || head->seqno != expect[i]) {
+			DRM_ERROR("execlists selftest %s: request %u "
+				  "completed as #%d\n", name, head->seqno, i);
+			return -EINVAL;
 		}
+		i++;
 	}
 
-	list_add_tail(&request->execlist_link, &engine->execlist_queue);
-	if (num_elements == 0)
-		execlists_context_unqueue(engine);
+	if (i != count || t->engine->execlist_prio_mask != 0) {
+		DRM_ERROR("execlists selftest %s: %d of %d requests completed\n",
+			  name, i, count);
+		return -EINVAL;
+	}
 
-	spin_unlock_bh(&engine->execlist_lock);
+	return 0;
+}
+
+static int execlists_test_run(struct execlists_test *t)
+{
+	static const int flat[] = { 0, 0, 0 };
+	static const int mixed[] = { 0, 2, -1 };
+	static const int aged[] = { 0, 3, -3 };
+	static const int sticky[] = { 0, 1, 0 };
+	static const u32 mixed_order[] = { 3, 1, 2 };
+	static const u32 interleaved_order[] = { 1, 2, 3 };
+	static const u32 folded_order[] = { 2 };
+	static const u32 running_order[] = { 2, 3 };
+	static const u32 aged_order[] = { 2, 1 };
+	static const u32 sticky_order[] = { 2, 3 };
+	struct drm_i915_gem_request *req0, *req1;
+	int ret;
+
+	/* Higher priority first, FIFO otherwise */
+	execlists_test_reset(t, mixed);
+	execlists_test_queue(t, 0, 1, 0);
+	execlists_test_queue(t, 2, 2, 0);
+	execlists_test_queue(t, 1, 3, 0);
+	ret = execlists_test_drain(t, "priority", mixed_order, 3);
+	if (ret)
+		return ret;
+
+	/* A context's later request never overtakes its earlier one */
+	execlists_test_reset(t, flat);
+	execlists_test_queue(t, 0, 1, 0);
+	execlists_test_queue(t, 1, 2, 0);
+	execlists_test_queue(t, 0, 3, 0);
+	ret = execlists_test_drain(t, "interleaved", interleaved_order, 3);
+	if (ret)
+		return ret;
+
+	/* Back to back requests of one context fold into the last one */
+	execlists_test_reset(t, flat);
+	execlists_test_queue(t, 0, 1, 0);
+	execlists_test_queue(t, 0, 2, 0);
+	ret = execlists_test_drain(t, "folded", folded_order, 1);
+	if (ret)
+		return ret;
+
+	/* The running context picks up its new requests when resubmitted */
+	execlists_test_reset(t, flat);
+	execlists_test_queue(t, 0, 1, 0);
+	execlists_pick(t->engine, &req0, &req1);
+	execlists_test_queue(t, 0, 2, 0);
+	execlists_test_queue(t, 1, 3, 0);
+	ret = execlists_test_drain(t, "running", running_order, 2);
+	if (ret)
+		return ret;
+
+	/* A low priority request ages past a fresh high priority one */
+	execlists_test_reset(t, aged);
+	execlists_test_queue(t, 1, 1, 0);
+	execlists_test_queue(t, 2, 2, 10 * EXECLISTS_AGE_MS);
+	ret = execlists_test_drain(t, "aging", aged_order, 2);
+	if (ret)
+		return ret;
+
+	/* Pending requests keep the level they were queued at */
+	execlists_test_reset(t, sticky);
+	execlists_test_queue(t, 0, 1, 0);
+	execlists_test_queue(t, 1, 2, 0);
+	t->ctx[0]->priority = I915_CONTEXT_MAX_USER_PRIORITY;
+	execlists_test_queue(t, 0, 3, 0);
+	return execlists_test_drain(t, "sticky", sticky_order, 2);
+}
+
+int intel_execlists_selftest(struct drm_i915_private *dev_priv)
+{
+	struct execlists_test t;
+	int i, ret = -ENOMEM;
+
+	memset(&t, 0, sizeof(t));
+	t.engine = kzalloc(sizeof(*t.engine), GFP_KERNEL);
+	if (t.engine == NULL)
+		goto out;
+	for (i = 0; i < EXECLISTS_TEST_CTXS; i++) {
+		t.ctx[i] = kzalloc(sizeof(*t.ctx[i]), GFP_KERNEL);
+		if (t.ctx[i] == NULL)
+			goto out;
+	}
+	for (i = 0; i < EXECLISTS_TEST_REQS; i++) {
+		t.req[i] = kzalloc(sizeof(*t.req[i]), GFP_KERNEL);
+		if (t.req[i] == NULL)
+			goto out;
+	}
+
+	ret = execlists_test_run(&t);
+	if (ret == 0)
+		DRM_INFO("execlists selftest passed\n");
+out:
+	for (i = 0; i < EXECLISTS_TEST_REQS; i++)
+		kfree(t.req[i]);
+	for (i = 0; i < EXECLISTS_TEST_CTXS; i++)
+		kfree(t.ctx[i]);
+	kfree(t.engine);
+	return ret;
 }
 
 static int logical_ring_invalidate_all_caches(struct drm_i915_gem_request *req)
@@ -2038,7 +2370,7 @@ logical_ring_init(struct drm_device *dev, struct intel_engine_cs *engine)
 	struct drm_i915_private *dev_priv = to_i915(dev);
 	struct intel_context *dctx = dev_priv->kernel_context;
 	enum forcewake_domains fw_domains;
-	int ret;
+	int i, ret;
 
 	/* Intentionally left blank. */
 	engine->buffer = NULL;
@@ -2051,6 +2383,9 @@ logical_ring_init(struct drm_device *dev, struct intel_engine_cs *engine)
 
 	INIT_LIST_HEAD(&engine->buffers);
 	INIT_LIST_HEAD(&engine->execlist_queue);
+	for (i = 0; i < I915_PRIORITY_LEVELS; i++)
+		INIT_LIST_HEAD(&engine->execlist_prio[i]);
+	engine->execlist_prio_mask = 0;
 	INIT_LIST_HEAD(&engine->execlist_retired_req_list);
 	lockinit(&engine->execlist_lock, "i915el", 0, LK_CANRECURSE);
 
@@ -124,5 +124,7 @@ int intel_execlists_submission(struct i915_execbuffer_params *params,
 			       struct list_head *vmas);
 
 void intel_execlists_retire_requests(struct intel_engine_cs *engine);
+void intel_execlists_cancel_requests(struct intel_engine_cs *engine);
+int intel_execlists_selftest(struct drm_i915_private *dev_priv);
 
 #endif /* _INTEL_LRC_H_ */
@@ -4,8 +4,6 @@
 #include <linux/hashtable.h>
 #include "i915_gem_batch_pool.h"
 
-#define I915_CMD_HASH_ORDER 9
-
 /* Early gen2 devices have a cacheline of just 32 bytes, using 64 is overkill,
  * but keeps the logic simple. Indeed, the whole purpose of this macro is just
  * to give some inclination as to some of the magic values used in the various
@@ -123,6 +121,10 @@ struct intel_ringbuffer {
 struct	intel_context;
 struct drm_i915_reg_table;
 
+/* One execlists submission queue per I915_CONTEXT_PARAM_PRIORITY value */
+#define I915_PRIORITY_LEVELS \
+	(I915_CONTEXT_MAX_USER_PRIORITY - I915_CONTEXT_MIN_USER_PRIORITY + 1)
+
 /*
  * we use a single page to load ctx workarounds so all of these
  * values are referred in terms of dwords
@@ -172,6 +174,8 @@ struct  intel_engine_cs {
 	struct i915_ctx_workarounds wa_ctx;
 
 	unsigned irq_refcount; /* protected by dev_priv->irq_lock */
+	u_long spin_hits;	/* waits satisfied by __i915_spin_request */
+	u_long spin_misses;
 	u32		irq_enable_mask;	/* bitmask to enable ring interrupt */
 	struct drm_i915_gem_request *trace_irq_req;
 	bool __must_check (*irq_get)(struct intel_engine_cs *ring);
@@ -268,6 +272,8 @@ struct  intel_engine_cs {
 	struct tasklet_struct irq_tasklet;
 	struct lock execlist_lock;	/* used inside tasklet, use spin_lock_bh */
 	struct list_head execlist_queue;
+	struct list_head execlist_prio[I915_PRIORITY_LEVELS];
+	unsigned int execlist_prio_mask;
 	struct list_head execlist_retired_req_list;
 	unsigned int fw_domains;
 	unsigned int next_context_status_buffer;
@@ -325,16 +331,18 @@ struct  intel_engine_cs {
 	bool needs_cmd_parser;
 
 	/*
-	 * Table of commands the command parser needs to know about
+	 * Index of the commands the command parser needs to know about
 	 * for this ring.
 	 */
-	DECLARE_HASHTABLE(cmd_hash, I915_CMD_HASH_ORDER);
+	struct i915_cmd_index *cmd_index;
 
 	/*
-	 * Table of registers allowed in commands that read/write registers.
+	 * Table of registers allowed in commands that read/write registers,
+	 * and its sorted lookup index for non-master and master clients.
 	 */
 	const struct drm_i915_reg_table *reg_tables;
 	int reg_table_count;
+	struct i915_reg_index *reg_index[2];
 
 	/*
 	 * Returns the bitmask for the length field of the specified command.
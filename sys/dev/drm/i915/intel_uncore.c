@@ -578,7 +578,8 @@ void assert_forcewakes_inactive(struct drm_i915_private *dev_priv)
 }
 
 /* We give fast paths for the really cool registers */
-#define NEEDS_FORCE_WAKE(reg) ((reg) < 0x40000)
+#define FW_RANGE_END 0x40000
+#define NEEDS_FORCE_WAKE(reg) ((reg) < FW_RANGE_END)
 
 #define __gen6_reg_read_fw_domains(offset) \
 ({ \
@@ -590,30 +591,68 @@ void assert_forcewakes_inactive(struct drm_i915_private *dev_priv)
 	__fwd; \
 })
 
-#define REG_RANGE(reg, start, end) ((reg) >= (start) && (reg) < (end))
+struct intel_forcewake_range {
+	u32 start;
+	u32 end;
+	enum forcewake_domains domains;
+};
 
-#define FORCEWAKE_VLV_RENDER_RANGE_OFFSET(reg) \
-	(REG_RANGE((reg), 0x2000, 0x4000) || \
-	 REG_RANGE((reg), 0x5000, 0x8000) || \
-	 REG_RANGE((reg), 0xB000, 0x12000) || \
-	 REG_RANGE((reg), 0x2E000, 0x30000))
+#define GEN_FW_RANGE(s, e, d) \
+	{ .start = (s), .end = (e), .domains = (d) }
 
-#define FORCEWAKE_VLV_MEDIA_RANGE_OFFSET(reg) \
-	(REG_RANGE((reg), 0x12000, 0x14000) || \
-	 REG_RANGE((reg), 0x22000, 0x24000) || \
-	 REG_RANGE((reg), 0x30000, 0x40000))
+/*
+ * Per-platform forcewake ranges, sorted by offset. Offsets below
+ * NEEDS_FORCE_WAKE() which are not covered by any range take the default
+ * domains passed to intel_uncore_fw_ranges_init() for the platform.
+ */
+static const struct intel_forcewake_range __vlv_fw_ranges[] = {
+	GEN_FW_RANGE(0x2000, 0x4000, FORCEWAKE_RENDER),
+	GEN_FW_RANGE(0x5000, 0x8000, FORCEWAKE_RENDER),
+	GEN_FW_RANGE(0xB000, 0x12000, FORCEWAKE_RENDER),
+	GEN_FW_RANGE(0x12000, 0x14000, FORCEWAKE_MEDIA),
+	GEN_FW_RANGE(0x22000, 0x24000, FORCEWAKE_MEDIA),
+	GEN_FW_RANGE(0x2E000, 0x30000, FORCEWAKE_RENDER),
+	GEN_FW_RANGE(0x30000, 0x40000, FORCEWAKE_MEDIA),
+};
 
-#define __vlv_reg_read_fw_domains(offset) \
-({ \
-	enum forcewake_domains __fwd = 0; \
-	if (!NEEDS_FORCE_WAKE(offset)) \
-		__fwd = 0; \
-	else if (FORCEWAKE_VLV_RENDER_RANGE_OFFSET(offset)) \
-		__fwd = FORCEWAKE_RENDER; \
-	else if (FORCEWAKE_VLV_MEDIA_RANGE_OFFSET(offset)) \
-		__fwd = FORCEWAKE_MEDIA; \
-	__fwd; \
-})
+static const struct intel_forcewake_range __chv_fw_ranges[] = {
+	GEN_FW_RANGE(0x2000, 0x4000, FORCEWAKE_RENDER),
+	GEN_FW_RANGE(0x4000, 0x5000, FORCEWAKE_RENDER | FORCEWAKE_MEDIA),
+	GEN_FW_RANGE(0x5200, 0x8000, FORCEWAKE_RENDER),
+	GEN_FW_RANGE(0x8000, 0x8300, FORCEWAKE_RENDER | FORCEWAKE_MEDIA),
+	GEN_FW_RANGE(0x8300, 0x8500, FORCEWAKE_RENDER),
+	GEN_FW_RANGE(0x8500, 0x8600, FORCEWAKE_RENDER | FORCEWAKE_MEDIA),
+	GEN_FW_RANGE(0x8800, 0x8900, FORCEWAKE_MEDIA),
+	GEN_FW_RANGE(0x9000, 0xB000, FORCEWAKE_RENDER | FORCEWAKE_MEDIA),
+	GEN_FW_RANGE(0xB000, 0xB480, FORCEWAKE_RENDER),
+	GEN_FW_RANGE(0xD000, 0xD800, FORCEWAKE_MEDIA),
+	GEN_FW_RANGE(0xE000, 0xE800, FORCEWAKE_RENDER),
+	GEN_FW_RANGE(0xF000, 0x10000, FORCEWAKE_RENDER | FORCEWAKE_MEDIA),
+	GEN_FW_RANGE(0x12000, 0x14000, FORCEWAKE_MEDIA),
+	GEN_FW_RANGE(0x1A000, 0x1C000, FORCEWAKE_MEDIA),
+	GEN_FW_RANGE(0x1E800, 0x1EA00, FORCEWAKE_MEDIA),
+	GEN_FW_RANGE(0x30000, 0x38000, FORCEWAKE_MEDIA),
+};
+
+static const struct intel_forcewake_range __gen9_fw_ranges[] = {
+	GEN_FW_RANGE(0xB00, 0x2000, 0), /* uncore */
+	GEN_FW_RANGE(0x2000, 0x2700, FORCEWAKE_RENDER),
+	GEN_FW_RANGE(0x3000, 0x4000, FORCEWAKE_RENDER),
+	GEN_FW_RANGE(0x5200, 0x8000, FORCEWAKE_RENDER),
+	GEN_FW_RANGE(0x8130, 0x8140, FORCEWAKE_MEDIA),
+	GEN_FW_RANGE(0x8140, 0x8160, FORCEWAKE_RENDER),
+	GEN_FW_RANGE(0x8300, 0x8500, FORCEWAKE_RENDER),
+	GEN_FW_RANGE(0x8800, 0x8A00, FORCEWAKE_MEDIA),
+	GEN_FW_RANGE(0x8C00, 0x8D00, FORCEWAKE_RENDER),
+	GEN_FW_RANGE(0x9400, 0x9800, FORCEWAKE_RENDER | FORCEWAKE_MEDIA),
+	GEN_FW_RANGE(0xB000, 0xB480, FORCEWAKE_RENDER),
+	GEN_FW_RANGE(0xD000, 0xD800, FORCEWAKE_MEDIA),
+	GEN_FW_RANGE(0xE000, 0xE900, FORCEWAKE_RENDER),
+	GEN_FW_RANGE(0x12000, 0x14000, FORCEWAKE_MEDIA),
+	GEN_FW_RANGE(0x1A000, 0x1EA00, FORCEWAKE_MEDIA),
+	GEN_FW_RANGE(0x24400, 0x24800, FORCEWAKE_RENDER),
+	GEN_FW_RANGE(0x30000, 0x40000, FORCEWAKE_MEDIA),
+};
 
 static const i915_reg_t gen8_shadowed_regs[] = {
 	GEN6_RPNSWREQ,
@@ -625,127 +664,6 @@ static const i915_reg_t gen8_shadowed_regs[] = {
 	/* TODO: Other registers are not yet used */
 };
 
-static bool is_gen8_shadowed(u32 offset)
-{
-	int i;
-	for (i = 0; i < ARRAY_SIZE(gen8_shadowed_regs); i++)
-		if (offset == gen8_shadowed_regs[i].reg)
-			return true;
-
-	return false;
-}
-
-#define __gen8_reg_write_fw_domains(offset) \
-({ \
-	enum forcewake_domains __fwd; \
-	if (NEEDS_FORCE_WAKE(offset) && !is_gen8_shadowed(offset)) \
-		__fwd = FORCEWAKE_RENDER; \
-	else \
-		__fwd = 0; \
-	__fwd; \
-})
-
-#define FORCEWAKE_CHV_RENDER_RANGE_OFFSET(reg) \
-	(REG_RANGE((reg), 0x2000, 0x4000) || \
-	 REG_RANGE((reg), 0x5200, 0x8000) || \
-	 REG_RANGE((reg), 0x8300, 0x8500) || \
-	 REG_RANGE((reg), 0xB000, 0xB480) || \
-	 REG_RANGE((reg), 0xE000, 0xE800))
-
-#define FORCEWAKE_CHV_MEDIA_RANGE_OFFSET(reg) \
-	(REG_RANGE((reg), 0x8800, 0x8900) || \
-	 REG_RANGE((reg), 0xD000, 0xD800) || \
-	 REG_RANGE((reg), 0x12000, 0x14000) || \
-	 REG_RANGE((reg), 0x1A000, 0x1C000) || \
-	 REG_RANGE((reg), 0x1E800, 0x1EA00) || \
-	 REG_RANGE((reg), 0x30000, 0x38000))
-
-#define FORCEWAKE_CHV_COMMON_RANGE_OFFSET(reg) \
-	(REG_RANGE((reg), 0x4000, 0x5000) || \
-	 REG_RANGE((reg), 0x8000, 0x8300) || \
-	 REG_RANGE((reg), 0x8500, 0x8600) || \
-	 REG_RANGE((reg), 0x9000, 0xB000) || \
-	 REG_RANGE((reg), 0xF000, 0x10000))
-
-#define __chv_reg_read_fw_domains(offset) \
-({ \
-	enum forcewake_domains __fwd = 0; \
-	if (!NEEDS_FORCE_WAKE(offset)) \
-		__fwd = 0; \
-	else if (FORCEWAKE_CHV_RENDER_RANGE_OFFSET(offset)) \
-		__fwd = FORCEWAKE_RENDER; \
-	else if (FORCEWAKE_CHV_MEDIA_RANGE_OFFSET(offset)) \
-		__fwd = FORCEWAKE_MEDIA; \
-	else if (FORCEWAKE_CHV_COMMON_RANGE_OFFSET(offset)) \
-		__fwd = FORCEWAKE_RENDER | FORCEWAKE_MEDIA; \
-	__fwd; \
-})
-
-#define __chv_reg_write_fw_domains(offset) \
-({ \
-	enum forcewake_domains __fwd = 0; \
-	if (!NEEDS_FORCE_WAKE(offset) || is_gen8_shadowed(offset)) \
-		__fwd = 0; \
-	else if (FORCEWAKE_CHV_RENDER_RANGE_OFFSET(offset)) \
-		__fwd = FORCEWAKE_RENDER; \
-	else if (FORCEWAKE_CHV_MEDIA_RANGE_OFFSET(offset)) \
-		__fwd = FORCEWAKE_MEDIA; \
-	else if (FORCEWAKE_CHV_COMMON_RANGE_OFFSET(offset)) \
-		__fwd = FORCEWAKE_RENDER | FORCEWAKE_MEDIA; \
-	__fwd; \
-})
-
-#define FORCEWAKE_GEN9_UNCORE_RANGE_OFFSET(reg) \
-	REG_RANGE((reg), 0xB00,  0x2000)
-
-#define FORCEWAKE_GEN9_RENDER_RANGE_OFFSET(reg) \
-	(REG_RANGE((reg), 0x2000, 0x2700) || \
-	 REG_RANGE((reg), 0x3000, 0x4000) || \
-	 REG_RANGE((reg), 0x5200, 0x8000) || \
-	 REG_RANGE((reg), 0x8140, 0x8160) || \
-	 REG_RANGE((reg), 0x8300, 0x8500) || \
-	 REG_RANGE((reg), 0x8C00, 0x8D00) || \
-	 REG_RANGE((reg), 0xB000, 0xB480) || \
-	 REG_RANGE((reg), 0xE000, 0xE900) || \
-	 REG_RANGE((reg), 0x24400, 0x24800))
-
-#define FORCEWAKE_GEN9_MEDIA_RANGE_OFFSET(reg) \
-	(REG_RANGE((reg), 0x8130, 0x8140) || \
-	 REG_RANGE((reg), 0x8800, 0x8A00) || \
-	 REG_RANGE((reg), 0xD000, 0xD800) || \
-	 REG_RANGE((reg), 0x12000, 0x14000) || \
-	 REG_RANGE((reg), 0x1A000, 0x1EA00) || \
-	 REG_RANGE((reg), 0x30000, 0x40000))
-
-#define FORCEWAKE_GEN9_COMMON_RANGE_OFFSET(reg) \
-	REG_RANGE((reg), 0x9400, 0x9800)
-
-#define FORCEWAKE_GEN9_BLITTER_RANGE_OFFSET(reg) \
-	((reg) < 0x40000 && \
-	 !FORCEWAKE_GEN9_UNCORE_RANGE_OFFSET(reg) && \
-	 !FORCEWAKE_GEN9_RENDER_RANGE_OFFSET(reg) && \
-	 !FORCEWAKE_GEN9_MEDIA_RANGE_OFFSET(reg) && \
-	 !FORCEWAKE_GEN9_COMMON_RANGE_OFFSET(reg))
-
-#define SKL_NEEDS_FORCE_WAKE(reg) \
-	((reg) < 0x40000 && !FORCEWAKE_GEN9_UNCORE_RANGE_OFFSET(reg))
-
-#define __gen9_reg_read_fw_domains(offset) \
-({ \
-	enum forcewake_domains __fwd; \
-	if (!SKL_NEEDS_FORCE_WAKE(offset)) \
-		__fwd = 0; \
-	else if (FORCEWAKE_GEN9_RENDER_RANGE_OFFSET(offset)) \
-		__fwd = FORCEWAKE_RENDER; \
-	else if (FORCEWAKE_GEN9_MEDIA_RANGE_OFFSET(offset)) \
-		__fwd = FORCEWAKE_MEDIA; \
-	else if (FORCEWAKE_GEN9_COMMON_RANGE_OFFSET(offset)) \
-		__fwd = FORCEWAKE_RENDER | FORCEWAKE_MEDIA; \
-	else \
-		__fwd = FORCEWAKE_BLITTER; \
-	__fwd; \
-})
-
 static const i915_reg_t gen9_shadowed_regs[] = {
 	RING_TAIL(RENDER_RING_BASE),
 	RING_TAIL(GEN6_BSD_RING_BASE),
@@ -756,29 +674,155 @@ static const i915_reg_t gen9_shadowed_regs[] = {
 	/* TODO: Other registers are not yet used */
 };
 
-static bool is_gen9_shadowed(u32 offset)
+static enum forcewake_domains
+fw_range_domains(const struct intel_forcewake_range *ranges, int num_ranges,
+		 enum forcewake_domains default_domains, u32 offset)
 {
 	int i;
-	for (i = 0; i < ARRAY_SIZE(gen9_shadowed_regs); i++)
-		if (offset == gen9_shadowed_regs[i].reg)
+
+	for (i = 0; i < num_ranges; i++)
+		if (offset >= ranges[i].start && offset < ranges[i].end)
+			return ranges[i].domains;
+
+	return default_domains;
+}
+
+static bool
+fw_range_shadowed(const i915_reg_t *shadowed, int num_shadowed, u32 offset)
+{
+	int i;
+
+	for (i = 0; i < num_shadowed; i++) {
+		u32 reg = i915_mmio_reg_offset(shadowed[i]);
+
+		if (offset >= reg && offset < reg + sizeof(u32))
 			return true;
+	}
 
 	return false;
 }
 
-#define __gen9_reg_write_fw_domains(offset) \
+/* The lowest offset above @offset at which the forcewake domains can change */
+static u32
+fw_range_next(const struct intel_forcewake_range *ranges, int num_ranges,
+	      const i915_reg_t *shadowed, int num_shadowed, u32 offset)
+{
+	u32 next = FW_RANGE_END;
+	int i;
+
+	for (i = 0; i < num_ranges; i++) {
+		if (ranges[i].start > offset)
+			next = min(next, ranges[i].start);
+		if (ranges[i].end > offset)
+			next = min(next, ranges[i].end);
+	}
+
+	for (i = 0; i < num_shadowed; i++) {
+		u32 reg = i915_mmio_reg_offset(shadowed[i]);
+
+		if (reg > offset)
+			next = min_t(u32, next, reg);
+		if (reg + sizeof(u32) > offset)
+			next = min_t(u32, next, reg + sizeof(u32));
+	}
+
+	return next;
+}
+
+/*
+ * Flatten the platform ranges, the default domains and the shadowed
+ * registers into a single gap-free table covering every offset which needs
+ * forcewake, so that each MMIO access costs one binary search. Shadowed
+ * registers show up as their own entries which need no forcewake for writes.
+ */
+static void
+intel_uncore_fw_ranges_init(struct drm_i915_private *dev_priv,
+			    const struct intel_forcewake_range *ranges,
+			    int num_ranges,
+			    enum forcewake_domains default_domains,
+			    const i915_reg_t *shadowed,
+			    int num_shadowed)
+{
+	struct intel_uncore *uncore = &dev_priv->uncore;
+	struct intel_uncore_fw_range *entry;
+	u32 offset;
+	int i;
+
+	for (i = 1; i < num_ranges; i++)
+		WARN_ON(ranges[i].start < ranges[i - 1].end);
+
+	uncore->fw_range_count = 0;
+
+	for (offset = 0; offset < FW_RANGE_END;
+	     offset = fw_range_next(ranges, num_ranges,
+				    shadowed, num_shadowed, offset)) {
+		enum forcewake_domains read, write;
+
+		read = fw_range_domains(ranges, num_ranges,
+					default_domains, offset);
+		write = read;
+		if (fw_range_shadowed(shadowed, num_shadowed, offset))
+			write = 0;
+
+		if (uncore->fw_range_count) {
+			entry = &uncore->fw_range[uncore->fw_range_count - 1];
+			if (entry->read_domains == read &&
+			    entry->write_domains == write)
+				continue;
+		}
+
+		if (WARN_ON(uncore->fw_range_count ==
+			    ARRAY_SIZE(uncore->fw_range))) {
+			/* Waking up everything is always safe, just slow */
+			entry = &uncore->fw_range[0];
+			entry->start = 0;
+			entry->read_domains = uncore->fw_domains;
+			entry->write_domains = uncore->fw_domains;
+			uncore->fw_range_count = 1;
+			return;
+		}
+
+		entry = &uncore->fw_range[uncore->fw_range_count++];
+		entry->start = offset;
+		entry->read_domains = read;
+		entry->write_domains = write;
+	}
+}
+
+static inline const struct intel_uncore_fw_range *
+find_fw_range(const struct drm_i915_private *dev_priv, u32 offset)
+{
+	const struct intel_uncore_fw_range *range = dev_priv->uncore.fw_range;
+	unsigned int count = dev_priv->uncore.fw_range_count;
+
+	/*
+	 * The table starts at offset 0 and has no holes, so we are looking
+	 * for the last entry starting at or below @offset.
+	 */
+	while (count > 1) {
+		unsigned int half = count / 2;
+
+		if (range[half].start <= offset)
+			range += half;
+		count -= half;
+	}
+
+	return range;
+}
+
+#define __fwtable_reg_read_fw_domains(offset) \
 ({ \
-	enum forcewake_domains __fwd; \
-	if (!SKL_NEEDS_FORCE_WAKE(offset) || is_gen9_shadowed(offset)) \
-		__fwd = 0; \
-	else if (FORCEWAKE_GEN9_RENDER_RANGE_OFFSET(offset)) \
-		__fwd = FORCEWAKE_RENDER; \
-	else if (FORCEWAKE_GEN9_MEDIA_RANGE_OFFSET(offset)) \
-		__fwd = FORCEWAKE_MEDIA; \
-	else if (FORCEWAKE_GEN9_COMMON_RANGE_OFFSET(offset)) \
-		__fwd = FORCEWAKE_RENDER | FORCEWAKE_MEDIA; \
-	else \
-		__fwd = FORCEWAKE_BLITTER; \
+	enum forcewake_domains __fwd = 0; \
+	if (NEEDS_FORCE_WAKE(offset)) \
+		__fwd = find_fw_range(dev_priv, offset)->read_domains; \
+	__fwd; \
+})
+
+#define __fwtable_reg_write_fw_domains(offset) \
+({ \
+	enum forcewake_domains __fwd = 0; \
+	if (NEEDS_FORCE_WAKE(offset)) \
+		__fwd = find_fw_range(dev_priv, offset)->write_domains; \
 	__fwd; \
 })
 
@@ -905,62 +949,28 @@ gen6_read##x(struct drm_i915_private *dev_priv, i915_reg_t reg, bool trace) { \
 	GEN6_READ_FOOTER; \
 }
 
-#define __vlv_read(x) \
+#define __fwtable_read(x) \
 static u##x \
-vlv_read##x(struct drm_i915_private *dev_priv, i915_reg_t reg, bool trace) { \
+fwtable_read##x(struct drm_i915_private *dev_priv, i915_reg_t reg, bool trace) { \
 	enum forcewake_domains fw_engine; \
 	GEN6_READ_HEADER(x); \
-	fw_engine = __vlv_reg_read_fw_domains(offset); \
+	fw_engine = __fwtable_reg_read_fw_domains(offset); \
 	if (fw_engine) \
 		__force_wake_auto(dev_priv, fw_engine); \
 	val = __raw_i915_read##x(dev_priv, reg); \
 	GEN6_READ_FOOTER; \
 }
 
-#define __chv_read(x) \
-static u##x \
-chv_read##x(struct drm_i915_private *dev_priv, i915_reg_t reg, bool trace) { \
-	enum forcewake_domains fw_engine; \
-	GEN6_READ_HEADER(x); \
-	fw_engine = __chv_reg_read_fw_domains(offset); \
-	if (fw_engine) \
-		__force_wake_auto(dev_priv, fw_engine); \
-	val = __raw_i915_read##x(dev_priv, reg); \
-	GEN6_READ_FOOTER; \
-}
-
-#define __gen9_read(x) \
-static u##x \
-gen9_read##x(struct drm_i915_private *dev_priv, i915_reg_t reg, bool trace) { \
-	enum forcewake_domains fw_engine; \
-	GEN6_READ_HEADER(x); \
-	fw_engine = __gen9_reg_read_fw_domains(offset); \
-	if (fw_engine) \
-		__force_wake_auto(dev_priv, fw_engine); \
-	val = __raw_i915_read##x(dev_priv, reg); \
-	GEN6_READ_FOOTER; \
-}
-
-__gen9_read(8)
-__gen9_read(16)
-__gen9_read(32)
-__gen9_read(64)
-__chv_read(8)
-__chv_read(16)
-__chv_read(32)
-__chv_read(64)
-__vlv_read(8)
-__vlv_read(16)
-__vlv_read(32)
-__vlv_read(64)
+__fwtable_read(8)
+__fwtable_read(16)
+__fwtable_read(32)
+__fwtable_read(64)
 __gen6_read(8)
 __gen6_read(16)
 __gen6_read(32)
 __gen6_read(64)
 
-#undef __gen9_read
-#undef __chv_read
-#undef __vlv_read
+#undef __fwtable_read
 #undef __gen6_read
 #undef GEN6_READ_FOOTER
 #undef GEN6_READ_HEADER
@@ -1073,55 +1083,22 @@ hsw_write##x(struct drm_i915_private *dev_priv, i915_reg_t reg, u##x val, bool t
 	GEN6_WRITE_FOOTER; \
 }
 
-#define __gen8_write(x) \
-static void \
-gen8_write##x(struct drm_i915_private *dev_priv, i915_reg_t reg, u##x val, bool trace) { \
-	enum forcewake_domains fw_engine; \
-	GEN6_WRITE_HEADER; \
-	fw_engine = __gen8_reg_write_fw_domains(offset); \
-	if (fw_engine) \
-		__force_wake_auto(dev_priv, fw_engine); \
-	__raw_i915_write##x(dev_priv, reg, val); \
-	GEN6_WRITE_FOOTER; \
-}
-
-#define __chv_write(x) \
-static void \
-chv_write##x(struct drm_i915_private *dev_priv, i915_reg_t reg, u##x val, bool trace) { \
-	enum forcewake_domains fw_engine; \
-	GEN6_WRITE_HEADER; \
-	fw_engine = __chv_reg_write_fw_domains(offset); \
-	if (fw_engine) \
-		__force_wake_auto(dev_priv, fw_engine); \
-	__raw_i915_write##x(dev_priv, reg, val); \
-	GEN6_WRITE_FOOTER; \
-}
-
-#define __gen9_write(x) \
+#define __fwtable_write(x) \
 static void \
-gen9_write##x(struct drm_i915_private *dev_priv, i915_reg_t reg, u##x val, \
-		bool trace) { \
+fwtable_write##x(struct drm_i915_private *dev_priv, i915_reg_t reg, u##x val, bool trace) { \
 	enum forcewake_domains fw_engine; \
 	GEN6_WRITE_HEADER; \
-	fw_engine = __gen9_reg_write_fw_domains(offset); \
+	fw_engine = __fwtable_reg_write_fw_domains(offset); \
 	if (fw_engine) \
 		__force_wake_auto(dev_priv, fw_engine); \
 	__raw_i915_write##x(dev_priv, reg, val); \
 	GEN6_WRITE_FOOTER; \
 }
 
-__gen9_write(8)
-__gen9_write(16)
-__gen9_write(32)
-__gen9_write(64)
-__chv_write(8)
-__chv_write(16)
-__chv_write(32)
-__chv_write(64)
-__gen8_write(8)
-__gen8_write(16)
-__gen8_write(32)
-__gen8_write(64)
+__fwtable_write(8)
+__fwtable_write(16)
+__fwtable_write(32)
+__fwtable_write(64)
 __hsw_write(8)
 __hsw_write(16)
 __hsw_write(32)
@@ -1131,9 +1108,7 @@ __gen6_write(16)
 __gen6_write(32)
 __gen6_write(64)
 
-#undef __gen9_write
-#undef __chv_write
-#undef __gen8_write
+#undef __fwtable_write
 #undef __hsw_write
 #undef __gen6_write
 #undef GEN6_WRITE_FOOTER
@@ -1342,16 +1317,33 @@ void intel_uncore_init(struct drm_device *dev)
 	switch (INTEL_INFO(dev)->gen) {
 	default:
 	case 9:
-		ASSIGN_WRITE_MMIO_VFUNCS(gen9);
-		ASSIGN_READ_MMIO_VFUNCS(gen9);
+		intel_uncore_fw_ranges_init(dev_priv,
+					    __gen9_fw_ranges,
+					    ARRAY_SIZE(__gen9_fw_ranges),
+					    FORCEWAKE_BLITTER,
+					    gen9_shadowed_regs,
+					    ARRAY_SIZE(gen9_shadowed_regs));
+		ASSIGN_WRITE_MMIO_VFUNCS(fwtable);
+		ASSIGN_READ_MMIO_VFUNCS(fwtable);
 		break;
 	case 8:
 		if (IS_CHERRYVIEW(dev)) {
-			ASSIGN_WRITE_MMIO_VFUNCS(chv);
-			ASSIGN_READ_MMIO_VFUNCS(chv);
+			intel_uncore_fw_ranges_init(dev_priv,
+						    __chv_fw_ranges,
+						    ARRAY_SIZE(__chv_fw_ranges),
+						    0,
+						    gen8_shadowed_regs,
+						    ARRAY_SIZE(gen8_shadowed_regs));
+			ASSIGN_WRITE_MMIO_VFUNCS(fwtable);
+			ASSIGN_READ_MMIO_VFUNCS(fwtable);
 
 		} else {
-			ASSIGN_WRITE_MMIO_VFUNCS(gen8);
+			intel_uncore_fw_ranges_init(dev_priv,
+						    NULL, 0,
+						    FORCEWAKE_RENDER,
+						    gen8_shadowed_regs,
+						    ARRAY_SIZE(gen8_shadowed_regs));
+			ASSIGN_WRITE_MMIO_VFUNCS(fwtable);
 			ASSIGN_READ_MMIO_VFUNCS(gen6);
 		}
 		break;
@@ -1364,7 +1356,11 @@ void intel_uncore_init(struct drm_device *dev)
 		}
 
 		if (IS_VALLEYVIEW(dev)) {
-			ASSIGN_READ_MMIO_VFUNCS(vlv);
+			intel_uncore_fw_ranges_init(dev_priv,
+						    __vlv_fw_ranges,
+						    ARRAY_SIZE(__vlv_fw_ranges),
+						    0, NULL, 0);
+			ASSIGN_READ_MMIO_VFUNCS(fwtable);
 		} else {
 			ASSIGN_READ_MMIO_VFUNCS(gen6);
 		}
@@ -1807,18 +1803,18 @@ intel_uncore_forcewake_for_read(struct drm_i915_private *dev_priv,
 
 	switch (INTEL_INFO(dev_priv)->gen) {
 	case 9:
-		fw_domains = __gen9_reg_read_fw_domains(i915_mmio_reg_offset(reg));
+		fw_domains = __fwtable_reg_read_fw_domains(i915_mmio_reg_offset(reg));
 		break;
 	case 8:
 		if (IS_CHERRYVIEW(dev_priv))
-			fw_domains = __chv_reg_read_fw_domains(i915_mmio_reg_offset(reg));
+			fw_domains = __fwtable_reg_read_fw_domains(i915_mmio_reg_offset(reg));
 		else
 			fw_domains = __gen6_reg_read_fw_domains(i915_mmio_reg_offset(reg));
 		break;
 	case 7:
 	case 6:
 		if (IS_VALLEYVIEW(dev_priv))
-			fw_domains = __vlv_reg_read_fw_domains(i915_mmio_reg_offset(reg));
+			fw_domains = __fwtable_reg_read_fw_domains(i915_mmio_reg_offset(reg));
 		else
 			fw_domains = __gen6_reg_read_fw_domains(i915_mmio_reg_offset(reg));
 		break;
@@ -1847,13 +1843,8 @@ intel_uncore_forcewake_for_write(struct drm_i915_private *dev_priv,
 
 	switch (INTEL_INFO(dev_priv)->gen) {
 	case 9:
-		fw_domains = __gen9_reg_write_fw_domains(i915_mmio_reg_offset(reg));
-		break;
 	case 8:
-		if (IS_CHERRYVIEW(dev_priv))
-			fw_domains = __chv_reg_write_fw_domains(i915_mmio_reg_offset(reg));
-		else
-			fw_domains = __gen8_reg_write_fw_domains(i915_mmio_reg_offset(reg));
+		fw_domains = __fwtable_reg_write_fw_domains(i915_mmio_reg_offset(reg));
 		break;
 	case 7:
 	case 6:
@@ -422,6 +422,7 @@ typedef struct drm_magic_entry {
 
 /* Event queued up for userspace to read */
 struct drm_pending_event {
+	struct completion *completion;	/* signalled on delivery, optional */
 	struct drm_event *event;
 	struct list_head link;
 	struct drm_file *file_priv;
@@ -488,8 +489,9 @@ struct drm_file {
 	struct list_head pending_event_list;
 	struct list_head event_list;
 	int event_space;
+	u_int event_pending;		/* bytes queued on event_list */
 
-	struct lock event_read_lock;
+	struct lock event_read_lock;	/* serializes drm_read() */
 
 	struct drm_prime_file_private prime;
 };
@@ -790,6 +792,8 @@ struct drm_minor {
 	struct drm_master *master;
 };
 
+#define DRM_VBLANK_LATENCY_BUCKETS	16
+
 struct drm_pending_vblank_event {
 	struct drm_pending_event base;
 	unsigned int pipe;
@@ -817,10 +821,22 @@ struct drm_vblank_crtc {
 	int pixeldur_ns;		/* pixel duration in ns */
 	bool enabled;			/* so we don't call enable more than
 					   once per disable */
+
+	/*
+	 * Pending vblank events sorted by target sequence, so the vblank
+	 * interrupt only has to look at the ones which are due.  Protected
+	 * by dev->event_lock, as are the statistics below.
+	 */
+	struct list_head event_list;
+	u_int event_count;		/* events on event_list */
+	u_long event_dispatched;	/* events sent from the vblank irq */
+	/* vblank to dispatch latency, bucket n counts < 2^n us */
+	u_long event_latency[DRM_VBLANK_LATENCY_BUCKETS];
 };
 
 struct drm_sysctl_info {
 	struct sysctl_ctx_list ctx;
+	struct sysctl_oid *top;		/* hw.dri.N */
 	char   name[2];
 };
 
@@ -865,7 +881,10 @@ struct drm_device {
 	/*@{ */
 	unsigned long     counters;
 	enum drm_stat_type	types[15];
-	atomic_t          counts[15];
+	atomic_t          counts[15];	/* _DRM_STAT_IOCTLS is per-cpu */
+	struct drm_ioctl_pcpu *ioctl_pcpu;	/* ioctl counters, per cpu */
+	int		  ioctl_stats;	/* collect per-ioctl latencies */
+	struct sysctl_ctx_list ioctl_sysctl_ctx;	/* hw.dri.N.ioctl */
 	/*@} */
 
 				/* Authentication */
@@ -940,6 +959,7 @@ struct drm_device {
 
 	/* array of size num_crtcs */
 	struct drm_vblank_crtc *vblank;
+	struct sysctl_ctx_list vblank_sysctl_ctx;	/* hw.dri.N.vblank */
 
 	struct lock vblank_time_lock;    /**< Protects vblank count and time updates during vblank enable/disable */
 	struct lock vbl_lock;
@@ -947,10 +967,6 @@ struct drm_device {
 
 	u32 max_vblank_count;           /**< size of vblank counter register */
 
-	/**
-	 * List of events
-	 */
-	struct list_head vblank_event_list;
 	struct lock event_lock;
 
 	/*@} */
@@ -28,6 +28,9 @@
 #include <linux/i2c.h>
 #include <linux/spinlock.h>
 #include <linux/types.h>
+#include <linux/completion.h>
+#include <linux/kref.h>
+#include <linux/workqueue.h>
 #include <linux/idr.h>
 #include <linux/fb.h>
 #include <linux/hdmi.h>
@@ -728,6 +731,8 @@ struct drm_crtc_funcs {
  * @state: current atomic state for this CRTC
  * @acquire_ctx: per-CRTC implicit acquire context used by atomic drivers for
  * 	legacy IOCTLs
+ * @commit_lock: protects @commit_list
+ * @commit_list: outstanding struct drm_crtc_commit for this CRTC, newest first
  *
  * Each CRTC may have one or more connectors associated with it.  This structure
  * allows the CRTC to be controlled.
@@ -787,8 +792,52 @@ struct drm_crtc {
 	 * acquire context.
 	 */
 	struct drm_modeset_acquire_ctx *acquire_ctx;
+
+	/* Commit tracking for the nonblocking atomic helpers */
+	struct spinlock commit_lock;
+	struct list_head commit_list;
+};
+
+/**
+ * struct drm_crtc_commit - track modeset commits on a CRTC
+ * @crtc: CRTC this commit belongs to
+ * @ref: reference count, one for the atomic state and one per waiter
+ * @flip_done: signalled when the new state is visible on screen, i.e. when
+ *	the vblank event of the commit has been sent
+ * @hw_done: signalled when the hardware has been programmed; the software
+ *	state of the next commit on this CRTC may only be swapped in after this
+ * @cleanup_done: signalled once the old framebuffers have been cleaned up
+ * @commit_entry: entry in &drm_crtc.commit_list
+ * @event: placeholder vblank event, used to signal @flip_done when userspace
+ *	did not ask for an event of its own
+ *
+ * The atomic helpers allocate one of these per CRTC in each commit, see
+ * drm_atomic_helper_setup_commit().  They allow nonblocking commits on
+ * disjoint sets of CRTCs to proceed in parallel while commits touching the
+ * same CRTC are ordered.
+ */
+struct drm_crtc_commit {
+	struct drm_crtc *crtc;
+	struct kref ref;
+	struct completion flip_done;
+	struct completion hw_done;
+	struct completion cleanup_done;
+	struct list_head commit_entry;
+	struct drm_pending_vblank_event *event;
 };
 
+void __drm_crtc_commit_free(struct kref *kref);
+
+static inline void drm_crtc_commit_get(struct drm_crtc_commit *commit)
+{
+	kref_get(&commit->ref);
+}
+
+static inline void drm_crtc_commit_put(struct drm_crtc_commit *commit)
+{
+	kref_put(&commit->ref, __drm_crtc_commit_free);
+}
+
 /**
  * struct drm_connector_state - mutable connector state
  * @connector: backpointer to the connector
@@ -1708,6 +1757,8 @@ struct drm_bridge {
  * @connectors: pointer to array of connector pointers
  * @connector_states: pointer to array of connector states pointers
  * @acquire_ctx: acquire context for this atomic modeset state update
+ * @crtc_commits: pointer to array of CRTC commit trackers, indexed like @crtcs
+ * @commit_work: work item for nonblocking commits
  */
 struct drm_atomic_state {
 	struct drm_device *dev;
@@ -1723,6 +1774,9 @@ struct drm_atomic_state {
 	struct drm_connector_state **connector_states;
 
 	struct drm_modeset_acquire_ctx *acquire_ctx;
+
+	struct drm_crtc_commit **crtc_commits;
+	struct work_struct commit_work;
 };
 
 
@@ -47,6 +47,24 @@ struct drm_hash_item {
 struct drm_open_hash {
 	struct hlist_head *table;
 	u8 order;
+	u8 min_order;			/* never shrink below the initial size */
+	u8 old_order;
+	struct hlist_head *old_table;	/* being migrated into table */
+	unsigned long migrate;		/* next old_table bucket to migrate */
+	unsigned long count;		/* items in both tables */
+	unsigned long resizes;
+};
+
+#define DRM_HT_CHAIN_HIST	8
+
+struct drm_ht_stats {
+	unsigned long items;
+	unsigned long buckets;
+	unsigned long used;		/* non-empty buckets */
+	unsigned long max_chain;
+	unsigned long resizes;
+	/* chains[n] counts chains of length n + 1, the last one longer too */
+	unsigned long chains[DRM_HT_CHAIN_HIST];
 };
 
 extern int drm_ht_create(struct drm_open_hash *ht, unsigned int order);
@@ -60,15 +78,15 @@ extern void drm_ht_verbose_list(struct drm_open_hash *ht, unsigned long key);
 extern int drm_ht_remove_key(struct drm_open_hash *ht, unsigned long key);
 extern int drm_ht_remove_item(struct drm_open_hash *ht, struct drm_hash_item *item);
 extern void drm_ht_remove(struct drm_open_hash *ht);
+extern void drm_ht_stats(struct drm_open_hash *ht, struct drm_ht_stats *stats);
 
 /*
- * RCU-safe interface
+ * RCU interface
  *
- * The user of this API needs to make sure that two or more instances of the
- * hash table manipulation functions are never run simultaneously.
- * The lookup function drm_ht_find_item_rcu may, however, run simultaneously
- * with any of the manipulation functions as long as it's called from within
- * an RCU read-locked section.
+ * Kept for source compatibility only.  Tables are resized and the old
+ * buckets freed without waiting for a grace period, so
+ * drm_ht_find_item_rcu must not run simultaneously with the manipulation
+ * functions either; the caller serializes all of them.
  */
 #define drm_ht_insert_item_rcu drm_ht_insert_item
 #define drm_ht_just_insert_please_rcu drm_ht_just_insert_please
@@ -39,6 +39,7 @@
 #include <linux/bug.h>
 #include <linux/kernel.h>
 #include <linux/list.h>
+#include <linux/rbtree.h>
 #include <linux/spinlock.h>
 #ifdef CONFIG_DEBUG_FS
 #include <linux/seq_file.h>
@@ -71,6 +72,11 @@ struct drm_mm_node {
 	u64 start;
 	u64 size;
 	struct drm_mm *mm;
+	/* Index of the hole following this node, valid iff hole_follows. */
+	struct rb_node rb_hole_size;
+	struct rb_node rb_hole_addr;
+	u64 hole_size;
+	u64 subtree_max_hole;
 };
 
 struct drm_mm {
@@ -79,6 +85,11 @@ struct drm_mm {
 	/* head_node.node_list is the list of all memory nodes, ordered
 	 * according to the (increasing) start address of the memory node. */
 	struct drm_mm_node head_node;
+	/* The same holes, sorted by size for best-fit searches ... */
+	struct rb_root holes_size;
+	/* ... and by start address, augmented with the largest hole size
+	 * found in each subtree, for bottom-up and top-down searches. */
+	struct rb_root holes_addr;
 	struct list_head unused_nodes;
 	int num_unused;
 	struct spinlock unused_lock;
@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2026 The DragonFly Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice unmodified, this list of conditions, and the following
+ *    disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _DRM_TRACEBUF_H_
+#define _DRM_TRACEBUF_H_
+
+#include <sys/types.h>
+
+/*
+ * Binary tracepoint records.
+ *
+ * Every cpu owns a ring of fixed-size records which its tracepoints fill
+ * without taking locks; reading hw.dri.trace.records drains all rings.
+ * Timestamps are raw TSC values (see machdep.tsc_freq) and are only
+ * comparable across cpus on systems with an invariant, synchronized TSC.
+ * The layout below is what userland sees and must not change.
+ */
+struct drm_trace_record {
+	uint64_t	tsc;
+	uint16_t	event;		/* DRM_TRACE_* */
+	uint16_t	cpu;
+	uint32_t	arg0;
+	uint64_t	arg1;
+	uint64_t	arg2;
+};
+
+/*
+ * Event classes, enabled individually through the hw.dri.trace.classes
+ * bitmask.  The class of an event is encoded in the upper byte of its id.
+ */
+#define DRM_TRACE_CLASS_REQUEST	0	/* i915 requests, radeon fences */
+#define DRM_TRACE_CLASS_GEM	1	/* eviction, shrinking, binding */
+#define DRM_TRACE_CLASS_VBLANK	2
+#define DRM_TRACE_CLASS_FLIP	3
+#define DRM_TRACE_CLASS_CS	4	/* radeon command submission */
+#define DRM_TRACE_CLASS_VM	5	/* radeon GPU VM */
+#define DRM_TRACE_NCLASSES	6
+
+#define DRM_TRACE_EVENT(class, n)	(((class) << 8) | (n))
+#define DRM_TRACE_EVENT_CLASS(ev)	((ev) >> 8)
+
+/*
+ * i915 engines and radeon fence rings are encoded as (minor << 8) | ring
+ * so that request timelines from multi-GPU systems can be told apart.
+ * Other ring arguments are the bare ring index.
+ */
+enum drm_trace_event {
+	/* arg0 = engine, arg1 = seqno, arg2 = dispatch flags */
+	DRM_TRACE_I915_REQUEST_DISPATCH =
+	    DRM_TRACE_EVENT(DRM_TRACE_CLASS_REQUEST, 0),
+	/* arg0 = engine, arg1 = seqno, arg2 = ring tail */
+	DRM_TRACE_I915_REQUEST_ADD,
+	/* arg0 = engine, arg1 = seqno last completed by the hardware */
+	DRM_TRACE_I915_REQUEST_NOTIFY,
+	/* arg0 = engine, arg1 = seqno */
+	DRM_TRACE_I915_REQUEST_RETIRE,
+	DRM_TRACE_I915_REQUEST_WAIT_BEGIN,
+	DRM_TRACE_I915_REQUEST_WAIT_END,
+	/* arg0 = waiting engine, arg1 = seqno, arg2 = signalling engine */
+	DRM_TRACE_I915_RING_SYNC_TO,
+	/* arg0 = ring, arg1 = seqno */
+	DRM_TRACE_RADEON_FENCE_EMIT,
+	DRM_TRACE_RADEON_FENCE_WAIT_BEGIN,
+	DRM_TRACE_RADEON_FENCE_WAIT_END,
+	/* arg0 = ring, arg1 = semaphore GPU address, arg2 = waiters */
+	DRM_TRACE_RADEON_SEMAPHORE_SIGNAL,
+	DRM_TRACE_RADEON_SEMAPHORE_WAIT,
+
+	/* arg0 = minor, arg1 = size, arg2 = (alignment << 32) | flags */
+	DRM_TRACE_I915_EVICT =
+	    DRM_TRACE_EVENT(DRM_TRACE_CLASS_GEM, 0),
+	/* arg0 = minor */
+	DRM_TRACE_I915_EVICT_EVERYTHING,
+	/* arg0 = minor, arg1 = address space */
+	DRM_TRACE_I915_EVICT_VM,
+	/* arg0 = minor, arg1 = target pages, arg2 = flags */
+	DRM_TRACE_I915_SHRINK,
+	/* arg0 = flags, arg1 = GTT offset, arg2 = size */
+	DRM_TRACE_I915_VMA_BIND,
+	DRM_TRACE_I915_VMA_UNBIND,
+	/* arg0 = pages, arg1 = bo */
+	DRM_TRACE_RADEON_BO_CREATE,
+
+	/* arg0 = pipe, arg1 = vblank sequence */
+	DRM_TRACE_VBLANK =
+	    DRM_TRACE_EVENT(DRM_TRACE_CLASS_VBLANK, 0),
+	/* arg0 = pipe, arg1 = target sequence, arg2 = pid */
+	DRM_TRACE_VBLANK_EVENT_QUEUED,
+	DRM_TRACE_VBLANK_EVENT_DELIVERED,
+
+	/* arg0 = plane, arg1 = framebuffer object */
+	DRM_TRACE_I915_FLIP_REQUEST =
+	    DRM_TRACE_EVENT(DRM_TRACE_CLASS_FLIP, 0),
+	DRM_TRACE_I915_FLIP_COMPLETE,
+
+	/* arg0 = ring, arg1 = IB dwords, arg2 = fences emitted */
+	DRM_TRACE_RADEON_CS =
+	    DRM_TRACE_EVENT(DRM_TRACE_CLASS_CS, 0),
+
+	/* arg0 = ring, arg1 = vmid */
+	DRM_TRACE_RADEON_VM_GRAB_ID =
+	    DRM_TRACE_EVENT(DRM_TRACE_CLASS_VM, 0),
+	/* arg0 = flags, arg1 = start offset, arg2 = end offset */
+	DRM_TRACE_RADEON_VM_BO_UPDATE,
+	/* arg0 = count, arg1 = pe, arg2 = addr */
+	DRM_TRACE_RADEON_VM_SET_PAGE,
+	/* arg0 = (ring << 16) | vmid, arg1 = page directory address */
+	DRM_TRACE_RADEON_VM_FLUSH,
+};
+
+#ifdef _KERNEL
+
+extern u_int drm_trace_classes;
+
+void drm_trace_record(u_int event, uint32_t arg0, uint64_t arg1,
+		      uint64_t arg2);
+void drm_trace_init(void);
+void drm_trace_fini(void);
+
+static __inline bool
+drm_trace_enabled(u_int class)
+{
+	return __predict_false(drm_trace_classes & (1U << class));
+}
+
+static __inline void
+drm_trace(u_int event, uint32_t arg0, uint64_t arg1, uint64_t arg2)
+{
+	if (drm_trace_enabled(DRM_TRACE_EVENT_CLASS(event)))
+		drm_trace_record(event, arg0, arg1, arg2);
+}
+
+#endif /* _KERNEL */
+
+#endif /* _DRM_TRACEBUF_H_ */
@@ -32,6 +32,10 @@
 #ifndef _TTM_MODULE_H_
 #define _TTM_MODULE_H_
 
+#include <sys/sysctl.h>
+
 #define TTM_PFX "[TTM] "
 
+SYSCTL_DECL(_hw_dri_ttm);
+
 #endif /* _TTM_MODULE_H_ */
@@ -103,4 +103,43 @@ wait_for_completion_interruptible_timeout(struct completion *c,
 	return ret;
 }
 
+static inline long
+wait_for_completion_timeout(struct completion *c, unsigned long timeout)
+{
+	int start_jiffies, elapsed_jiffies, remaining_jiffies;
+	long ret = 1;
+
+	start_jiffies = ticks;
+
+	lockmgr(&c->wait.lock, LK_EXCLUSIVE);
+	while (c->done == 0) {
+		if (lksleep(&c->wait, &c->wait.lock, 0, "wfct",
+			    timeout) == EWOULDBLOCK) {
+			ret = 0;
+			break;
+		}
+	}
+	lockmgr(&c->wait.lock, LK_RELEASE);
+
+	if (ret) {
+		elapsed_jiffies = ticks - start_jiffies;
+		remaining_jiffies = timeout - elapsed_jiffies;
+		if (remaining_jiffies > 0)
+			ret = remaining_jiffies;
+	}
+
+	return ret;
+}
+
+/*
+ * Unlike Linux, complete_all() does not leave the completion in a state
+ * that try_wait_for_completion() could consume, so only provide the
+ * non-consuming test.
+ */
+static inline bool
+completion_done(struct completion *c)
+{
+	return c->done != 0;
+}
+
 #endif	/* _LINUX_COMPLETION_H_ */
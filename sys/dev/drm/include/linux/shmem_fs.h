@@ -37,5 +37,6 @@
 #define	VM_OBJECT_LOCK_ASSERT_OWNED(object)
 
 vm_page_t shmem_read_mapping_page(vm_object_t, vm_pindex_t);
+int shmem_read_mapping_pages(vm_object_t, vm_pindex_t, vm_page_t *, int);
 
 #endif	/* _LINUX_SHMEM_FS_H_ */
@@ -41,4 +41,25 @@ MALLOC_DECLARE(M_DRM);
 
 #define kcalloc(n, size, flags)	kzalloc((n) * (size), flags)
 
+#define SLAB_HWCACHE_ALIGN	0x00002000UL
+
+struct kmem_cache;
+
+#define KMEM_CACHE(__struct, __flags)					\
+	kmem_cache_create(#__struct, sizeof(struct __struct),		\
+			  __alignof__(struct __struct), (__flags), NULL)
+
+struct kmem_cache *kmem_cache_create(const char *name, size_t size,
+				     size_t align, unsigned long flags,
+				     void (*ctor)(void *));
+void kmem_cache_destroy(struct kmem_cache *cache);
+void *kmem_cache_alloc(struct kmem_cache *cache, gfp_t flags);
+void kmem_cache_free(struct kmem_cache *cache, void *obj);
+
+static inline void *
+kmem_cache_zalloc(struct kmem_cache *cache, gfp_t flags)
+{
+	return kmem_cache_alloc(cache, flags | __GFP_ZERO);
+}
+
 #endif	/* _LINUX_SLAB_H_ */
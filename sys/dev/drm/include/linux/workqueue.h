@@ -258,5 +258,6 @@ destroy_work_on_stack(struct work_struct *work)
 extern struct workqueue_struct *system_wq;
 extern struct workqueue_struct *system_long_wq;
 extern struct workqueue_struct *system_power_efficient_wq;
+extern struct workqueue_struct *system_unbound_wq;
 
 #endif	/* _LINUX_WORKQUEUE_H_ */
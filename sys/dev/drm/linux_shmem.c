@@ -37,14 +37,15 @@
 #include <linux/err.h>
 #include <linux/shmem_fs.h>
 
-vm_page_t
-shmem_read_mapping_page(vm_object_t object, vm_pindex_t pindex)
+/*
+ * Make a grabbed (busied) page valid, reading it back from the pager or
+ * zero-filling it.  Returns the page wired and unbusied.
+ */
+static vm_page_t
+shmem_validate_page(vm_object_t object, vm_pindex_t pindex, vm_page_t m)
 {
-	vm_page_t m;
 	int rv;
 
-	VM_OBJECT_LOCK_ASSERT_OWNED(object);
-	m = vm_page_grab(object, pindex, VM_ALLOC_NORMAL | VM_ALLOC_RETRY);
 	if (m->valid != VM_PAGE_BITS_ALL) {
 		if (vm_pager_has_page(object, pindex)) {
 			rv = vm_pager_get_page(object, &m, 1);
@@ -65,3 +66,52 @@ shmem_read_mapping_page(vm_object_t object, vm_pindex_t pindex)
 	vm_page_wakeup(m);
 	return (m);
 }
+
+vm_page_t
+shmem_read_mapping_page(vm_object_t object, vm_pindex_t pindex)
+{
+	vm_page_t m;
+
+	VM_OBJECT_LOCK_ASSERT_OWNED(object);
+	m = vm_page_grab(object, pindex, VM_ALLOC_NORMAL | VM_ALLOC_RETRY);
+	return shmem_validate_page(object, pindex, m);
+}
+
+/*
+ * Wire up to count consecutive pages starting at pindex into ma[].
+ *
+ * Resident pages are picked up by following the object's page tree from
+ * one index to the next instead of looking every index up again, and only
+ * the holes are grabbed individually.  Returns the number of pages wired,
+ * which is short if a page after the first could not be brought in, or a
+ * negative errno if the first one could not.
+ */
+int
+shmem_read_mapping_pages(vm_object_t object, vm_pindex_t pindex,
+			 vm_page_t *ma, int count)
+{
+	vm_page_t m, next;
+	int i;
+
+	VM_OBJECT_LOCK_ASSERT_OWNED(object);
+	next = vm_page_lookup(object, pindex);
+	for (i = 0; i < count; i++) {
+		m = next;
+		if (m == NULL || m->pindex != pindex + i ||
+		    vm_page_busy_try(m, TRUE)) {
+			/* Hole or busy page */
+			m = vm_page_grab(object, pindex + i,
+					 VM_ALLOC_NORMAL | VM_ALLOC_RETRY);
+		}
+
+		m = shmem_validate_page(object, pindex + i, m);
+		if (IS_ERR(m))
+			return i ? i : PTR_ERR(m);
+		ma[i] = m;
+
+		/* m stays in the object while wired, so its successor is safe */
+		next = vm_page_rb_tree_RB_NEXT(m);
+	}
+
+	return i;
+}
@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2026 The DragonFly Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice unmodified, this list of conditions, and the following
+ *    disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/kernel.h>
+#include <sys/sysctl.h>
+#include <sys/thread2.h>
+
+#include <linux/slab.h>
+
+/*
+ * Minimal kmem_cache implementation.
+ *
+ * Each cache keeps a small magazine of free objects per cpu in front of
+ * kmalloc(). The magazines are only ever touched by their own cpu inside a
+ * critical section, so the fast paths need neither locks nor atomics. Objects
+ * which do not fit in the local magazine go straight back to kmalloc.
+ */
+
+#define KMEM_CACHE_MAG_SIZE	32
+
+struct kmem_cache_cpu {
+	int		count;
+	void		*objs[KMEM_CACHE_MAG_SIZE];
+	u_long		hits;
+	u_long		misses;
+} __cachealign;
+
+struct kmem_cache {
+	char		name[32];
+	size_t		size;
+	unsigned long	flags;
+	void		(*ctor)(void *);
+	struct kmem_cache_cpu *cpu;
+	struct sysctl_ctx_list sysctl_ctx;
+};
+
+enum {
+	KMEM_CACHE_STAT_HITS,
+	KMEM_CACHE_STAT_MISSES,
+	KMEM_CACHE_STAT_CACHED,
+};
+
+SYSCTL_DECL(_hw_dri);
+static SYSCTL_NODE(_hw_dri, OID_AUTO, slab, CTLFLAG_RD, 0,
+    "DRM object caches");
+
+static int
+kmem_cache_sysctl_stat(SYSCTL_HANDLER_ARGS)
+{
+	struct kmem_cache *cache = arg1;
+	struct kmem_cache_cpu *cc;
+	u_long val = 0;
+	int i;
+
+	for (i = 0; i < ncpus; i++) {
+		cc = &cache->cpu[i];
+		switch (arg2) {
+		case KMEM_CACHE_STAT_HITS:
+			val += cc->hits;
+			break;
+		case KMEM_CACHE_STAT_MISSES:
+			val += cc->misses;
+			break;
+		case KMEM_CACHE_STAT_CACHED:
+			val += cc->count;
+			break;
+		}
+	}
+
+	return sysctl_handle_long(oidp, &val, 0, req);
+}
+
+static void
+kmem_cache_sysctl_init(struct kmem_cache *cache)
+{
+	struct sysctl_oid *top;
+
+	sysctl_ctx_init(&cache->sysctl_ctx);
+	top = SYSCTL_ADD_NODE(&cache->sysctl_ctx,
+	    SYSCTL_STATIC_CHILDREN(_hw_dri_slab), OID_AUTO, cache->name,
+	    CTLFLAG_RD, 0, cache->name);
+	if (top == NULL)
+		return;
+
+	SYSCTL_ADD_PROC(&cache->sysctl_ctx, SYSCTL_CHILDREN(top), OID_AUTO,
+	    "hits", CTLTYPE_ULONG | CTLFLAG_RD, cache, KMEM_CACHE_STAT_HITS,
+	    kmem_cache_sysctl_stat, "LU", "Allocations served from a magazine");
+	SYSCTL_ADD_PROC(&cache->sysctl_ctx, SYSCTL_CHILDREN(top), OID_AUTO,
+	    "misses", CTLTYPE_ULONG | CTLFLAG_RD, cache, KMEM_CACHE_STAT_MISSES,
+	    kmem_cache_sysctl_stat, "LU", "Allocations which fell back to kmalloc");
+	SYSCTL_ADD_PROC(&cache->sysctl_ctx, SYSCTL_CHILDREN(top), OID_AUTO,
+	    "cached", CTLTYPE_ULONG | CTLFLAG_RD, cache, KMEM_CACHE_STAT_CACHED,
+	    kmem_cache_sysctl_stat, "LU", "Free objects held in magazines");
+}
+
+struct kmem_cache *
+kmem_cache_create(const char *name, size_t size, size_t align,
+		  unsigned long flags, void (*ctor)(void *))
+{
+	struct kmem_cache *cache;
+
+	cache = kmalloc(sizeof(*cache), M_DRM, M_WAITOK | M_ZERO);
+	strlcpy(cache->name, name, sizeof(cache->name));
+	cache->size = size;
+	cache->flags = flags;
+	cache->ctor = ctor;
+	cache->cpu = kmalloc(ncpus * sizeof(*cache->cpu), M_DRM,
+			     M_WAITOK | M_ZERO);
+
+	kmem_cache_sysctl_init(cache);
+
+	return cache;
+}
+
+void
+kmem_cache_destroy(struct kmem_cache *cache)
+{
+	struct kmem_cache_cpu *cc;
+	int i;
+
+	if (cache == NULL)
+		return;
+
+	sysctl_ctx_free(&cache->sysctl_ctx);
+
+	for (i = 0; i < ncpus; i++) {
+		cc = &cache->cpu[i];
+		while (cc->count > 0)
+			kfree(cc->objs[--cc->count]);
+	}
+
+	kfree(cache->cpu);
+	kfree(cache);
+}
+
+void *
+kmem_cache_alloc(struct kmem_cache *cache, gfp_t flags)
+{
+	struct kmem_cache_cpu *cc;
+	void *obj = NULL;
+
+	crit_enter();
+	cc = &cache->cpu[mycpuid];
+	if (cc->count > 0) {
+		obj = cc->objs[--cc->count];
+		cc->hits++;
+	} else {
+		cc->misses++;
+	}
+	crit_exit();
+
+	if (obj != NULL) {
+		if (flags & __GFP_ZERO)
+			memset(obj, 0, cache->size);
+		return obj;
+	}
+
+	obj = kmalloc(cache->size, M_DRM, flags);
+	if (obj != NULL && cache->ctor != NULL && (flags & __GFP_ZERO) == 0)
+		cache->ctor(obj);
+
+	return obj;
+}
+
+void
+kmem_cache_free(struct kmem_cache *cache, void *obj)
+{
+	struct kmem_cache_cpu *cc;
+
+	if (obj == NULL)
+		return;
+
+	crit_enter();
+	cc = &cache->cpu[mycpuid];
+	if (cc->count < KMEM_CACHE_MAG_SIZE) {
+		cc->objs[cc->count++] = obj;
+		obj = NULL;
+	}
+	crit_exit();
+
+	if (obj != NULL)
+		kfree(obj);
+}
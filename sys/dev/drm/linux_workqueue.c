@@ -30,12 +30,14 @@
 struct workqueue_struct *system_wq;
 struct workqueue_struct *system_long_wq;
 struct workqueue_struct *system_power_efficient_wq;
+struct workqueue_struct *system_unbound_wq;
 
 static int init_workqueues(void *arg)
 {
 	system_wq = alloc_workqueue("system_wq", 0, 1);
 	system_long_wq = alloc_workqueue("system_long_wq", 0, 1);
 	system_power_efficient_wq = alloc_workqueue("system_power_efficient_wq", 0, 1);
+	system_unbound_wq = alloc_workqueue("system_unbound_wq", 0, ncpus);
 
 	return 0;
 }
@@ -45,6 +47,7 @@ static int destroy_workqueues(void *arg)
 	destroy_workqueue(system_wq);
 	destroy_workqueue(system_long_wq);
 	destroy_workqueue(system_power_efficient_wq);
+	destroy_workqueue(system_unbound_wq);
 
 	return 0;
 }
@@ -26,9 +26,7 @@
 #include "radeon.h"
 #include "radeon_ucode.h"
 #include "radeon_asic.h"
-#ifdef TRACE_TODO
 #include "radeon_trace.h"
-#endif
 #include "cikd.h"
 
 /* sdma */
@@ -24,9 +24,7 @@
 #include <drm/drmP.h>
 #include "radeon.h"
 #include "radeon_asic.h"
-#ifdef TRACE_TODO
 #include "radeon_trace.h"
-#endif
 #include "nid.h"
 
 /*
@@ -449,6 +449,8 @@ struct radeon_mman {
 	struct ttm_bo_device		bdev;
 	bool				mem_global_referenced;
 	bool				initialized;
+	/* always move with the CPU, used by the benchmarks */
+	bool				force_memcpy;
 
 #if defined(CONFIG_DEBUG_FS)
 	struct dentry			*vram;
@@ -30,6 +30,7 @@
 #define RADEON_BENCHMARK_COPY_DMA  0
 
 #define RADEON_BENCHMARK_ITERATIONS 1024
+#define RADEON_BENCHMARK_CPU_ITERATIONS 16
 #define RADEON_BENCHMARK_COMMON_MODES_N 17
 
 static int radeon_benchmark_do_move(struct radeon_device *rdev, unsigned size,
@@ -165,6 +166,58 @@ out_cleanup:
 	}
 }
 
+/*
+ * Time the CPU fallback path (ttm_bo_move_memcpy), as used when evicting
+ * without a copy ring, by bouncing an unpinned buffer object between the
+ * two domains. Half of the moves go each way.
+ */
+static void radeon_benchmark_cpu_move(struct radeon_device *rdev,
+				      unsigned size,
+				      unsigned sdomain, unsigned ddomain)
+{
+	struct radeon_bo *bo = NULL;
+	unsigned long start_jiffies;
+	unsigned long end_jiffies;
+	int i, r, n;
+	int time;
+
+	n = RADEON_BENCHMARK_CPU_ITERATIONS;
+	r = radeon_bo_create(rdev, size, PAGE_SIZE, true, sdomain, 0, NULL, &bo);
+	if (r) {
+		goto out_cleanup;
+	}
+	r = radeon_bo_reserve(bo, false);
+	if (unlikely(r != 0))
+		goto out_cleanup;
+
+	rdev->mman.force_memcpy = true;
+	start_jiffies = jiffies;
+	for (i = 0; i < n; i++) {
+		radeon_ttm_placement_from_domain(bo, (i & 1) ? sdomain : ddomain);
+		r = ttm_bo_validate(&bo->tbo, &bo->placement, false, false);
+		if (r)
+			break;
+	}
+	end_jiffies = jiffies;
+	rdev->mman.force_memcpy = false;
+	radeon_bo_unreserve(bo);
+	if (r)
+		goto out_cleanup;
+
+	time = jiffies_to_msecs(end_jiffies - start_jiffies);
+	if (time > 0)
+		radeon_benchmark_log_results(n, size, time,
+					     sdomain, ddomain, "cpu");
+
+out_cleanup:
+	if (bo)
+		radeon_bo_unref(&bo);
+
+	if (r) {
+		DRM_ERROR("Error while benchmarking BO move.\n");
+	}
+}
+
 void radeon_benchmark(struct radeon_device *rdev, int test_number)
 {
 	int i;
@@ -243,6 +296,20 @@ void radeon_benchmark(struct radeon_device *rdev, int test_number)
 					      RADEON_GEM_DOMAIN_VRAM,
 					      RADEON_GEM_DOMAIN_VRAM);
 		break;
+	case 9:
+		/* CPU moves, VRAM to GTT and back, buffer size sweep, powers of 2 */
+		for (i = 1; i <= 4096; i <<= 1)
+			radeon_benchmark_cpu_move(rdev, i * RADEON_GPU_PAGE_SIZE,
+						  RADEON_GEM_DOMAIN_VRAM,
+						  RADEON_GEM_DOMAIN_GTT);
+		break;
+	case 10:
+		/* CPU moves, VRAM to GTT and back, buffer size sweep, common modes */
+		for (i = 0; i < RADEON_BENCHMARK_COMMON_MODES_N; i++)
+			radeon_benchmark_cpu_move(rdev, common_modes[i],
+						  RADEON_GEM_DOMAIN_VRAM,
+						  RADEON_GEM_DOMAIN_GTT);
+		break;
 
 	default:
 		DRM_ERROR("Unknown benchmark\n");
@@ -24,14 +24,14 @@
  * Authors:
  *    Jerome Glisse <glisse@freedesktop.org>
  */
+#include <linux/hash.h>
 #include <linux/list_sort.h>
+#include <linux/log2.h>
 #include <drm/drmP.h>
 #include <uapi_drm/radeon_drm.h>
 #include "radeon_reg.h"
 #include "radeon.h"
-#ifdef TRACE_TODO
 #include "radeon_trace.h"
-#endif
 
 #define RADEON_CS_MAX_PRIORITY		32u
 #define RADEON_CS_NUM_BUCKETS		(RADEON_CS_MAX_PRIORITY + 1)
@@ -74,12 +74,35 @@ static void radeon_cs_buckets_get_list(struct radeon_cs_buckets *b,
 	}
 }
 
+/*
+ * Duplicate handles are found through an open-addressed hash table of reloc
+ * indices keyed by GEM handle, rather than by comparing each reloc with all
+ * the previous ones, which was quadratic in the number of relocs.
+ */
+static unsigned *radeon_cs_reloc_hash_find(struct radeon_cs_parser *p,
+					   unsigned *hash, unsigned hash_bits,
+					   u32 handle)
+{
+	unsigned mask = (1 << hash_bits) - 1;
+	unsigned h = hash_32(handle, hash_bits);
+
+	/* slots hold the reloc index + 1, 0 marks an empty slot */
+	while (hash[h] && p->relocs[hash[h] - 1].handle != handle)
+		h = (h + 1) & mask;
+
+	return &hash[h];
+}
+
 static int radeon_cs_parser_relocs(struct radeon_cs_parser *p)
 {
 	struct radeon_cs_chunk *chunk;
 	struct radeon_cs_buckets buckets;
-	unsigned i, j;
-	bool duplicate;
+	struct drm_gem_object **gobjs;
+	unsigned *hash;
+	u32 *handles;
+	unsigned hash_bits;
+	unsigned i, nhandles;
+	int ret = 0;
 
 	if (p->chunk_relocs_idx == -1) {
 		return 0;
@@ -97,32 +120,68 @@ static int radeon_cs_parser_relocs(struct radeon_cs_parser *p)
 		return -ENOMEM;
 	}
 
-	radeon_cs_buckets_init(&buckets);
+	/* keep the hash table at most half full */
+	hash_bits = order_base_2(max(p->nrelocs * 2, 16u));
+	hash = kcalloc(1 << hash_bits, sizeof(*hash), GFP_KERNEL);
+	handles = kcalloc(p->nrelocs, sizeof(*handles), GFP_KERNEL);
+	gobjs = kcalloc(p->nrelocs, sizeof(*gobjs), GFP_KERNEL);
+	if (hash == NULL || handles == NULL || gobjs == NULL) {
+		ret = -ENOMEM;
+		goto out_free;
+	}
 
+	/* Point duplicates at their first reloc and collect the others */
+	nhandles = 0;
 	for (i = 0; i < p->nrelocs; i++) {
 		struct drm_radeon_cs_reloc *r;
-		unsigned priority;
+		unsigned *slot;
 
-		duplicate = false;
 		r = (struct drm_radeon_cs_reloc *)&chunk->kdata[i*4];
-		for (j = 0; j < i; j++) {
-			if (r->handle == p->relocs[j].handle) {
-				p->relocs_ptr[i] = &p->relocs[j];
-				duplicate = true;
-				break;
-			}
-		}
-		if (duplicate) {
+		slot = radeon_cs_reloc_hash_find(p, hash, hash_bits, r->handle);
+		if (*slot) {
+			p->relocs_ptr[i] = &p->relocs[*slot - 1];
 			p->relocs[i].handle = 0;
 			continue;
 		}
 
-		p->relocs[i].gobj = drm_gem_object_lookup(p->filp, r->handle);
-		if (p->relocs[i].gobj == NULL) {
+		*slot = i + 1;
+		p->relocs[i].handle = r->handle;
+		handles[nhandles++] = r->handle;
+	}
+
+	/* Then look them all up under a single table lock */
+	drm_gem_objects_lookup(p->filp, handles, nhandles, gobjs);
+
+	nhandles = 0;
+	for (i = 0; i < p->nrelocs; i++) {
+		if (p->relocs_ptr[i] != NULL)
+			continue;
+
+		p->relocs[i].gobj = gobjs[nhandles++];
+		if (p->relocs[i].gobj == NULL && ret == 0) {
 			DRM_ERROR("gem object lookup failed 0x%x\n",
-				  r->handle);
-			return -ENOENT;
+				  p->relocs[i].handle);
+			ret = -ENOENT;
 		}
+	}
+
+out_free:
+	kfree(gobjs);
+	kfree(handles);
+	kfree(hash);
+	if (ret)
+		return ret;
+
+	radeon_cs_buckets_init(&buckets);
+
+	for (i = 0; i < p->nrelocs; i++) {
+		struct drm_radeon_cs_reloc *r;
+		unsigned priority;
+
+		if (p->relocs_ptr[i] != NULL)
+			continue;
+
+		r = (struct drm_radeon_cs_reloc *)&chunk->kdata[i*4];
 		p->relocs_ptr[i] = &p->relocs[i];
 		p->relocs[i].robj = gem_to_radeon_bo(p->relocs[i].gobj);
 
@@ -668,9 +727,7 @@ int radeon_cs_ioctl(struct drm_device *dev, void *data, struct drm_file *filp)
 		return r;
 	}
 
-#if TRACE_TODO
 	trace_radeon_cs(&parser);
-#endif
 
 	r = radeon_cs_ib_chunk(rdev, &parser);
 	if (r) {
@@ -31,9 +31,7 @@
 #include <drm/drmP.h>
 #include "radeon_reg.h"
 #include "radeon.h"
-#ifdef TRACE_TODO
 #include "radeon_trace.h"
-#endif
 
 /*
  * Fences
@@ -137,9 +135,7 @@ int radeon_fence_emit(struct radeon_device *rdev,
 	(*fence)->seq = ++rdev->fence_drv[ring].sync_seq[ring];
 	(*fence)->ring = ring;
 	radeon_fence_ring_emit(rdev, ring, *fence);
-#ifdef TRACE_TODO
 	trace_radeon_fence_emit(rdev->ddev, ring, (*fence)->seq);
-#endif
 	radeon_fence_schedule_check(rdev, ring);
 	return 0;
 }
@@ -386,9 +382,7 @@ static int radeon_fence_wait_seq_timeout(struct radeon_device *rdev,
 		if (!target_seq[i])
 			continue;
 
-#ifdef TRACE_TODO
 		trace_radeon_fence_wait_begin(rdev->ddev, i, target_seq[i]);
-#endif
 		radeon_irq_kms_sw_irq_get(rdev, i);
 	}
 
@@ -410,9 +404,7 @@ static int radeon_fence_wait_seq_timeout(struct radeon_device *rdev,
 			continue;
 
 		radeon_irq_kms_sw_irq_put(rdev, i);
-#if TRACE_TODO
 		trace_radeon_fence_wait_end(rdev->ddev, i, target_seq[i]);
-#endif
 	}
 
 	return r;
@@ -32,9 +32,7 @@
 #include <drm/drmP.h>
 #include <uapi_drm/radeon_drm.h>
 #include "radeon.h"
-#ifdef TRACE_TODO
 #include "radeon_trace.h"
-#endif
 #include <linux/io.h>
 
 
@@ -228,9 +226,7 @@ int radeon_bo_create(struct radeon_device *rdev,
 	}
 	*bo_ptr = bo;
 
-#ifdef TRACE_TODO
 	trace_radeon_bo_create(bo);
-#endif
 
 	return 0;
 }
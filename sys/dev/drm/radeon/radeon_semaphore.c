@@ -29,9 +29,7 @@
  */
 #include <drm/drmP.h>
 #include "radeon.h"
-#ifdef TRACE_TODO
 #include "radeon_trace.h"
-#endif
 
 int radeon_semaphore_create(struct radeon_device *rdev,
 			    struct radeon_semaphore **semaphore)
@@ -69,9 +67,7 @@ bool radeon_semaphore_emit_signal(struct radeon_device *rdev, int ridx,
 {
 	struct radeon_ring *ring = &rdev->ring[ridx];
 
-#ifdef TRACE_TODO
 	trace_radeon_semaphore_signale(ridx, semaphore);
-#endif
 
 	if (radeon_semaphore_ring_emit(rdev, ridx, ring, semaphore, false)) {
 		--semaphore->waiters;
@@ -88,9 +84,7 @@ bool radeon_semaphore_emit_wait(struct radeon_device *rdev, int ridx,
 {
 	struct radeon_ring *ring = &rdev->ring[ridx];
 
-#ifdef TRACE_TODO
 	trace_radeon_semaphore_wait(ridx, semaphore);
-#endif
 
 	if (radeon_semaphore_ring_emit(rdev, ridx, ring, semaphore, true)) {
 		++semaphore->waiters;
@@ -388,7 +388,7 @@ static int radeon_bo_move(struct ttm_buffer_object *bo,
 		return 0;
 	}
 	if (!rdev->ring[radeon_copy_ring_index(rdev)].ready ||
-	    rdev->asic->copy.copy == NULL) {
+	    rdev->asic->copy.copy == NULL || rdev->mman.force_memcpy) {
 		/* use memcpy */
 		goto memcpy;
 	}
@@ -28,9 +28,7 @@
 #include <drm/drmP.h>
 #include <uapi_drm/radeon_drm.h>
 #include "radeon.h"
-#ifdef TRACE_TODO
 #include "radeon_trace.h"
-#endif
 
 /*
  * GPUVM
@@ -199,9 +197,7 @@ struct radeon_fence *radeon_vm_grab_id(struct radeon_device *rdev,
 		if (fence == NULL) {
 			/* found a free one */
 			vm->id = i;
-#ifdef TRACE_TODO
 			trace_radeon_vm_grab_id(vm->id, ring);
-#endif
 			return NULL;
 		}
 
@@ -214,9 +210,7 @@ struct radeon_fence *radeon_vm_grab_id(struct radeon_device *rdev,
 	for (i = 0; i < 2; ++i) {
 		if (choices[i]) {
 			vm->id = choices[i];
-#ifdef TRACE_TODO
 			trace_radeon_vm_grab_id(vm->id, ring);
-#endif
 			return rdev->vm_manager.active[choices[i]];
 		}
 	}
@@ -246,9 +240,7 @@ void radeon_vm_flush(struct radeon_device *rdev,
 	/* if we can't remember our last VM flush then flush now! */
 	/* XXX figure out why we have to flush all the time */
 	if (!vm->last_flush || true || pd_addr != vm->pd_gpu_addr) {
-#ifdef TRACE_TODO
 		trace_radeon_vm_flush(pd_addr, ring, vm->id);
-#endif
 		vm->pd_gpu_addr = pd_addr;
 		radeon_ring_vm_flush(rdev, ring, vm);
 	}
@@ -371,9 +363,7 @@ static void radeon_vm_set_pages(struct radeon_device *rdev,
 				uint64_t addr, unsigned count,
 				uint32_t incr, uint32_t flags)
 {
-#ifdef TRACE_TODO
 	trace_radeon_vm_set_page(pe, addr, count, incr, flags);
-#endif
 
 	if ((flags & R600_PTE_GART_MASK) == R600_PTE_GART_MASK) {
 		uint64_t src = rdev->gart.table_addr + (addr >> 12) * 8;
@@ -929,9 +919,7 @@ int radeon_vm_bo_update(struct radeon_device *rdev,
 		return 0;
 	bo_va->addr = addr;
 
-#ifdef TRACE_TODO
 	trace_radeon_vm_bo_update(bo_va);
-#endif
 
 	nptes = (bo_va->eoffset - bo_va->soffset) / RADEON_GPU_PAGE_SIZE;
 
@@ -42,6 +42,9 @@
 #define TTM_DEBUG(fmt, arg...)
 #define TTM_BO_HASH_ORDER 13
 
+SYSCTL_DECL(_hw_dri);
+SYSCTL_NODE(_hw_dri, OID_AUTO, ttm, CTLFLAG_RW, 0, "TTM memory manager");
+
 static int ttm_bo_setup_vm(struct ttm_buffer_object *bo);
 static int ttm_bo_swapout(struct ttm_mem_shrink *shrink);
 static void ttm_bo_global_kobj_release(struct ttm_bo_global *glob);
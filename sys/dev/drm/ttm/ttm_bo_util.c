@@ -248,50 +248,87 @@ static int ttm_copy_io_page(void *dst, void *src, unsigned long page)
 	return 0;
 }
 
-static int ttm_copy_io_ttm_page(struct ttm_tt *ttm, void *src,
-				unsigned long page,
-				vm_memattr_t prot)
-{
-	vm_page_t d = ttm->pages[page];
-	void *dst;
-
-	if (!d)
-		return -ENOMEM;
-
-	src = (void *)((unsigned long)src + (page << PAGE_SHIFT));
-
-	/* XXXKIB can't sleep ? */
-	dst = pmap_mapdev_attr(VM_PAGE_TO_PHYS(d), PAGE_SIZE, prot);
-	if (!dst)
-		return -ENOMEM;
-
-	memcpy_fromio(dst, src, PAGE_SIZE);
-
-	pmap_unmapdev((vm_offset_t)dst, PAGE_SIZE);
+/*
+ * Number of TTM pages mapped at once by a CPU move. Every chunk costs one
+ * pmap_qenter()/pmap_qremove() pair and thus one TLB invalidation, instead
+ * of one pmap_mapdev_attr()/pmap_unmapdev() pair per page.
+ */
+#define TTM_COPY_CHUNK_PAGES 256
 
-	return 0;
+/*
+ * Copy with non-temporal stores. The destination of a move is typically
+ * write-combined or uncached, and in any case not going to be read back
+ * by the CPU soon, so there is no point in pulling it into the cache.
+ * Only uses integer registers, so no FPU state needs to be saved.
+ */
+static void ttm_memcpy_nt(void *dst, const void *src, size_t len)
+{
+#if defined(__x86_64__)
+	uint64_t *d = dst;
+	const uint64_t *s = src;
+	size_t n;
+
+	KKASSERT((len & 31) == 0);
+	for (n = len / sizeof(*d); n != 0; n -= 4, d += 4, s += 4) {
+		__asm __volatile(
+		    "movnti %4, %0\n\t"
+		    "movnti %5, %1\n\t"
+		    "movnti %6, %2\n\t"
+		    "movnti %7, %3"
+		    : "=m" (d[0]), "=m" (d[1]), "=m" (d[2]), "=m" (d[3])
+		    : "r" (s[0]), "r" (s[1]), "r" (s[2]), "r" (s[3]));
+	}
+	cpu_sfence();
+#else
+	memcpy(dst, src, len);
+#endif
 }
 
-static int ttm_copy_ttm_io_page(struct ttm_tt *ttm, void *dst,
-				unsigned long page,
-				vm_memattr_t prot)
+/*
+ * Copy @num_pages between the pages of @ttm and the ioremapped region @io,
+ * mapping the TTM pages into a single kernel window one chunk at a time.
+ * The window maps the pages with their own memory attributes, which
+ * ttm_tt_set_caching() keeps in line with the caching state of the TTM.
+ */
+static int ttm_copy_ttm_io(struct ttm_tt *ttm, void *io,
+			   unsigned long num_pages, bool to_io)
 {
-	vm_page_t s = ttm->pages[page];
-	void *src;
+	vm_offset_t kva;
+	unsigned long i, j, n;
+	char *chunk_io;
+	int ret = 0;
 
-	if (!s)
+	kva = kmem_alloc_nofault(&kernel_map,
+				 TTM_COPY_CHUNK_PAGES * PAGE_SIZE,
+				 VM_SUBSYS_DRM_TTM, PAGE_SIZE);
+	if (kva == 0)
 		return -ENOMEM;
 
-	dst = (void *)((unsigned long)dst + (page << PAGE_SHIFT));
-	src = pmap_mapdev_attr(VM_PAGE_TO_PHYS(s), PAGE_SIZE, prot);
-	if (!src)
-		return -ENOMEM;
+	for (i = 0; i < num_pages; i += n) {
+		n = min(num_pages - i, (unsigned long)TTM_COPY_CHUNK_PAGES);
 
-	memcpy_toio(dst, src, PAGE_SIZE);
+		for (j = 0; j < n; j++) {
+			if (ttm->pages[i + j] == NULL) {
+				ret = -ENOMEM;
+				goto out;
+			}
+		}
+		pmap_qenter(kva, &ttm->pages[i], n);
 
-	pmap_unmapdev((vm_offset_t)src, PAGE_SIZE);
+		chunk_io = (char *)io + (i << PAGE_SHIFT);
+		if (to_io)
+			ttm_memcpy_nt(chunk_io, (void *)kva, n << PAGE_SHIFT);
+		else if (ttm->caching_state != tt_cached)
+			ttm_memcpy_nt((void *)kva, chunk_io, n << PAGE_SHIFT);
+		else
+			memcpy_fromio((void *)kva, chunk_io, n << PAGE_SHIFT);
 
-	return 0;
+		pmap_qremove(kva, n);
+	}
+
+out:
+	kmem_free(&kernel_map, kva, TTM_COPY_CHUNK_PAGES * PAGE_SIZE);
+	return ret;
 }
 
 int ttm_bo_move_memcpy(struct ttm_buffer_object *bo,
@@ -352,21 +389,22 @@ int ttm_bo_move_memcpy(struct ttm_buffer_object *bo,
 		add = new_mem->num_pages - 1;
 	}
 
-	for (i = 0; i < new_mem->num_pages; ++i) {
-		page = i * dir + add;
-		if (old_iomap == NULL) {
-			vm_memattr_t prot = ttm_io_prot(old_mem->placement);
-			ret = ttm_copy_ttm_io_page(ttm, new_iomap, page,
-						   prot);
-		} else if (new_iomap == NULL) {
-			vm_memattr_t prot = ttm_io_prot(new_mem->placement);
-			ret = ttm_copy_io_ttm_page(ttm, old_iomap, page,
-						   prot);
-		} else
+	if (old_iomap == NULL) {
+		ret = ttm_copy_ttm_io(ttm, new_iomap, new_mem->num_pages,
+				      true);
+	} else if (new_iomap == NULL) {
+		ret = ttm_copy_ttm_io(ttm, old_iomap, new_mem->num_pages,
+				      false);
+	} else {
+		for (i = 0; i < new_mem->num_pages; ++i) {
+			page = i * dir + add;
 			ret = ttm_copy_io_page(new_iomap, old_iomap, page);
-		if (ret)
-			goto out1;
+			if (ret)
+				break;
+		}
 	}
+	if (ret)
+		goto out1;
 	cpu_mfence();
 out2:
 	old_copy = *old_mem;
@@ -55,6 +55,20 @@ RB_GENERATE(ttm_bo_device_buffer_objects, ttm_buffer_object, vm_rb,
 
 #define TTM_BO_VM_NUM_PREFAULT 16
 
+static int ttm_bo_vm_num_prefault = TTM_BO_VM_NUM_PREFAULT;
+TUNABLE_INT("drm.ttm.vm_num_prefault", &ttm_bo_vm_num_prefault);
+SYSCTL_INT(_hw_dri_ttm, OID_AUTO, vm_num_prefault, CTLFLAG_RW,
+    &ttm_bo_vm_num_prefault, 0,
+    "Pages made resident per CPU fault on a buffer object mapping");
+
+static u_long ttm_bo_vm_faults;
+SYSCTL_ULONG(_hw_dri_ttm, OID_AUTO, vm_faults, CTLFLAG_RD,
+    &ttm_bo_vm_faults, 0, "CPU faults on buffer object mappings");
+
+static u_long ttm_bo_vm_prefaulted;
+SYSCTL_ULONG(_hw_dri_ttm, OID_AUTO, vm_prefaulted, CTLFLAG_RD,
+    &ttm_bo_vm_prefaulted, 0, "Pages made resident ahead of CPU faults");
+
 int
 ttm_bo_cmp_rb_tree_items(struct ttm_buffer_object *a,
     struct ttm_buffer_object *b)
@@ -99,6 +113,72 @@ static struct ttm_buffer_object *ttm_bo_vm_lookup_rb(struct ttm_bo_device *bdev,
 	return best_bo;
 }
 
+/*
+ * Look up the page backing @pindex of the buffer object and set its
+ * caching attributes. The caller holds the reservation and the io lock.
+ */
+static vm_page_t
+ttm_bo_vm_page(struct ttm_buffer_object *bo, vm_pindex_t pindex)
+{
+	vm_page_t m;
+
+	if (bo->mem.bus.is_iomem) {
+		m = vm_phys_fictitious_to_vm_page(bo->mem.bus.base +
+		    bo->mem.bus.offset + IDX_TO_OFF(pindex));
+		pmap_page_set_memattr(m, ttm_io_prot(bo->mem.placement));
+	} else {
+		m = bo->ttm->pages[pindex];
+		if (unlikely(!m))
+			return (NULL);
+		pmap_page_set_memattr(m,
+		    (bo->mem.placement & TTM_PL_FLAG_CACHED) ?
+		    VM_MEMATTR_WRITE_BACK : ttm_io_prot(bo->mem.placement));
+	}
+
+	return (m);
+}
+
+/*
+ * Make the pages following the faulting one resident in the VM object
+ * while we still hold the reservation and the io lock, so that streaming
+ * access through the mapping is resolved by vm_fault() from the object
+ * instead of coming back here, and reserving the buffer, for every page.
+ * The window is bounded by the buffer object and by the mapping.
+ */
+static void
+ttm_bo_vm_prefault(struct ttm_buffer_object *bo, vm_object_t vm_obj,
+    vm_pindex_t pindex)
+{
+	vm_pindex_t end;
+	vm_page_t m;
+	u_long count = 0;
+
+	end = pindex + ttm_bo_vm_num_prefault;
+	if (end > bo->num_pages)
+		end = bo->num_pages;
+	if (end > vm_obj->size)
+		end = vm_obj->size;
+
+	for (pindex++; pindex < end; pindex++) {
+		if (vm_page_lookup(vm_obj, pindex) != NULL)
+			continue;
+
+		m = ttm_bo_vm_page(bo, pindex);
+		if (m == NULL || m->object != NULL)
+			break;
+		if (vm_page_busy_try(m, FALSE))
+			break;
+
+		m->valid = VM_PAGE_BITS_ALL;
+		vm_page_insert(m, vm_obj, pindex);
+		vm_page_wakeup(m);
+		count++;
+	}
+
+	if (count != 0)
+		atomic_add_long(&ttm_bo_vm_prefaulted, count);
+}
+
 static int
 ttm_bo_vm_fault(vm_object_t vm_obj, vm_ooffset_t offset,
     int prot, vm_page_t *mres)
@@ -112,6 +192,8 @@ ttm_bo_vm_fault(vm_object_t vm_obj, vm_ooffset_t offset,
 	struct ttm_mem_type_manager *man =
 		&bdev->man[bo->mem.mem_type];
 
+	atomic_add_long(&ttm_bo_vm_faults, 1);
+
 	vm_object_pip_add(vm_obj, 1);
 	oldm = *mres;
 	if (oldm != NULL) {
@@ -213,20 +295,10 @@ reserve:
 		}
 	}
 
-	if (bo->mem.bus.is_iomem) {
-		m = vm_phys_fictitious_to_vm_page(bo->mem.bus.base +
-		    bo->mem.bus.offset + offset);
-		pmap_page_set_memattr(m, ttm_io_prot(bo->mem.placement));
-	} else {
-		ttm = bo->ttm;
-		m = ttm->pages[OFF_TO_IDX(offset)];
-		if (unlikely(!m)) {
-			retval = VM_PAGER_ERROR;
-			goto out_io_unlock;
-		}
-		pmap_page_set_memattr(m,
-		    (bo->mem.placement & TTM_PL_FLAG_CACHED) ?
-		    VM_MEMATTR_WRITE_BACK : ttm_io_prot(bo->mem.placement));
+	m = ttm_bo_vm_page(bo, OFF_TO_IDX(offset));
+	if (unlikely(!m)) {
+		retval = VM_PAGER_ERROR;
+		goto out_io_unlock;
 	}
 
 	VM_OBJECT_LOCK(vm_obj);
@@ -250,6 +322,9 @@ reserve:
 	}
 	vm_page_busy_try(m, FALSE);
 
+	if (ttm_bo_vm_num_prefault > 1)
+		ttm_bo_vm_prefault(bo, vm_obj, OFF_TO_IDX(offset));
+
 	if (oldm != NULL) {
 		vm_page_free(oldm);
 	}
@@ -34,10 +34,11 @@
  * $FreeBSD: head/sys/dev/drm2/ttm/ttm_page_alloc.c 247849 2013-03-05 16:15:34Z kib $
  */
 
-/* simple list based uncached page pool
+/* simple list based page pool
  * - Pool collects resently freed pages for reuse
  * - Use page->lru to keep a free list
  * - doesn't track currently in use pages
+ * - each cpu keeps a small cache of pages in front of every pool
  */
 
 #define pr_fmt(fmt) "[TTM] " fmt
@@ -45,6 +46,7 @@
 #include <sys/eventhandler.h>
 
 #include <drm/drmP.h>
+#include <drm/ttm/ttm_module.h>
 #include <drm/ttm/ttm_bo_driver.h>
 #include <drm/ttm/ttm_page_alloc.h>
 
@@ -57,17 +59,40 @@
 #define FREE_ALL_PAGES			(~0U)
 /* times are in msecs */
 #define PAGE_FREE_INTERVAL		1000
+/* per-cpu cache size and the number of pages moved to or from the pool */
+#define TTM_PCPU_PAGES			32
+#define TTM_PCPU_BATCH			8
 
 /**
- * struct ttm_page_pool - Pool to reuse recently allocated uc/wc pages.
+ * struct ttm_page_pcpu - Per-cpu cache of free pages in front of a pool.
+ *
+ * The cache is normally only touched by its own cpu, the lock is there so
+ * that the shrinker can drain the caches of other cpus. It never sees
+ * contention on the allocation paths.
+ *
+ * @lock: Protects the cache.
+ * @npages: Number of pages in the cache.
+ * @last_used: Ticks of the last allocation or free through the cache.
+ * @pages: The cached pages, most recently freed last.
+ */
+struct ttm_page_pcpu {
+	struct spinlock		lock;
+	unsigned		npages;
+	int			last_used;
+	vm_page_t		pages[TTM_PCPU_PAGES];
+} __cachealign;
+
+/**
+ * struct ttm_page_pool - Pool to reuse recently allocated pages.
  *
  * @lock: Protects the shared pool from concurrnet access. Must be used with
  * irqsave/irqrestore variants because pool allocator maybe called from
  * delayed work.
  * @fill_lock: Prevent concurrent calls to fill.
- * @list: Pool of free uc/wc pages for fast reuse.
+ * @list: Pool of free pages for fast reuse.
  * @gfp_flags: Flags to pass for alloc_page.
  * @npages: Number of pages in pool.
+ * @pcpu: Per-cpu caches in front of the shared pool.
  */
 struct ttm_page_pool {
 	struct lock		lock;
@@ -79,6 +104,7 @@ struct ttm_page_pool {
 	char			*name;
 	unsigned long		nfrees;
 	unsigned long		nrefills;
+	struct ttm_page_pcpu	*pcpu;
 };
 
 /**
@@ -93,7 +119,7 @@ struct ttm_pool_opts {
 	unsigned	small;
 };
 
-#define NUM_POOLS 4
+#define NUM_POOLS 6
 
 /**
  * struct ttm_pool_manager - Holds memory pools for fst allocation
@@ -112,6 +138,7 @@ struct ttm_pool_manager {
 	unsigned int kobj_ref;
 	eventhandler_tag lowmem_handler;
 	struct ttm_pool_opts	options;
+	struct sysctl_ctx_list	sysctl_ctx;
 
 	union {
 		struct ttm_page_pool	u_pools[NUM_POOLS];
@@ -120,6 +147,8 @@ struct ttm_pool_manager {
 			struct ttm_page_pool	u_uc_pool;
 			struct ttm_page_pool	u_wc_pool_dma32;
 			struct ttm_page_pool	u_uc_pool_dma32;
+			struct ttm_page_pool	u_wb_pool;
+			struct ttm_page_pool	u_wb_pool_dma32;
 		} _ut;
 	} _u;
 };
@@ -129,6 +158,8 @@ struct ttm_pool_manager {
 #define	uc_pool _u._ut.u_uc_pool
 #define	wc_pool_dma32 _u._ut.u_wc_pool_dma32
 #define	uc_pool_dma32 _u._ut.u_uc_pool_dma32
+#define	wb_pool _u._ut.u_wb_pool
+#define	wb_pool_dma32 _u._ut.u_wb_pool_dma32
 
 static void
 ttm_vm_page_free(vm_page_t m)
@@ -171,59 +202,124 @@ static void ttm_pool_kobj_release(struct ttm_pool_manager *m)
 	kfree(m);
 }
 
-#if 0
-/* XXXKIB sysctl */
-static ssize_t ttm_pool_store(struct ttm_pool_manager *m,
-		struct attribute *attr, const char *buffer, size_t size)
+static struct ttm_pool_manager *_manager;
+
+enum {
+	TTM_POOL_OPT_MAX_SIZE,
+	TTM_POOL_OPT_SMALL,
+	TTM_POOL_OPT_ALLOC_SIZE,
+};
+
+/*
+ * hw.dri.ttm.pool_{max_size,small,alloc_size}, in kB like the Linux sysfs
+ * attributes they replace.
+ */
+static int ttm_pool_sysctl_opt(SYSCTL_HANDLER_ARGS)
 {
-	int chars;
+	struct ttm_pool_manager *m = arg1;
+	unsigned *opt;
 	unsigned val;
-	chars = sscanf(buffer, "%u", &val);
-	if (chars == 0)
-		return size;
+	int error;
+
+	switch (arg2) {
+	case TTM_POOL_OPT_MAX_SIZE:
+		opt = &m->options.max_size;
+		break;
+	case TTM_POOL_OPT_SMALL:
+		opt = &m->options.small;
+		break;
+	case TTM_POOL_OPT_ALLOC_SIZE:
+		opt = &m->options.alloc_size;
+		break;
+	default:
+		return (EINVAL);
+	}
+
+	val = *opt * (PAGE_SIZE >> 10);
+	error = sysctl_handle_int(oidp, &val, 0, req);
+	if (error || req->newptr == NULL)
+		return (error);
 
 	/* Convert kb to number of pages */
 	val = val / (PAGE_SIZE >> 10);
 
-	if (attr == &ttm_page_pool_max)
-		m->options.max_size = val;
-	else if (attr == &ttm_page_pool_small)
-		m->options.small = val;
-	else if (attr == &ttm_page_pool_alloc_size) {
+	if (arg2 == TTM_POOL_OPT_ALLOC_SIZE) {
 		if (val > NUM_PAGES_TO_ALLOC*8) {
 			pr_err("Setting allocation size to %lu is not allowed. Recommended size is %lu\n",
 			       NUM_PAGES_TO_ALLOC*(PAGE_SIZE >> 7),
 			       NUM_PAGES_TO_ALLOC*(PAGE_SIZE >> 10));
-			return size;
+			return (EINVAL);
 		} else if (val > NUM_PAGES_TO_ALLOC) {
 			pr_warn("Setting allocation size to larger than %lu is not recommended\n",
 				NUM_PAGES_TO_ALLOC*(PAGE_SIZE >> 10));
 		}
-		m->options.alloc_size = val;
 	}
 
-	return size;
+	*opt = val;
+
+	return (0);
 }
 
-static ssize_t ttm_pool_show(struct ttm_pool_manager *m,
-		struct attribute *attr, char *buffer)
+static int ttm_pool_sysctl_cached(SYSCTL_HANDLER_ARGS)
 {
+	struct ttm_page_pool *pool = arg1;
 	unsigned val = 0;
+	int i;
 
-	if (attr == &ttm_page_pool_max)
-		val = m->options.max_size;
-	else if (attr == &ttm_page_pool_small)
-		val = m->options.small;
-	else if (attr == &ttm_page_pool_alloc_size)
-		val = m->options.alloc_size;
-
-	val = val * (PAGE_SIZE >> 10);
+	for (i = 0; i < ncpus; i++)
+		val += pool->pcpu[i].npages;
 
-	return snprintf(buffer, PAGE_SIZE, "%u\n", val);
+	return (sysctl_handle_int(oidp, &val, 0, req));
 }
-#endif
 
-static struct ttm_pool_manager *_manager;
+static void ttm_pool_sysctl_init(struct ttm_pool_manager *m)
+{
+	struct sysctl_oid *top, *oid;
+	struct ttm_page_pool *pool;
+	int i;
+
+	sysctl_ctx_init(&m->sysctl_ctx);
+
+	SYSCTL_ADD_PROC(&m->sysctl_ctx, SYSCTL_STATIC_CHILDREN(_hw_dri_ttm),
+	    OID_AUTO, "pool_max_size", CTLTYPE_UINT | CTLFLAG_RW,
+	    m, TTM_POOL_OPT_MAX_SIZE, ttm_pool_sysctl_opt, "IU",
+	    "Maximum size of each page pool (kB)");
+	SYSCTL_ADD_PROC(&m->sysctl_ctx, SYSCTL_STATIC_CHILDREN(_hw_dri_ttm),
+	    OID_AUTO, "pool_small", CTLTYPE_UINT | CTLFLAG_RW,
+	    m, TTM_POOL_OPT_SMALL, ttm_pool_sysctl_opt, "IU",
+	    "Allocations below this size refill the pool first (kB)");
+	SYSCTL_ADD_PROC(&m->sysctl_ctx, SYSCTL_STATIC_CHILDREN(_hw_dri_ttm),
+	    OID_AUTO, "pool_alloc_size", CTLTYPE_UINT | CTLFLAG_RW,
+	    m, TTM_POOL_OPT_ALLOC_SIZE, ttm_pool_sysctl_opt, "IU",
+	    "Size of a pool refill (kB)");
+
+	top = SYSCTL_ADD_NODE(&m->sysctl_ctx,
+	    SYSCTL_STATIC_CHILDREN(_hw_dri_ttm), OID_AUTO, "pool",
+	    CTLFLAG_RD, 0, "Page pools");
+	if (top == NULL)
+		return;
+
+	for (i = 0; i < NUM_POOLS; ++i) {
+		pool = &m->pools[i];
+		oid = SYSCTL_ADD_NODE(&m->sysctl_ctx, SYSCTL_CHILDREN(top),
+		    OID_AUTO, pool->name, CTLFLAG_RD, 0, pool->name);
+		if (oid == NULL)
+			continue;
+
+		SYSCTL_ADD_UINT(&m->sysctl_ctx, SYSCTL_CHILDREN(oid),
+		    OID_AUTO, "size", CTLFLAG_RD, &pool->npages, 0,
+		    "Pages in the shared pool");
+		SYSCTL_ADD_PROC(&m->sysctl_ctx, SYSCTL_CHILDREN(oid),
+		    OID_AUTO, "cached", CTLTYPE_UINT | CTLFLAG_RD, pool, 0,
+		    ttm_pool_sysctl_cached, "IU", "Pages in the per-cpu caches");
+		SYSCTL_ADD_ULONG(&m->sysctl_ctx, SYSCTL_CHILDREN(oid),
+		    OID_AUTO, "refills", CTLFLAG_RD, &pool->nrefills,
+		    "Pool refills");
+		SYSCTL_ADD_ULONG(&m->sysctl_ctx, SYSCTL_CHILDREN(oid),
+		    OID_AUTO, "pages_freed", CTLFLAG_RD, &pool->nfrees,
+		    "Pages freed from the pool");
+	}
+}
 
 static int set_pages_array_wb(vm_page_t *pages, int addrinarray)
 {
@@ -277,8 +373,11 @@ static struct ttm_page_pool *ttm_get_pool(int flags,
 {
 	int pool_index;
 
-	if (cstate == tt_cached)
-		return NULL;
+	if (cstate == tt_cached) {
+		if (flags & TTM_PAGE_FLAG_DMA32)
+			return &_manager->wb_pool_dma32;
+		return &_manager->wb_pool;
+	}
 
 	if (cstate == tt_wc)
 		pool_index = 0x0;
@@ -396,6 +495,40 @@ out:
 	return nr_free;
 }
 
+static void ttm_page_pool_put_pages(struct ttm_page_pool *pool,
+				    vm_page_t *pages, unsigned npages);
+
+/**
+ * Move the pages of the per-cpu caches back to the shared pool.
+ *
+ * Unless @all is set, only the caches which have not been used for
+ * PAGE_FREE_INTERVAL are drained, so that busy cpus keep their pages.
+ */
+static void ttm_page_pool_drain_pcpu(struct ttm_page_pool *pool, bool all)
+{
+	vm_page_t pages[TTM_PCPU_PAGES];
+	struct ttm_page_pcpu *pc;
+	unsigned npages;
+	int i;
+
+	for (i = 0; i < ncpus; i++) {
+		pc = &pool->pcpu[i];
+		npages = 0;
+
+		spin_lock(&pc->lock);
+		if (all || jiffies - pc->last_used >
+		    msecs_to_jiffies(PAGE_FREE_INTERVAL)) {
+			npages = pc->npages;
+			memcpy(pages, pc->pages, npages * sizeof(pages[0]));
+			pc->npages = 0;
+		}
+		spin_unlock(&pc->lock);
+
+		if (npages)
+			ttm_page_pool_put_pages(pool, pages, npages);
+	}
+}
+
 /* Get good estimation how many pages are free in pools */
 static int ttm_pool_get_num_unused_pages(void)
 {
@@ -425,6 +558,7 @@ static int ttm_pool_mm_shrink(void *arg)
 		if (shrink_pages == 0)
 			break;
 		pool = &_manager->pools[(i + pool_offset)%NUM_POOLS];
+		ttm_page_pool_drain_pcpu(pool, false);
 		shrink_pages = ttm_page_pool_free(pool, nr_free);
 	}
 	/* return estimated number of unused pages in pool */
@@ -663,24 +797,12 @@ out:
 	return count;
 }
 
-/* Put all pages in pages list to correct pool to wait for reuse */
-static void ttm_put_pages(vm_page_t *pages, unsigned npages, int flags,
-			  enum ttm_caching_state cstate)
+/* Put the pages in the shared pool to wait for reuse */
+static void ttm_page_pool_put_pages(struct ttm_page_pool *pool,
+				    vm_page_t *pages, unsigned npages)
 {
-	struct ttm_page_pool *pool = ttm_get_pool(flags, cstate);
 	unsigned i;
 
-	if (pool == NULL) {
-		/* No pool for this memory type so free the pages */
-		for (i = 0; i < npages; i++) {
-			if (pages[i]) {
-				ttm_vm_page_free(pages[i]);
-				pages[i] = NULL;
-			}
-		}
-		return;
-	}
-
 	lockmgr(&pool->lock, LK_EXCLUSIVE);
 	for (i = 0; i < npages; i++) {
 		if (pages[i]) {
@@ -703,6 +825,76 @@ static void ttm_put_pages(vm_page_t *pages, unsigned npages, int flags,
 		ttm_page_pool_free(pool, npages);
 }
 
+/**
+ * Take up to @npages pages from this cpu's cache of @pool.
+ *
+ * @return number of pages taken.
+ */
+static unsigned ttm_pcpu_get_pages(struct ttm_page_pool *pool,
+				   vm_page_t *pages, unsigned npages)
+{
+	struct ttm_page_pcpu *pc = &pool->pcpu[mycpuid];
+	unsigned count = 0;
+
+	spin_lock(&pc->lock);
+	while (count < npages && pc->npages > 0)
+		pages[count++] = pc->pages[--pc->npages];
+	pc->last_used = jiffies;
+	spin_unlock(&pc->lock);
+
+	return count;
+}
+
+/**
+ * Stash the pages in this cpu's cache of @pool. When the cache is full its
+ * oldest TTM_PCPU_BATCH pages are moved to the shared pool to make room.
+ */
+static void ttm_pcpu_put_pages(struct ttm_page_pool *pool,
+			       vm_page_t *pages, unsigned npages)
+{
+	vm_page_t drain[TTM_PCPU_BATCH];
+	struct ttm_page_pcpu *pc;
+	unsigned i = 0, ndrain;
+
+	while (i < npages) {
+		ndrain = 0;
+		pc = &pool->pcpu[mycpuid];
+
+		spin_lock(&pc->lock);
+		for (; i < npages && pc->npages < TTM_PCPU_PAGES; i++) {
+			if (pages[i]) {
+				pc->pages[pc->npages++] = pages[i];
+				pages[i] = NULL;
+			}
+		}
+		if (i < npages) {
+			ndrain = TTM_PCPU_BATCH;
+			memcpy(drain, pc->pages, sizeof(drain));
+			pc->npages -= ndrain;
+			memmove(pc->pages, pc->pages + ndrain,
+			    pc->npages * sizeof(pc->pages[0]));
+		}
+		pc->last_used = jiffies;
+		spin_unlock(&pc->lock);
+
+		if (ndrain)
+			ttm_page_pool_put_pages(pool, drain, ndrain);
+	}
+}
+
+/* Put all pages in pages list to correct pool to wait for reuse */
+static void ttm_put_pages(vm_page_t *pages, unsigned npages, int flags,
+			  enum ttm_caching_state cstate)
+{
+	struct ttm_page_pool *pool = ttm_get_pool(flags, cstate);
+
+	/* Large frees would only churn through the cache */
+	if (npages < TTM_PCPU_PAGES)
+		ttm_pcpu_put_pages(pool, pages, npages);
+	else
+		ttm_page_pool_put_pages(pool, pages, npages);
+}
+
 /*
  * On success pages list will hold count number of correctly
  * cached pages.
@@ -711,61 +903,54 @@ static int ttm_get_pages(vm_page_t *pages, unsigned npages, int flags,
 			 enum ttm_caching_state cstate)
 {
 	struct ttm_page_pool *pool = ttm_get_pool(flags, cstate);
+	vm_page_t extra[TTM_PCPU_BATCH];
 	struct pglist plist;
-	vm_page_t p = NULL;
-	int gfp_flags, aflags;
-	unsigned count;
+	vm_page_t p = NULL, p1;
+	int gfp_flags;
+	unsigned count, want, nextra, i;
 	int r;
 
-	aflags = VM_ALLOC_NORMAL |
-	    ((flags & TTM_PAGE_FLAG_ZERO_ALLOC) != 0 ? VM_ALLOC_ZERO : 0);
-
-	/* No pool for cached pages */
-	if (pool == NULL) {
-		for (r = 0; r < npages; ++r) {
-			p = vm_page_alloc_contig(0,
-			    (flags & TTM_PAGE_FLAG_DMA32) ? 0xffffffff :
-			    VM_MAX_ADDRESS, PAGE_SIZE,
-			    0, 1*PAGE_SIZE, ttm_caching_state_to_vm(cstate));
-			if (!p) {
-				pr_err("Unable to allocate page\n");
-				return -ENOMEM;
-			}
-#if 0
-			p->oflags &= ~VPO_UNMANAGED;
-#endif
-			p->flags |= PG_FICTITIOUS;
-			pages[r] = p;
-		}
-		return 0;
-	}
-
 	/* combine zero flag to pool flags */
 	gfp_flags = flags | pool->ttm_page_alloc_flags;
 
-	/* First we take pages from the pool */
-	TAILQ_INIT(&plist);
-	npages = ttm_page_pool_get_pages(pool, &plist, flags, cstate, npages);
-	count = 0;
-	TAILQ_FOREACH(p, &plist, pageq) {
-		pages[count++] = p;
+	/* First we take pages from this cpu's cache */
+	count = ttm_pcpu_get_pages(pool, pages, npages);
+
+	/*
+	 * Then from the pool. Small requests take a whole batch, the pages
+	 * we don't need go to the cache for the next allocations.
+	 */
+	if (count < npages) {
+		want = max(npages - count, (unsigned)TTM_PCPU_BATCH);
+		TAILQ_INIT(&plist);
+		ttm_page_pool_get_pages(pool, &plist, flags, cstate, want);
+
+		nextra = 0;
+		TAILQ_FOREACH_MUTABLE(p, &plist, pageq, p1) {
+			TAILQ_REMOVE(&plist, p, pageq);
+			if (count < npages)
+				pages[count++] = p;
+			else
+				extra[nextra++] = p;
+		}
+		if (nextra)
+			ttm_pcpu_put_pages(pool, extra, nextra);
 	}
 
 	/* clear the pages coming from the pool if requested */
 	if (flags & TTM_PAGE_FLAG_ZERO_ALLOC) {
-		TAILQ_FOREACH(p, &plist, pageq) {
-			pmap_zero_page(VM_PAGE_TO_PHYS(p));
-		}
+		for (i = 0; i < count; i++)
+			pmap_zero_page(VM_PAGE_TO_PHYS(pages[i]));
 	}
 
 	/* If pool didn't have enough pages allocate new one. */
-	if (npages > 0) {
+	if (count < npages) {
 		/* ttm_alloc_new_pages doesn't reference pool so we can run
 		 * multiple requests in parallel.
 		 **/
 		TAILQ_INIT(&plist);
 		r = ttm_alloc_new_pages(&plist, gfp_flags, flags, cstate,
-		    npages);
+		    npages - count);
 		TAILQ_FOREACH(p, &plist, pageq) {
 			pages[count++] = p;
 		}
@@ -784,12 +969,18 @@ static int ttm_get_pages(vm_page_t *pages, unsigned npages, int flags,
 static void ttm_page_pool_init_locked(struct ttm_page_pool *pool, gfp_t flags,
 				      char *name)
 {
+	int i;
+
 	lockinit(&pool->lock, "ttmpool", 0, LK_CANRECURSE);
 	pool->fill_lock = false;
 	TAILQ_INIT(&pool->list);
 	pool->npages = pool->nfrees = 0;
 	pool->ttm_page_alloc_flags = flags;
 	pool->name = name;
+	pool->pcpu = kmalloc(ncpus * sizeof(*pool->pcpu), M_DRM,
+	    M_WAITOK | M_ZERO);
+	for (i = 0; i < ncpus; i++)
+		spin_init(&pool->pcpu[i].lock, "ttmpcpu");
 }
 
 int ttm_page_alloc_init(struct ttm_mem_global *glob, unsigned max_pages)
@@ -803,9 +994,12 @@ int ttm_page_alloc_init(struct ttm_mem_global *glob, unsigned max_pages)
 	ttm_page_pool_init_locked(&_manager->wc_pool, 0, "wc");
 	ttm_page_pool_init_locked(&_manager->uc_pool, 0, "uc");
 	ttm_page_pool_init_locked(&_manager->wc_pool_dma32,
-	    TTM_PAGE_FLAG_DMA32, "wc dma");
+	    TTM_PAGE_FLAG_DMA32, "wc_dma32");
 	ttm_page_pool_init_locked(&_manager->uc_pool_dma32,
-	    TTM_PAGE_FLAG_DMA32, "uc dma");
+	    TTM_PAGE_FLAG_DMA32, "uc_dma32");
+	ttm_page_pool_init_locked(&_manager->wb_pool, 0, "wb");
+	ttm_page_pool_init_locked(&_manager->wb_pool_dma32,
+	    TTM_PAGE_FLAG_DMA32, "wb_dma32");
 
 	_manager->options.max_size = max_pages;
 	_manager->options.small = SMALL_ALLOCATION;
@@ -813,6 +1007,7 @@ int ttm_page_alloc_init(struct ttm_mem_global *glob, unsigned max_pages)
 
 	refcount_init(&_manager->kobj_ref, 1);
 	ttm_pool_mm_shrink_init(_manager);
+	ttm_pool_sysctl_init(_manager);
 
 	return 0;
 }
@@ -822,10 +1017,14 @@ void ttm_page_alloc_fini(void)
 	int i;
 
 	pr_info("Finalizing pool allocator\n");
+	sysctl_ctx_free(&_manager->sysctl_ctx);
 	ttm_pool_mm_shrink_fini(_manager);
 
-	for (i = 0; i < NUM_POOLS; ++i)
+	for (i = 0; i < NUM_POOLS; ++i) {
+		ttm_page_pool_drain_pcpu(&_manager->pools[i], true);
 		ttm_page_pool_free(&_manager->pools[i], FREE_ALL_PAGES);
+		kfree(_manager->pools[i].pcpu);
+	}
 
 	if (refcount_release(&_manager->kobj_ref))
 		ttm_pool_kobj_release(_manager);